@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ==================== ADC SAMPLER ====================
+// Continuous A0 sampling through the ESP32-S3 ADC DMA controller. The
+// hardware converts at `sampleRate` into the driver's DMA pool; a reader
+// task drains it, averages every `oversample` conversions into one
+// decimated value and publishes that as latest(), so readers never touch
+// the ADC and never wait.
+//
+// The driver drops conversions when its pool fills up before the reader
+// task gets to it; each such overflow is counted in lossEvents().
+//
+// While running, analogRead() on ADC1 must not be used; go through the
+// sampler instead.
+struct AdcStats
+{
+    uint32_t conversions; // raw samples received
+    uint32_t decimated;   // averaged values published
+    uint32_t lossEvents;  // driver pool overflows (samples dropped)
+    uint32_t foreign;     // samples from an unexpected channel, ignored
+};
+
+class AdcSampler
+{
+public:
+    static const uint32_t MIN_SAMPLE_RATE = 1000;
+    static const uint32_t MAX_SAMPLE_RATE = 80000;
+    static const uint32_t MAX_OVERSAMPLE = 256;
+
+    AdcSampler();
+
+    // Only while stopped
+    void setSampleRate(uint32_t hz) { sampleRate = hz; }
+    void setOversample(uint32_t count) { oversample = count; }
+
+    bool start(uint8_t pin);
+    void stop();
+
+    bool running() const { return active; }
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getOversample() const { return oversample; }
+
+    // Most recent decimated value (0-4095); O(1), safe from any task
+    uint16_t latest() const { return latestValue; }
+    AdcStats stats() const;
+
+private:
+    uint32_t sampleRate;
+    uint32_t oversample;
+    uint8_t channel;
+    TaskHandle_t readerTask;
+    volatile bool active;
+    volatile bool stopRequested;
+    volatile uint16_t latestValue;
+    volatile uint32_t conversions;
+    volatile uint32_t decimated;
+    volatile uint32_t lossEvents;
+    volatile uint32_t foreign;
+
+    static void readerEntry(void *parameter);
+    void readLoop();
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// ==================== ALLOCATION COUNTER ====================
+// Counts heap calls made through malloc/calloc/realloc/free (and so also
+// new/delete and Arduino String). The build links with
+// -Wl,--wrap=malloc etc. and defines ALLOC_COUNTER_WRAP; without those the
+// counters stay at zero and allocationCounting() returns false.
+//
+// ESP-IDF drivers that call heap_caps_malloc() directly are not seen.
+struct AllocStats
+{
+    uint32_t allocations; // successful malloc/calloc/realloc calls
+    uint32_t frees;       // free() of a non-null pointer
+    uint32_t failures;    // calls that returned null
+};
+
+bool allocationCounting();
+AllocStats allocationStats();
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== BINARY PROTOCOL ====================
+// Opt-in framed protocol used after the BINARY_MODE text command.
+//
+// Frame on the wire:  COBS( opcode | sequence | payload... | crc32 ) 0x00
+//   - opcode:   host->device: the command's opcode from the command table
+//               device->host: one of the FRAME_* opcodes below
+//   - sequence: sender's counter, echoed in ACK frames for matching
+//   - payload:  command argument as little-endian int32 (or empty),
+//               or the typed body of a device frame
+//   - crc32:    little-endian CRC-32 (IEEE) over opcode..payload
+//
+// Plain C++ with no Arduino dependency; the same encoder/decoder is meant
+// to be linked into host tools.
+
+// Device -> host frame opcodes
+// payload: request opcode, request sequence, DispatchResult (u8 each),
+// applied value (i32, 0 unless ok), device micros() after the handler (u32)
+const uint8_t FRAME_ACK = 0x80;
+const size_t ACK_FRAME_SIZE = 11;
+const uint8_t FRAME_TEXT = 0x81; // payload: one line of text, no terminator
+const uint8_t FRAME_JSON = 0x82; // payload: one JSON message, no terminator
+// payload: window ms (u32), loop busy permille (u16), core 0 and core 1
+// load permille (u16 each, PROFILE_LOAD_UNKNOWN without run-time stats),
+// scope count (u8), then per scope in PROFILE order: count, mean us,
+// p99 us, max us (u32 each)
+const uint8_t FRAME_PROFILE = 0x83;
+const size_t PROFILE_FRAME_HEADER_SIZE = 11;
+const size_t PROFILE_FRAME_SCOPE_SIZE = 16;
+const uint16_t PROFILE_LOAD_UNKNOWN = 0xFFFF;
+// payload: TELEMETRY_STREAM records, layout in TelemetryRecord.h
+const uint8_t FRAME_TELEMETRY = 0x84;
+// payload: tier (u8), row version (u8), row size (u8), row count (u8),
+// absolute index of the first row (u32), then the rows as packed in
+// TelemetryHistory.h. A frame with no rows ends the dump; its index is
+// where the next dump of the tier would continue.
+const uint8_t FRAME_HISTORY = 0x85;
+const size_t HISTORY_FRAME_HEADER_SIZE = 8;
+// TIME_SYNC reply. payload: when the request was received and when this
+// reply was queued, esp_timer microseconds (u64 each)
+const uint8_t FRAME_TIME = 0x86;
+const size_t TIME_FRAME_SIZE = 16;
+
+// Host -> device: a command to run at a device time rather than on
+// arrival. payload: time (u64, esp_timer microseconds), the command's
+// opcode (u8), then its argument as usual. Acknowledged when queued;
+// the outcome follows as a "scheduled" JSON message.
+const uint8_t OPCODE_SCHEDULE = 0x76;
+const size_t SCHEDULE_HEADER_SIZE = 9;
+
+const size_t FRAME_HEADER_SIZE = 2;
+const size_t FRAME_CRC_SIZE = 4;
+const size_t FRAME_MAX_PAYLOAD = 1024; // holds the largest JSON message
+const size_t FRAME_MAX_DECODED = FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE;
+// COBS adds one byte per 254 plus the leading code byte, then the delimiter
+const size_t FRAME_MAX_ENCODED = FRAME_MAX_DECODED + FRAME_MAX_DECODED / 254 + 2;
+
+struct BinaryFrame
+{
+    uint8_t opcode;
+    uint8_t sequence;
+    const uint8_t *payload;
+    size_t length;
+};
+
+uint32_t frameCrc32(const uint8_t *data, size_t length);
+
+// Returns the encoded size, 0 if `out` is too small
+size_t cobsEncode(const uint8_t *in, size_t length, uint8_t *out, size_t capacity);
+// Returns the decoded size, 0 on a malformed block. `in` excludes the delimiter.
+size_t cobsDecode(const uint8_t *in, size_t length, uint8_t *out, size_t capacity);
+
+// Builds a complete frame including the trailing 0x00 delimiter.
+// Returns its size, 0 if the payload or `out` is too large/small.
+size_t encodeFrame(uint8_t opcode, uint8_t sequence,
+                   const uint8_t *payload, size_t length,
+                   uint8_t *out, size_t capacity);
+
+// Byte-at-a-time frame receiver. feed() returns true when a frame with a
+// valid CRC has been completed; its payload points into the decoder and
+// stays valid until the next feed().
+class FrameDecoder
+{
+public:
+    FrameDecoder() : received(0), overflowing(false), badFrames(0), overflows(0) {}
+
+    bool feed(uint8_t byte, BinaryFrame &frame);
+    void reset();
+
+    uint32_t badFrameCount() const { return badFrames; }
+    uint32_t overflowCount() const { return overflows; }
+
+private:
+    uint8_t encoded[FRAME_MAX_ENCODED];
+    uint8_t decoded[FRAME_MAX_DECODED];
+    size_t received;
+    bool overflowing;
+    uint32_t badFrames;
+    uint32_t overflows;
+};
+
+inline int32_t readInt32LE(const uint8_t *data)
+{
+    return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                     ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+inline void writeUint16LE(uint8_t *data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+inline void writeInt32LE(uint8_t *data, int32_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)((uint32_t)value >> 8);
+    data[2] = (uint8_t)((uint32_t)value >> 16);
+    data[3] = (uint8_t)((uint32_t)value >> 24);
+}
+
+inline uint64_t readUint64LE(const uint8_t *data)
+{
+    return (uint64_t)(uint32_t)readInt32LE(data) | ((uint64_t)(uint32_t)readInt32LE(data + 4) << 32);
+}
+
+inline void writeUint64LE(uint8_t *data, uint64_t value)
+{
+    writeInt32LE(data, (int32_t)(uint32_t)value);
+    writeInt32LE(data + 4, (int32_t)(uint32_t)(value >> 32));
+}
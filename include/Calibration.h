@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== OUTPUT CALIBRATION ====================
+// Linearizes optical output. A calibration curve holds the A0 photodiode
+// reading at CAL_POINTS evenly spaced raw setpoints (0, 4096, ... 65535).
+// load() inverts it into a LUT so that a requested power fraction maps to
+// the raw setpoint that produces it: one table lookup and one linear
+// interpolation per conversion.
+//
+// Requested power is relative to the curve: 0 is the dark reading at zero
+// duty, LASER_SETPOINT_MAX is the reading at full duty. Flat stretches
+// (below the lasing threshold) are skipped, so the first step above zero
+// lands at the threshold.
+//
+// Has no Arduino dependency so it can be exercised on the host.
+const size_t CAL_POINTS = 17;
+const size_t CAL_LUT_SIZE = 256; // entry i is requested power i * 257
+const uint16_t CAL_MIN_SPAN = 64; // readings the curve must rise to be usable
+
+// Raw setpoint of curve point `index`
+inline uint32_t calibrationSetpoint(size_t index)
+{
+    return index + 1 < CAL_POINTS ? (uint32_t)index * 4096 : 65535;
+}
+
+class Calibration
+{
+public:
+    Calibration() : enabled(false), lut(), knots() {}
+
+    // Back to the uncalibrated, linear mapping
+    void clear() { enabled = false; }
+
+    // Builds the inverse LUT. Rejects curves that decrease or barely rise.
+    bool load(const uint16_t curve[CAL_POINTS]);
+
+    // Requested power (0-65535) to raw setpoint
+    uint32_t linearize(uint32_t setpoint) const
+    {
+        if (!enabled)
+        {
+            return setpoint;
+        }
+        uint32_t index = setpoint / 257;
+        uint32_t fraction = setpoint % 257;
+        if (fraction == 0)
+        {
+            return lut[index];
+        }
+        int32_t step = (int32_t)lut[index + 1] - (int32_t)lut[index];
+        return (uint32_t)((int32_t)lut[index] + (step * (int32_t)fraction + 128) / 257);
+    }
+
+    bool active() const { return enabled; }
+    const uint16_t *curve() const { return knots; }
+
+    // Least-squares monotonic fit (pool adjacent violators) of a sweep taken
+    // at `count` evenly spaced raw setpoints from 0 to 65535, resampled to
+    // the curve points. `count` must be at least 2 and at most CAL_MAX_SWEEP.
+    static const size_t CAL_MAX_SWEEP = 128;
+    static void fitMonotonic(const uint16_t *sweep, size_t count, uint16_t curve[CAL_POINTS]);
+
+private:
+    bool enabled;
+    uint16_t lut[CAL_LUT_SIZE];
+    uint16_t knots[CAL_POINTS];
+};
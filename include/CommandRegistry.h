@@ -0,0 +1,414 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ==================== COMMAND REGISTRY ====================
+// Compile-time command table with a perfect-hash index. Each command is
+// looked up with one pass over its name, one table probe and one strncmp,
+// and its argument is parsed straight out of the receive buffer.
+//
+// The index is built in a constexpr constructor using hash-and-displace:
+// names are grouped into buckets by their FNV-1a hash and each bucket gets
+// a displacement that sends all its names to free slots. A duplicate name
+// or an unsolvable table makes the constructor non-constant, which turns
+// into a compile error at the constexpr declaration.
+//
+// Every command also has a fixed opcode (0x01-0x7F) for the binary
+// protocol; opcodes must be unique and stay stable across versions.
+
+enum class ArgType : uint8_t
+{
+    None,   // NAME
+    Int,    // NAME:value, value checked against [minValue, maxValue]
+    IntList // NAME:v1,v2,... each checked; handler runs once per value
+};
+
+enum class DispatchResult : uint8_t
+{
+    Ok,
+    UnknownCommand,
+    BadArgument,
+    Rejected // Handler refused it in the current state (set by the firmware)
+};
+
+typedef void (*CommandHandler)(int32_t value);
+
+struct CommandSpec
+{
+    uint8_t opcode;
+    const char *name;
+    ArgType argType;
+    const char *argName;
+    int32_t minValue;
+    int32_t maxValue;
+    CommandHandler handler;
+    const char *group; // Help section; nullptr hides the command from help
+    const char *help;
+};
+
+constexpr CommandSpec command(uint8_t opcode, const char *name, CommandHandler handler,
+                              const char *group, const char *help)
+{
+    return CommandSpec{opcode, name, ArgType::None, nullptr, 0, 0, handler, group, help};
+}
+
+constexpr CommandSpec commandWithInt(uint8_t opcode, const char *name, const char *argName,
+                                     int32_t minValue, int32_t maxValue,
+                                     CommandHandler handler,
+                                     const char *group, const char *help)
+{
+    return CommandSpec{opcode, name, ArgType::Int, argName, minValue, maxValue, handler, group, help};
+}
+
+constexpr CommandSpec commandWithIntList(uint8_t opcode, const char *name, const char *argName,
+                                         int32_t minValue, int32_t maxValue,
+                                         CommandHandler handler,
+                                         const char *group, const char *help)
+{
+    return CommandSpec{opcode, name, ArgType::IntList, argName, minValue, maxValue, handler, group, help};
+}
+
+// Strict decimal parse of [text, text + length); no partial matches.
+inline bool parseInt32(const char *text, size_t length, int32_t &value)
+{
+    size_t i = 0;
+    bool negative = false;
+    if (i < length && (text[i] == '-' || text[i] == '+'))
+    {
+        negative = text[i] == '-';
+        i++;
+    }
+    if (i == length)
+    {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (; i < length; i++)
+    {
+        char c = text[i];
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+        result = result * 10 + (c - '0');
+        if (result > 0x80000000LL)
+        {
+            return false;
+        }
+    }
+
+    result = negative ? -result : result;
+    if (result > INT32_MAX)
+    {
+        return false;
+    }
+    value = (int32_t)result;
+    return true;
+}
+
+// Power-of-two slot count with at least half the slots left empty
+constexpr size_t commandSlotCount(size_t count)
+{
+    size_t slots = 16;
+    while (slots < count * 2)
+    {
+        slots *= 2;
+    }
+    return slots;
+}
+
+// Deliberately not constexpr: reaching one during constant evaluation is
+// what reports a bad table.
+inline void commandTableHasNoPerfectHash() {}
+inline void commandTableHasBadOpcode() {}
+
+template <size_t N>
+class CommandRegistry
+{
+public:
+    static constexpr size_t SLOTS = commandSlotCount(N);
+    static constexpr size_t BUCKETS = SLOTS / 4;
+
+    constexpr CommandRegistry(const CommandSpec (&table)[N]) : specs(table)
+    {
+        uint32_t hashes[N] = {};
+        uint8_t bucketSize[BUCKETS] = {};
+        size_t largest = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            uint8_t opcode = table[i].opcode;
+            if (opcode == 0 || opcode >= 0x80 || opcodes[opcode] != 0)
+            {
+                commandTableHasBadOpcode();
+            }
+            opcodes[opcode] = (uint8_t)(i + 1);
+
+            hashes[i] = hashName(table[i].name, lengthOf(table[i].name));
+            size_t b = hashes[i] & (BUCKETS - 1);
+            bucketSize[b]++;
+            if (bucketSize[b] > largest)
+            {
+                largest = bucketSize[b];
+            }
+        }
+
+        // Place the most crowded buckets first while the table is emptiest
+        for (size_t size = largest; size > 0; size--)
+        {
+            for (size_t b = 0; b < BUCKETS; b++)
+            {
+                if (bucketSize[b] == size)
+                {
+                    placeBucket(b, hashes);
+                }
+            }
+        }
+    }
+
+    const CommandSpec *find(const char *name, size_t length) const
+    {
+        uint32_t hash = hashName(name, length);
+        uint8_t entry = slots[slotFor(hash, displacement[hash & (BUCKETS - 1)])];
+        if (entry == 0)
+        {
+            return nullptr;
+        }
+
+        const CommandSpec &spec = specs[entry - 1];
+        if (strncmp(spec.name, name, length) != 0 || spec.name[length] != '\0')
+        {
+            return nullptr;
+        }
+        return &spec;
+    }
+
+    const CommandSpec *findOpcode(uint8_t opcode) const
+    {
+        uint8_t entry = opcode < 0x80 ? opcodes[opcode] : 0;
+        return entry == 0 ? nullptr : &specs[entry - 1];
+    }
+
+    // Splits "NAME[:arg]", validates the argument against the
+    // command's schema and runs its handler.
+    DispatchResult dispatch(const char *line, size_t length) const
+    {
+        const CommandSpec *spec = match(line, length);
+        return spec ? execute(*spec, line, length) : DispatchResult::UnknownCommand;
+    }
+
+    // The command a "NAME[:arg]" line names, without running it
+    const CommandSpec *match(const char *line, size_t length) const
+    {
+        const char *colon = static_cast<const char *>(memchr(line, ':', length));
+        return find(line, colon ? (size_t)(colon - line) : length);
+    }
+
+    // Second half of dispatch() for a spec returned by match(). `argument`
+    // receives the value the handler ran with (the last one of a list).
+    DispatchResult execute(const CommandSpec &spec, const char *line, size_t length,
+                           int32_t *argument = nullptr) const
+    {
+        const char *colon = static_cast<const char *>(memchr(line, ':', length));
+        size_t nameLength = colon ? (size_t)(colon - line) : length;
+
+        if (spec.argType == ArgType::IntList)
+        {
+            return colon ? invokeList(spec, colon + 1, length - nameLength - 1, argument)
+                         : DispatchResult::BadArgument;
+        }
+
+        int32_t value = 0;
+        if (colon != nullptr &&
+            !parseInt32(colon + 1, length - nameLength - 1, value))
+        {
+            return DispatchResult::BadArgument;
+        }
+        return invoke(spec, colon != nullptr, value, argument);
+    }
+
+    // Binary protocol: arguments are little-endian int32s (one, or several
+    // back to back for a list)
+    DispatchResult dispatchOpcode(uint8_t opcode, const uint8_t *payload, size_t length) const
+    {
+        const CommandSpec *spec = findOpcode(opcode);
+        return spec ? executePayload(*spec, payload, length) : DispatchResult::UnknownCommand;
+    }
+
+    // Second half of dispatchOpcode() for a spec returned by findOpcode()
+    DispatchResult executePayload(const CommandSpec &spec, const uint8_t *payload, size_t length,
+                                  int32_t *argument = nullptr) const
+    {
+        if (length % 4 != 0 || (spec.argType != ArgType::IntList && length > 4))
+        {
+            return DispatchResult::BadArgument;
+        }
+
+        if (spec.argType == ArgType::IntList)
+        {
+            if (length == 0)
+            {
+                return DispatchResult::BadArgument;
+            }
+            for (size_t i = 0; i < length; i += 4)
+            {
+                int32_t value = readLE(payload + i);
+                if (value < spec.minValue || value > spec.maxValue)
+                {
+                    return DispatchResult::BadArgument;
+                }
+            }
+            for (size_t i = 0; i < length; i += 4)
+            {
+                run(spec, readLE(payload + i), argument);
+            }
+            return DispatchResult::Ok;
+        }
+
+        int32_t value = length == 4 ? readLE(payload) : 0;
+        return invoke(spec, length == 4, value, argument);
+    }
+
+    constexpr size_t size() const { return N; }
+    constexpr const CommandSpec &operator[](size_t index) const { return specs[index]; }
+
+private:
+    const CommandSpec *specs;
+    uint8_t displacement[BUCKETS] = {};
+    uint8_t slots[SLOTS] = {};  // index + 1 into specs, 0 = empty
+    uint8_t opcodes[0x80] = {}; // index + 1 into specs by opcode, 0 = unused
+
+    static int32_t readLE(const uint8_t *data)
+    {
+        return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                         ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+    }
+
+    // The argument is stored first so a handler can overwrite it with the
+    // value it actually applied
+    static void run(const CommandSpec &spec, int32_t value, int32_t *argument)
+    {
+        if (argument != nullptr)
+        {
+            *argument = value;
+        }
+        spec.handler(value);
+    }
+
+    // Validates every comma-separated value before running any of them
+    static DispatchResult invokeList(const CommandSpec &spec, const char *text, size_t length,
+                                     int32_t *argument)
+    {
+        for (int pass = 0; pass < 2; pass++)
+        {
+            size_t start = 0;
+            while (start <= length)
+            {
+                const char *comma = static_cast<const char *>(memchr(text + start, ',', length - start));
+                size_t end = comma ? (size_t)(comma - text) : length;
+
+                int32_t value;
+                if (!parseInt32(text + start, end - start, value) ||
+                    value < spec.minValue || value > spec.maxValue)
+                {
+                    return DispatchResult::BadArgument;
+                }
+                if (pass == 1)
+                {
+                    run(spec, value, argument);
+                }
+                start = end + 1;
+            }
+        }
+        return DispatchResult::Ok;
+    }
+
+    static DispatchResult invoke(const CommandSpec &spec, bool hasArgument, int32_t value,
+                                 int32_t *argument)
+    {
+        if (spec.argType == ArgType::None)
+        {
+            if (hasArgument)
+            {
+                return DispatchResult::BadArgument;
+            }
+        }
+        else if (!hasArgument || value < spec.minValue || value > spec.maxValue)
+        {
+            return DispatchResult::BadArgument;
+        }
+
+        run(spec, value, argument);
+        return DispatchResult::Ok;
+    }
+
+    static constexpr size_t lengthOf(const char *text)
+    {
+        size_t length = 0;
+        while (text[length] != '\0')
+        {
+            length++;
+        }
+        return length;
+    }
+
+    static constexpr uint32_t hashName(const char *name, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    // murmur3 finalizer over the hash plus the bucket's displacement
+    static constexpr size_t slotFor(uint32_t hash, uint8_t shift)
+    {
+        uint32_t x = hash + shift * 0x9E3779B1u;
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        return x & (SLOTS - 1);
+    }
+
+    constexpr void placeBucket(size_t bucket, const uint32_t (&hashes)[N])
+    {
+        for (unsigned shift = 0; shift < 256; shift++)
+        {
+            bool taken[SLOTS] = {};
+            bool fits = true;
+            for (size_t i = 0; i < N && fits; i++)
+            {
+                if ((hashes[i] & (BUCKETS - 1)) != bucket)
+                {
+                    continue;
+                }
+                size_t slot = slotFor(hashes[i], (uint8_t)shift);
+                fits = slots[slot] == 0 && !taken[slot];
+                taken[slot] = true;
+            }
+            if (!fits)
+            {
+                continue;
+            }
+
+            displacement[bucket] = (uint8_t)shift;
+            for (size_t i = 0; i < N; i++)
+            {
+                if ((hashes[i] & (BUCKETS - 1)) == bucket)
+                {
+                    slots[slotFor(hashes[i], (uint8_t)shift)] = (uint8_t)(i + 1);
+                }
+            }
+            return;
+        }
+
+        // No displacement works (duplicate command name?)
+        commandTableHasNoPerfectHash();
+    }
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== JSON WRITER ====================
+// Streaming JSON encoder over a caller-supplied buffer. Nothing is allocated:
+// numbers are formatted by hand and strings are escaped as they are copied.
+// If the buffer runs out the output is truncated and overflowed() is set, so
+// callers can check once at the end instead of after every field.
+class JsonWriter
+{
+public:
+    JsonWriter(char *buffer, size_t capacity);
+
+    JsonWriter &beginObject();
+    JsonWriter &endObject();
+
+    JsonWriter &stringField(const char *key, const char *value);
+    JsonWriter &boolField(const char *key, bool value);
+    JsonWriter &intField(const char *key, int32_t value);
+    JsonWriter &uintField(const char *key, uint32_t value);
+    JsonWriter &uint64Field(const char *key, uint64_t value); // 64-bit divisions; off hot paths
+    // Writes scaled / 10^decimals, e.g. fixedField("v", 165, 2) -> "v":1.65
+    JsonWriter &fixedField(const char *key, int32_t scaled, uint8_t decimals);
+    JsonWriter &uintArrayField(const char *key, const uint16_t *values, size_t count);
+
+    // Terminates the message with "\r\n" (same framing as Serial.println)
+    JsonWriter &endLine();
+
+    const char *data() const { return buffer; }
+    size_t length() const { return used; }
+    bool overflowed() const { return overflow; }
+
+private:
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    bool overflow;
+    bool needComma;
+
+    void key(const char *name);
+    void put(char c);
+    void putRaw(const char *text);
+    void putEscaped(const char *text);
+    void putUnsigned(uint32_t value, uint8_t minDigits);
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== LATENCY STATS ====================
+// Log2 histograms of command latency, per command and per stage, in CPU
+// cycles. Recording is a count-leading-zeros, an add and a compare, so it
+// stays enabled in production builds.
+//
+// Bucket 0 holds everything below 2^LATENCY_MIN_SHIFT cycles, bucket b
+// covers [2^(b+LATENCY_MIN_SHIFT-1), 2^(b+LATENCY_MIN_SHIFT)) and the last
+// bucket is open-ended. Counts saturate at 65535.
+//
+// Histograms are kept for the first LATENCY_SLOTS - 1 distinct commands
+// seen after a reset; anything after that shares the last slot.
+enum class LatencyStage : uint8_t
+{
+    Receive,  // first byte read from the UART to complete line/frame
+    Queue,    // complete to dispatch start (other commands ahead of it)
+    Handler,  // dispatch start to handler return
+    Apply,    // handler return to the laser task applying the output
+    EndToEnd, // first byte to output applied
+    Count
+};
+
+const size_t LATENCY_STAGES = (size_t)LatencyStage::Count;
+const size_t LATENCY_BUCKETS = 20;
+const uint8_t LATENCY_MIN_SHIFT = 7; // bucket 0 < 128 cycles, last >= 2^25
+const size_t LATENCY_SLOTS = 16;
+const uint8_t LATENCY_OTHER = 0xFF; // opcode reported for the shared slot
+
+class LatencyStats
+{
+public:
+    LatencyStats() { reset(); }
+
+    // Histogram slot for a command opcode, assigned on first use
+    uint8_t slotFor(uint8_t opcode);
+
+    void record(uint8_t slot, LatencyStage stage, uint32_t cycles)
+    {
+        Histogram &h = histograms[slot][(size_t)stage];
+        uint32_t bucket = cycles >> LATENCY_MIN_SHIFT == 0
+                              ? 0
+                              : 31 - __builtin_clz(cycles) - LATENCY_MIN_SHIFT + 1;
+        if (bucket >= LATENCY_BUCKETS)
+        {
+            bucket = LATENCY_BUCKETS - 1;
+        }
+        if (h.counts[bucket] != UINT16_MAX)
+        {
+            h.counts[bucket]++;
+        }
+        if (cycles > h.maxCycles)
+        {
+            h.maxCycles = cycles;
+        }
+    }
+
+    void reset();
+
+    size_t slotsUsed() const { return used; }
+    uint8_t opcode(size_t slot) const { return opcodes[slot]; }
+    const uint16_t *counts(size_t slot, LatencyStage stage) const { return histograms[slot][(size_t)stage].counts; }
+    uint32_t maxCycles(size_t slot, LatencyStage stage) const { return histograms[slot][(size_t)stage].maxCycles; }
+    uint32_t samples(size_t slot, LatencyStage stage) const;
+
+private:
+    struct Histogram
+    {
+        uint16_t counts[LATENCY_BUCKETS];
+        uint32_t maxCycles;
+    };
+
+    Histogram histograms[LATENCY_SLOTS][LATENCY_STAGES];
+    uint8_t opcodes[LATENCY_SLOTS];
+    size_t used;
+};
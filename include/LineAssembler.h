@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ==================== SERIAL LINE ASSEMBLER ====================
+// Collects bytes from a stream into a fixed static buffer and hands out
+// complete command lines in place. Never waits for more data: poll() only
+// takes what the UART driver already holds, so a partial line from the host
+// can no longer stall loop() for the Stream timeout.
+//
+// Lines are returned as pointers into the buffer (NUL-terminated, trimmed,
+// '\r\n' and '\n' both accepted) and stay valid until the next poll()/feed().
+// Lines longer than MAX_LINE_LENGTH after trimming are discarded up to the
+// next newline and counted in droppedLines().
+//
+// Has no Arduino dependency so it can be driven from a host build against a
+// stubbed Serial.
+class LineAssembler
+{
+public:
+    static const size_t BUFFER_SIZE = 512;
+    static const size_t MAX_LINE_LENGTH = 200;
+
+    LineAssembler() : start(0), scan(0), end(0), discarding(false), dropped(0) {}
+
+    // Pulls whatever bytes the stream already has, up to the free space.
+    // Returns the number of bytes taken.
+    template <typename StreamT>
+    size_t poll(StreamT &stream)
+    {
+        int available = stream.available();
+        if (available <= 0)
+        {
+            return 0;
+        }
+
+        size_t room = reserve();
+        size_t count = (size_t)available < room ? (size_t)available : room;
+        count = stream.read(reinterpret_cast<uint8_t *>(buffer + end), count);
+        end += count;
+        return count;
+    }
+
+    // Appends raw bytes. Returns how many fit; the caller should drain lines
+    // with nextLine() and feed the remainder again.
+    size_t feed(const char *data, size_t length)
+    {
+        size_t room = reserve();
+        size_t count = length < room ? length : room;
+        memcpy(buffer + end, data, count);
+        end += count;
+        return count;
+    }
+
+    // Yields the next complete, non-empty line. Call repeatedly until it
+    // returns false to consume several commands delivered in one read.
+    bool nextLine(char *&line, size_t &length)
+    {
+        while (scan < end)
+        {
+            char *newline = static_cast<char *>(memchr(buffer + scan, '\n', end - scan));
+            if (newline == nullptr)
+            {
+                scan = end;
+                break;
+            }
+
+            size_t lineStart = start;
+            size_t lineEnd = newline - buffer;
+            start = scan = lineEnd + 1;
+
+            if (discarding)
+            {
+                discarding = false;
+                continue;
+            }
+
+            // Trim in place (also strips the '\r' of a "\r\n" terminator)
+            // before the length check, so the limit applies to the command
+            trim(lineStart, lineEnd);
+            if (lineEnd == lineStart)
+            {
+                continue;
+            }
+            if (lineEnd - lineStart > MAX_LINE_LENGTH)
+            {
+                dropped++;
+                continue;
+            }
+
+            buffer[lineEnd] = '\0';
+            line = buffer + lineStart;
+            length = lineEnd - lineStart;
+            return true;
+        }
+
+        // Partial line already too long, or filling the buffer with padding:
+        // drop what we have and skip the rest
+        if (end - start > MAX_LINE_LENGTH && (partialTooLong() || end - start == BUFFER_SIZE))
+        {
+            if (!discarding)
+            {
+                dropped++;
+                discarding = true;
+            }
+            start = scan = end;
+        }
+
+        return false;
+    }
+
+    uint32_t droppedLines() const { return dropped; }
+    size_t pending() const { return end - start; }
+
+private:
+    char buffer[BUFFER_SIZE];
+    size_t start; // first byte of the line being assembled
+    size_t scan;  // bytes before this are known not to contain '\n'
+    size_t end;   // one past the last received byte
+    bool discarding;
+    uint32_t dropped;
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    void trim(size_t &from, size_t &to) const
+    {
+        while (from < to && isSpace(buffer[from]))
+        {
+            from++;
+        }
+        while (to > from && isSpace(buffer[to - 1]))
+        {
+            to--;
+        }
+    }
+
+    // Surrounding whitespace does not count; a '\r' may still be waiting
+    // for its '\n'
+    bool partialTooLong() const
+    {
+        size_t from = start;
+        size_t to = end;
+        trim(from, to);
+        return to - from > MAX_LINE_LENGTH;
+    }
+
+    // Free space at the tail, compacting the unconsumed bytes to the front
+    // when the tail is exhausted. Only the partial line is ever moved.
+    size_t reserve()
+    {
+        if (start == end)
+        {
+            start = scan = end = 0;
+        }
+        else if (end == BUFFER_SIZE && start > 0)
+        {
+            memmove(buffer, buffer + start, end - start);
+            scan -= start;
+            end -= start;
+            start = 0;
+        }
+        return BUFFER_SIZE - end;
+    }
+};
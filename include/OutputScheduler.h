@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ==================== OUTPUT SCHEDULER ====================
+// Writes one LEDC duty at a given instant of the 64-bit esp_timer clock.
+// The laser task only ticks every millisecond, so when a scheduled output
+// is due within the next tick it arms a one-shot hardware timer alarm
+// instead; the ISR writes the duty and stamps the time it actually did.
+class OutputScheduler
+{
+public:
+    OutputScheduler();
+
+    // Laser task only. `at` is in esp_timer_get_time() microseconds; an
+    // instant already passed fires on the next timer tick.
+    void arm(uint8_t channel, uint32_t duty, uint64_t at);
+    // Disarms, or releases an alarm that has fired
+    void cancel();
+
+    bool armed() const { return pending; }
+    bool fired() const { return done; }
+    uint32_t firedDuty() const { return duty; }
+    // Valid once fired()
+    uint64_t firedAt() const { return firedTime; }
+
+    void onTimer(); // ISR body
+
+private:
+    uint8_t channel;
+    uint32_t duty;
+    hw_timer_t *timer;
+    bool pending; // armed, not yet taken by the laser task
+    volatile bool done;
+    volatile uint64_t firedTime;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== POWER CONTROLLER ====================
+// Fixed-point PID that holds the photodiode reading on A0 at a target by
+// adjusting the laser setpoint. Integer math only, one update() per tick.
+//
+// Units: target and measurement are ADC counts (0-4095), the output is a
+// setpoint fraction (0-65535). Gains are Q8.8 fixed point, so 256 means one
+// setpoint step per count of error (Ki per tick, Kd per count of change per
+// tick). The derivative acts on the measurement so target steps do not kick
+// the output. Anti-windup: the integrator is clamped to the output range
+// and stops accumulating in the direction the output is saturated.
+//
+// Has no Arduino dependency so it can be exercised on the host.
+struct PowerTelemetry
+{
+    uint32_t ticks;         // updates since the last target change
+    uint32_t settlingTicks; // ticks until |error| stayed inside the band, 0 = not settled
+    int32_t lastError;
+    int32_t lastMeasurement;
+    uint32_t lastOutput;
+    int32_t meanErrorCenti;  // mean error since settling, hundredths of a count
+    uint32_t peakError;      // largest |error| since settling
+    uint32_t saturatedTicks; // ticks with the output pinned at 0 or full scale
+};
+
+class PowerController
+{
+public:
+    static const int32_t ADC_MAX = 4095;
+    static const uint32_t OUTPUT_MAX = 65535;
+    static const int32_t GAIN_MAX = 32767; // keeps every term inside int32
+    static const uint32_t SETTLE_HOLD = 20; // ticks inside the band to count as settled
+
+    PowerController();
+
+    void setTarget(int32_t counts);
+    void setGains(int32_t kp, int32_t ki, int32_t kd);
+
+    // Bumpless start: the integrator takes over from `output`
+    void reset(uint32_t output);
+
+    // One control step. Returns the new setpoint fraction.
+    uint32_t update(int32_t measurement);
+
+    int32_t getTarget() const { return target; }
+    int32_t getKp() const { return kp; }
+    int32_t getKi() const { return ki; }
+    int32_t getKd() const { return kd; }
+    const PowerTelemetry &telemetry() const { return stats; }
+
+private:
+    int32_t target;
+    int32_t kp;
+    int32_t ki;
+    int32_t kd;
+    int32_t integral; // Q8, clamped to [0, OUTPUT_MAX << 8]
+    int32_t previousMeasurement;
+    bool primed;      // previousMeasurement is valid
+    uint32_t inBand;  // consecutive ticks inside the settling band
+    int64_t errorSum; // since settling, for the mean
+    uint32_t errorCount;
+    PowerTelemetry stats;
+
+    void restartTelemetry();
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== PROFILER ====================
+// Timing accumulator for one named scope, in microseconds. Keeps count,
+// min, max and total, plus a histogram with four buckets per power of two
+// so percentiles come out within 12.5% without storing samples. Recording
+// is a count-leading-zeros and a few adds.
+//
+// Has no Arduino dependency so it can be exercised on the host.
+const size_t PROFILE_BUCKETS = 72; // exact below 8us, open-ended above 2^18us
+
+struct ProfileSummary
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t meanUs;
+    uint32_t p50Us;
+    uint32_t p90Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope() { reset(); }
+
+    void record(uint32_t us)
+    {
+        size_t bucket = bucketFor(us);
+        if (counts[bucket] != UINT16_MAX)
+        {
+            counts[bucket]++;
+        }
+        count++;
+        totalUs += us;
+        if (us < minUs)
+        {
+            minUs = us;
+        }
+        if (us > maxUs)
+        {
+            maxUs = us;
+        }
+    }
+
+    void reset();
+
+    // Value below which `permille` of the samples fall (bucket midpoint,
+    // clamped to the observed min/max). 0 with no samples.
+    uint32_t percentile(uint16_t permille) const;
+    ProfileSummary summary() const;
+
+    uint32_t samples() const { return count; }
+    uint64_t total() const { return totalUs; }
+
+private:
+    uint16_t counts[PROFILE_BUCKETS];
+    uint32_t count;
+    uint64_t totalUs;
+    uint32_t minUs;
+    uint32_t maxUs;
+
+    static size_t bucketFor(uint32_t us)
+    {
+        if (us < 4)
+        {
+            return us;
+        }
+        uint32_t msb = 31 - __builtin_clz(us);
+        size_t bucket = (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+        return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+    }
+
+    static uint32_t bucketLow(size_t bucket);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "SpscQueue.h"
+
+// ==================== SAMPLE STREAM ====================
+// Jitter buffer for host-streamed duty samples. loop() pushes samples as
+// they arrive over serial; a hardware timer ISR pops one per tick and
+// writes it to LEDC, so playout runs at a fixed rate no matter how bursty
+// the link is.
+//
+// Playout starts once `prefill` samples are buffered and re-primes the same
+// way after an underrun, holding the last value meanwhile. If nothing is
+// played for a full second the stream counts as starved and the laser task
+// returns to the steady setpoint.
+class SampleStream
+{
+public:
+    static const size_t CAPACITY = 1023;
+    static const uint32_t MAX_SAMPLE_RATE = 20000;
+
+    SampleStream();
+
+    // Producer side (loop). Returns false and counts an overrun when full.
+    bool push(uint16_t duty);
+
+    // Only while stopped
+    void clear();
+    void setSampleRate(uint32_t hz) { sampleRate = hz; }
+    void setPrefill(uint32_t samples) { prefill = samples; }
+
+    // Timer control; called from the laser task only
+    void start(uint8_t channel);
+    void stop();
+
+    bool running() const { return active; }
+    bool starved() const { return idleTicks >= sampleRate; }
+    size_t fill() const { return buffer.size(); }
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getPrefill() const { return prefill; }
+    uint32_t playedSamples() const { return played; }
+    uint32_t underrunCount() const { return underruns; }
+    uint32_t overrunCount() const { return overruns; }
+    uint16_t lastDuty() const { return writtenDuty; }
+
+    void onTimer(); // ISR body
+
+private:
+    SpscQueue<uint16_t, CAPACITY + 1> buffer;
+    uint32_t sampleRate;
+    uint32_t prefill;
+    uint8_t channel;
+    hw_timer_t *timer;
+    volatile bool active;
+    volatile bool primed;
+    volatile uint32_t idleTicks;
+    volatile uint32_t played;
+    volatile uint32_t underruns;
+    volatile uint16_t writtenDuty;
+    uint32_t overruns;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Preferences.h>
+
+// ==================== SETTINGS CACHE ====================
+// Write-behind cache in front of Preferences. Setters only update RAM and
+// mark the key dirty; poll() commits dirty keys once the settings have been
+// quiet for QUIET_PERIOD, or at the latest MAX_DELAY after the first
+// unsaved change, so a slider drag costs one NVS write instead of hundreds.
+// A value set back to what NVS already holds is not written at all.
+//
+// Call flush() before anything that can lose RAM (restart, deep sleep).
+struct SettingsStats
+{
+    uint32_t commits;      // poll()/flush() calls that wrote something
+    uint32_t writes;       // keys written to NVS
+    uint32_t erases;       // keys removed from NVS
+    uint32_t lastCommitUs; // duration of the most recent commit
+    uint32_t maxCommitUs;
+};
+
+class SettingsCache
+{
+public:
+    static const size_t MAX_KEYS = 16;
+    static const uint32_t QUIET_PERIOD = 500; // ms without changes before committing
+    static const uint32_t MAX_DELAY = 5000;   // ms a change may stay unsaved
+
+    explicit SettingsCache(Preferences &preferences);
+
+    // Reads through to NVS on first use, RAM afterwards
+    uint32_t getUInt(const char *key, uint32_t defaultValue);
+    uint8_t getUChar(const char *key, uint8_t defaultValue);
+    int32_t getInt(const char *key, int32_t defaultValue);
+
+    void putUInt(const char *key, uint32_t value);
+    void putUChar(const char *key, uint8_t value);
+    void putInt(const char *key, int32_t value);
+
+    // Blobs are written rarely and go straight to NVS. getBytes() returns
+    // the stored length, 0 if the key is missing or does not fit.
+    size_t getBytes(const char *key, void *data, size_t length);
+    bool putBytes(const char *key, const void *data, size_t length);
+
+    // Immediate; also forgets any cached value
+    void remove(const char *key);
+
+    // Returns true if anything was committed
+    bool poll(uint32_t nowMs);
+    bool flush();
+
+    size_t pendingKeys() const;
+    const SettingsStats &stats() const { return counters; }
+
+private:
+    enum class Type : uint8_t
+    {
+        UInt,
+        UChar,
+        Int
+    };
+
+    // Keys are string literals, compared by content
+    struct Entry
+    {
+        const char *key;
+        Type type;
+        bool stored;  // NVS holds `committed`
+        bool pending; // `value` still has to be written
+        uint32_t value;
+        uint32_t committed;
+    };
+
+    Preferences &prefs;
+    Entry entries[MAX_KEYS];
+    size_t count;
+    bool dirty;
+    uint32_t firstChangeMs;
+    uint32_t lastChangeMs;
+    SettingsStats counters;
+
+    Entry *lookup(const char *key, Type type, uint32_t defaultValue);
+    void put(const char *key, Type type, uint32_t value);
+};
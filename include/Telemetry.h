@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== TELEMETRY PUBLISHER ====================
+// Decides which telemetry fields go out and when. The host subscribes to a
+// set of fields; each one is reported when it has moved by more than its
+// deadband (but no sooner than minIntervalMs after its last report), when
+// maxIntervalMs passes without a report, and in every keyframe.
+//
+// Fields are plain int32 values identified by index; the caller samples
+// them, asks for the due set as a bitmask and formats the message.
+//
+// Has no Arduino dependency so it can be exercised on the host.
+struct TelemetryFieldConfig
+{
+    uint32_t minIntervalMs; // rate limit for change reports
+    uint32_t maxIntervalMs; // report at least this often, 0 = keyframes only
+    uint32_t deadband;      // change needed to report, 0 = any change
+};
+
+class TelemetryPublisher
+{
+public:
+    static const size_t MAX_FIELDS = 32;
+
+    TelemetryPublisher() : fieldCount(0), subscribedFields(0), reportedFields(0) {}
+
+    void begin(const TelemetryFieldConfig *defaults, size_t count, uint32_t subscribed);
+
+    void subscribe(uint32_t fields);
+    uint32_t subscribed() const { return subscribedFields; }
+    bool configure(size_t field, const TelemetryFieldConfig &config);
+    const TelemetryFieldConfig &config(size_t field) const { return configs[field]; }
+
+    // Subscribed fields due at `now` for a change report; they count as
+    // reported from here on. `values` holds one entry per field.
+    uint32_t collectChanges(const int32_t *values, uint32_t now);
+    // Every subscribed field, likewise marked reported
+    uint32_t collectKeyframe(const int32_t *values, uint32_t now);
+
+private:
+    TelemetryFieldConfig configs[MAX_FIELDS];
+    int32_t lastValues[MAX_FIELDS];
+    uint32_t lastReports[MAX_FIELDS]; // ms
+    size_t fieldCount;
+    uint32_t subscribedFields;
+    uint32_t reportedFields; // fields with a valid lastValues entry
+
+    void markReported(size_t field, int32_t value, uint32_t now);
+};
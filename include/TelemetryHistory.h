@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== TELEMETRY HISTORY ====================
+// Round-robin history of a few channels at three resolutions: raw samples,
+// per-second rollups and per-minute rollups (min, max, mean and sample
+// count). Each raw sample updates the open second in O(1); a closed second
+// updates the open minute the same way, so nothing is ever rescanned.
+//
+// Rows are addressed by absolute index (rows ever written to the tier);
+// the newest `capacity` of them are held. A reader that falls behind sees
+// the index jump instead of getting overwritten rows.
+//
+// Storage is handed in by the caller so it can come from PSRAM. Has no
+// Arduino dependency so it can be exercised on the host.
+const size_t HISTORY_CHANNELS = 5;
+const size_t HISTORY_TIERS = 3;
+const uint8_t HISTORY_RAW = 0;
+const uint8_t HISTORY_SECONDS = 1;
+const uint8_t HISTORY_MINUTES = 2;
+
+// Packed rows, little-endian: time_ms (u32) then per channel value (i32)
+// for raw rows; time_ms (u32), samples (u32), then per channel min, max
+// and mean (i32 each) for rollups
+const uint8_t HISTORY_ROW_VERSION = 1;
+const size_t HISTORY_RAW_ROW_SIZE = 4 + 4 * HISTORY_CHANNELS;
+const size_t HISTORY_ROLLUP_ROW_SIZE = 8 + 12 * HISTORY_CHANNELS;
+
+struct HistorySample
+{
+    uint32_t timeMs;
+    int32_t values[HISTORY_CHANNELS];
+};
+
+struct HistoryRollup
+{
+    uint32_t timeMs; // start of the second/minute
+    uint32_t samples;
+    int32_t minimum[HISTORY_CHANNELS];
+    int32_t maximum[HISTORY_CHANNELS];
+    int32_t mean[HISTORY_CHANNELS];
+};
+
+class TelemetryHistory
+{
+public:
+    static const uint32_t SECOND_MS = 1000;
+    static const uint32_t MINUTE_MS = 60000;
+
+    TelemetryHistory();
+
+    // Any buffer may be null (capacity 0) to leave its tier empty
+    void begin(HistorySample *raw, size_t rawCapacity,
+               HistoryRollup *seconds, size_t secondsCapacity,
+               HistoryRollup *minutes, size_t minutesCapacity);
+
+    void record(uint32_t nowMs, const int32_t values[HISTORY_CHANNELS]);
+
+    size_t capacity(uint8_t tier) const { return tiers[tier].capacity; }
+    uint32_t written(uint8_t tier) const { return tiers[tier].written; }
+    // Oldest absolute index still held
+    uint32_t oldest(uint8_t tier) const;
+    static size_t rowSize(uint8_t tier) { return tier == HISTORY_RAW ? HISTORY_RAW_ROW_SIZE : HISTORY_ROLLUP_ROW_SIZE; }
+
+    // Packs row `index` into `out` (rowSize bytes); false once it is gone
+    bool packRow(uint8_t tier, uint32_t index, uint8_t *out) const;
+
+private:
+    struct Tier
+    {
+        size_t capacity;
+        uint32_t written;
+    };
+
+    struct Accumulator
+    {
+        uint32_t startMs;
+        uint32_t samples;
+        int32_t minimum[HISTORY_CHANNELS];
+        int32_t maximum[HISTORY_CHANNELS];
+        int64_t sum[HISTORY_CHANNELS];
+    };
+
+    Tier tiers[HISTORY_TIERS];
+    HistorySample *rawRows;
+    HistoryRollup *rollupRows[HISTORY_TIERS]; // [0] unused
+    Accumulator open[HISTORY_TIERS];          // [0] unused
+
+    void accumulate(uint8_t tier, uint32_t timeMs, uint32_t samples,
+                    const int32_t *minimum, const int32_t *maximum, const int64_t *sum);
+    void close(uint8_t tier);
+};
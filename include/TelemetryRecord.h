@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== TELEMETRY RECORDS ====================
+// Fixed-layout samples streamed by TELEMETRY_STREAM, taken by the laser
+// task on its 1kHz tick. A FRAME_TELEMETRY payload is a header followed by
+// `count` records of `record size` bytes, all little-endian:
+//
+//   header:  layout version (u8) | record size (u8) | count (u8)
+//   record:  offset  size
+//     sequence      0     2  u16, +1 per record taken; a jump means loss
+//     time_us       2     4  u32 micros() at the tick
+//     duty          6     2  u16 LEDC duty being output
+//     a0            8     2  u16 A0 reading (filtered when sampling continuously)
+//     flags        10     1  TELEMETRY_FLAG_*
+//     output_mode  11     1  0 steady, 1 waveform, 2 stream, 3 power loop
+//
+// New fields are only ever appended, with a new layout version, so a
+// decoder can read the fields it knows and skip to the next record by
+// size. TELEMETRY_LAYOUT reports the same table at run time.
+//
+// Has no Arduino dependency; tools/telemetry_decode.cpp uses it on the host.
+const uint8_t TELEMETRY_LAYOUT_VERSION = 1;
+const size_t TELEMETRY_RECORD_SIZE = 12;
+const size_t TELEMETRY_FRAME_HEADER_SIZE = 3;
+
+const uint8_t TELEMETRY_FLAG_LASER_ON = 0x01;
+const uint8_t TELEMETRY_FLAG_CALIBRATING = 0x02;
+const uint8_t TELEMETRY_FLAG_A0_FILTERED = 0x04; // continuous sampler, not a one-shot read
+
+struct TelemetryRecord
+{
+    uint16_t sequence;
+    uint32_t timeUs;
+    uint16_t duty;
+    uint16_t a0;
+    uint8_t flags;
+    uint8_t outputMode;
+};
+
+struct TelemetryFieldInfo
+{
+    const char *name;
+    uint8_t offset;
+    uint8_t size;
+};
+
+const TelemetryFieldInfo TELEMETRY_LAYOUT[] = {
+    {"sequence", 0, 2}, {"time_us", 2, 4}, {"duty", 6, 2},
+    {"a0", 8, 2},       {"flags", 10, 1},  {"output_mode", 11, 1},
+};
+const size_t TELEMETRY_LAYOUT_FIELDS = sizeof(TELEMETRY_LAYOUT) / sizeof(TELEMETRY_LAYOUT[0]);
+
+inline void packTelemetryRecord(const TelemetryRecord &record, uint8_t out[TELEMETRY_RECORD_SIZE])
+{
+    out[0] = (uint8_t)record.sequence;
+    out[1] = (uint8_t)(record.sequence >> 8);
+    for (int i = 0; i < 4; i++)
+    {
+        out[2 + i] = (uint8_t)(record.timeUs >> (8 * i));
+    }
+    out[6] = (uint8_t)record.duty;
+    out[7] = (uint8_t)(record.duty >> 8);
+    out[8] = (uint8_t)record.a0;
+    out[9] = (uint8_t)(record.a0 >> 8);
+    out[10] = record.flags;
+    out[11] = record.outputMode;
+}
+
+inline void unpackTelemetryRecord(const uint8_t *in, TelemetryRecord &record)
+{
+    record.sequence = (uint16_t)(in[0] | (in[1] << 8));
+    record.timeUs = (uint32_t)in[2] | ((uint32_t)in[3] << 8) | ((uint32_t)in[4] << 16) | ((uint32_t)in[5] << 24);
+    record.duty = (uint16_t)(in[6] | (in[7] << 8));
+    record.a0 = (uint16_t)(in[8] | (in[9] << 8));
+    record.flags = in[10];
+    record.outputMode = in[11];
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== TX QUEUE ====================
+// Outbound message queue in front of the UART. Callers push whole lines and
+// return immediately; pump() later moves bytes to the driver, but only as
+// many as availableForWrite() says fit, so a saturated link never blocks the
+// caller. The UART driver's TX-empty interrupt does the rest.
+//
+// Classes are served in strict priority order and a started message is
+// always finished before switching, so lines never interleave. A message
+// that does not fit is dropped whole and counted. Heartbeats coalesce: a
+// new one replaces any heartbeat still waiting.
+enum class TxClass : uint8_t
+{
+    Response,  // direct replies to host commands
+    Event,     // unsolicited state changes
+    Heartbeat, // periodic telemetry, only the newest is kept
+    Stream,    // high-rate telemetry records, never coalesced
+    Log,       // informational chatter, dropped first
+    Count
+};
+
+struct TxStats
+{
+    uint32_t queuedBytes;
+    uint32_t sentBytes;
+    uint32_t droppedBytes;
+    uint32_t droppedMessages;
+    uint32_t coalescedMessages;
+};
+
+class TxQueue
+{
+public:
+    TxQueue();
+
+    // Enqueues text followed by "\r\n" as one message
+    bool pushLine(TxClass cls, const char *text, size_t length);
+    // Enqueues raw bytes as one message (no terminator added)
+    bool push(TxClass cls, const char *data, size_t length);
+
+    // Writes as many bytes as the writer has room for, highest priority first.
+    // Classes below `last` wait (a started message is still finished).
+    // Returns the number of bytes handed to the writer.
+    template <typename PrintT>
+    size_t pump(PrintT &out, TxClass last = TxClass::Log)
+    {
+        int room = out.availableForWrite();
+        size_t budget = room > 0 ? (size_t)room : 0;
+        size_t sent = 0;
+
+        while (sent < budget)
+        {
+            const char *chunk;
+            size_t length = nextChunk(chunk, budget - sent, last);
+            if (length == 0)
+            {
+                break;
+            }
+            out.write(reinterpret_cast<const uint8_t *>(chunk), length);
+            consume(length);
+            sent += length;
+        }
+        return sent;
+    }
+
+    // Blocking: pushes everything out (used before restart)
+    template <typename PrintT>
+    void drain(PrintT &out)
+    {
+        const char *chunk;
+        size_t length;
+        while ((length = nextChunk(chunk, SIZE_MAX, TxClass::Log)) > 0)
+        {
+            out.write(reinterpret_cast<const uint8_t *>(chunk), length);
+            consume(length);
+        }
+        out.flush();
+    }
+
+    size_t pendingBytes() const;
+    // Nothing from `last` or above left to hand over, and no message half sent
+    bool drained(TxClass last) const;
+    // Room left in one class's ring; each message also takes 2 bytes of it
+    size_t freeBytes(TxClass cls) const { return rings[(uint8_t)cls].size - rings[(uint8_t)cls].used; }
+    const TxStats &stats(TxClass cls) const { return rings[(uint8_t)cls].stats; }
+    TxStats totals() const;
+
+private:
+    struct Ring
+    {
+        char *data;
+        size_t size;
+        size_t head; // next byte to send
+        size_t used;
+        size_t messages;
+        size_t remaining; // bytes left in the message being sent, 0 = none started
+        bool coalesce;
+        TxStats stats;
+    };
+
+    Ring rings[(uint8_t)TxClass::Count];
+    int8_t active; // ring with a partially sent message, -1 = none
+
+    bool enqueue(TxClass cls, const char *data, size_t length, bool newline);
+    void copyIn(Ring &ring, size_t &tail, const char *data, size_t length);
+    size_t nextChunk(const char *&chunk, size_t limit, TxClass last);
+    void consume(size_t length);
+};
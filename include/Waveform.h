@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ==================== WAVEFORM ENGINE ====================
+// Plays a 256-entry duty table out of a hardware timer ISR using a 32-bit
+// phase accumulator (DDS): every tick the phase advances by a step derived
+// from the waveform frequency and the top 8 bits pick the table entry.
+//
+// Tables are double-buffered. loadTable() fills the idle buffer and the ISR
+// swaps it in (together with any new frequency) when the phase wraps, so a
+// running waveform only ever changes shape at a cycle boundary.
+//
+// The ISR records the spacing of its own invocations with the CPU cycle
+// counter so timing jitter can be reported from the device.
+
+const size_t WAVE_TABLE_SIZE = 256;
+
+enum class WaveShape : uint8_t
+{
+    Sine,
+    Square,
+    Triangle,
+    Sawtooth,
+    Arbitrary
+};
+
+struct WaveTiming
+{
+    uint32_t samples;
+    uint32_t expectedCycles; // CPU cycles between ticks at the set sample rate
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+};
+
+// Fills `out` with one period in setpoint units (0-65535). Shape values
+// span -1..+1 around `offset`, scaled by `amplitude` (both in permille of
+// full power) and clamped. Arbitrary points are permille, centred on 500,
+// and are resampled to the table size with linear interpolation.
+void generateWave(WaveShape shape, uint16_t amplitude, uint16_t offset,
+                  const uint16_t *points, size_t pointCount,
+                  uint16_t out[WAVE_TABLE_SIZE]);
+
+class WaveformEngine
+{
+public:
+    static const uint32_t MAX_SAMPLE_RATE = 40000;
+
+    WaveformEngine();
+
+    // Copies a duty table into the idle buffer and queues it, together with
+    // the frequency, for the next cycle boundary (or now, when stopped)
+    void loadTable(const uint16_t duties[WAVE_TABLE_SIZE], uint32_t frequencyMilliHz);
+    void setSampleRate(uint32_t hz) { sampleRate = hz; }
+    void setCycles(uint32_t count) { targetCycles = count; }
+
+    // Clears the cycle count and finished flag before a new run is requested
+    void rearm();
+
+    // Timer control; called from the laser task only
+    void start(uint8_t channel);
+    void stop();
+
+    bool running() const { return active; }
+    bool finished() const { return done; }
+    uint32_t completedCycles() const { return cycles; }
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getTargetCycles() const { return targetCycles; }
+    uint16_t lastDuty() const { return writtenDuty; }
+
+    WaveTiming timing();
+    void resetTiming();
+
+    void onTimer(); // ISR body
+
+private:
+    uint16_t tables[2][WAVE_TABLE_SIZE];
+    volatile uint8_t current;
+    volatile bool swapPending;
+    volatile uint32_t phase;
+    volatile uint32_t phaseStep;
+    uint32_t pendingStep;
+    uint32_t sampleRate;
+    uint32_t targetCycles; // 0 = run until stopped
+    volatile uint32_t cycles;
+    volatile bool active;
+    volatile bool done;
+    volatile uint16_t writtenDuty;
+    uint8_t channel;
+    hw_timer_t *timer;
+
+    uint32_t lastTick;
+    WaveTiming stats;
+
+    uint32_t stepFor(uint32_t frequencyMilliHz) const;
+};
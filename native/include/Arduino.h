@@ -0,0 +1,159 @@
+#pragma once
+
+#include <functional>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ==================== NATIVE HAL ====================
+// Host stand-ins for the parts of Arduino-ESP32 and FreeRTOS the firmware
+// uses, for the [env:native] build. Serial is stdin/stdout, time is the
+// host's monotonic clock (optionally sped up), tasks and hardware timers
+// are threads, and LEDC and A0 are plain variables (see NativeHal.h to
+// drive them).
+//
+// Only what src/ calls is provided; add to it as the firmware grows.
+
+// -------------------- Pins --------------------
+const uint8_t INPUT = 0x01;
+const uint8_t OUTPUT = 0x03;
+const uint8_t A0 = 1; // GPIO1 on the ESP32-S3
+
+void pinMode(uint8_t pin, uint8_t mode);
+uint16_t analogRead(uint8_t pin);
+int8_t digitalPinToAnalogChannel(uint8_t pin); // -1: no ADC DMA on the host
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+// -------------------- Time --------------------
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+int64_t esp_timer_get_time(); // microseconds since boot, 64-bit (esp_timer.h on the ESP32)
+
+// -------------------- LEDC --------------------
+uint32_t ledcSetup(uint8_t channel, uint32_t frequency, uint8_t resolution);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+uint32_t ledcChangeFrequency(uint8_t channel, uint32_t frequency, uint8_t resolution);
+
+// -------------------- Hardware timers --------------------
+// Counts at 80MHz / divider like the APB-clocked timers; each enabled alarm
+// runs its callback on a thread of its own.
+struct hw_timer_t;
+hw_timer_t *timerBegin(uint8_t number, uint16_t divider, bool countUp);
+void timerAttachInterrupt(hw_timer_t *timer, void (*callback)(), bool edge);
+void timerAlarmWrite(hw_timer_t *timer, uint64_t ticks, bool autoreload);
+void timerWrite(hw_timer_t *timer, uint64_t ticks);
+void timerAlarmEnable(hw_timer_t *timer);
+void timerAlarmDisable(hw_timer_t *timer);
+
+// -------------------- FreeRTOS --------------------
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+
+#define configMAX_PRIORITIES 25
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms)) // 1kHz tick
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stackSize,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core);
+void vTaskDelete(TaskHandle_t task); // only nullptr (the calling task) is supported
+TickType_t xTaskGetTickCount();
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t period);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+// Spinlock; ISR variants are the same lock since "ISRs" are threads here
+typedef struct
+{
+    volatile int locked;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+inline void nativeEnterCritical(portMUX_TYPE *mux)
+{
+    while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE))
+    {
+    }
+}
+
+inline void nativeExitCritical(portMUX_TYPE *mux)
+{
+    __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+#define portENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) nativeExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) nativeExitCritical(mux)
+
+// -------------------- Chip --------------------
+uint32_t getCpuFrequencyMhz();
+
+class EspClass
+{
+public:
+    uint32_t getCycleCount(); // host clock scaled to getCpuFreqMHz()
+    uint32_t getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+    uint32_t getHeapSize() { return 327680; }
+    uint32_t getFreeHeap() { return 262144; }
+    uint32_t getMinFreeHeap() { return 262144; }
+    uint32_t getMaxAllocHeap() { return 131072; }
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+    uint32_t getFlashChipSize() { return 8 * 1024 * 1024; }
+    const char *getChipModel() { return "ESP32-S3 (native)"; }
+    uint8_t getChipRevision() { return 0; }
+    const char *getSdkVersion() { return "native"; }
+    void restart(); // runs the restart handler, or exits
+};
+
+extern EspClass ESP;
+
+// -------------------- Serial --------------------
+// TX drains at the configured baud rate in virtual time (10 bits per byte)
+// through a 128-byte FIFO plus the driver buffer, so availableForWrite()
+// fills up like the real UART's, and bytes reach the host as they would
+// leave the wire. Input arrives at the same rate and is handed over as the
+// RX interrupt would (see setRxFIFOFull/setRxTimeout), which is also when
+// the onReceive() callback runs.
+typedef std::function<void(void)> OnReceiveCb;
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    void updateBaudRate(unsigned long baud);
+    void setTxBufferSize(size_t size);
+    void setRxBufferSize(size_t size) { (void)size; }
+    bool setRxFIFOFull(uint8_t fifoBytes);
+    bool setRxTimeout(uint8_t symbols);
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+    explicit operator bool() const { return true; }
+
+    int available();
+    int read();
+    size_t read(uint8_t *buffer, size_t size);
+    int availableForWrite();
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+    size_t write(const uint8_t *buffer, size_t size);
+    void flush(); // until the last byte has left the wire
+};
+
+extern HardwareSerial Serial;
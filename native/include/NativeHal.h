@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// ==================== NATIVE HAL HOOKS ====================
+// What the host side of the native build can see and change: the clock,
+// the serial port, the signal on each analog pin and the duty on each
+// LEDC channel. The configuration calls are made before setup().
+
+// Virtual clock: runs `speed` times faster than the host clock and starts
+// at `startMs` (e.g. just before the 32-bit millis() wrap). Sleeps, task
+// periods and timer alarms all shrink by the same factor.
+void nativeSetClock(double speed, uint64_t startMs);
+
+// Serial on `fd` (a pty master) instead of stdin/stdout
+void nativeSetSerialFd(int fd);
+// True once the serial input has reached end of file (stdin only)
+bool nativeInputClosed();
+// True when the serial output has been on the wire and quiet for `ms`
+bool nativeOutputIdle(uint32_t ms);
+
+// A0 model for the photodiode: `dark` below `thresholdPermille` of full
+// duty on LEDC `channel`, rising linearly to `full` at 100%, plus uniform
+// noise of +-`noise` counts
+void nativeSetPhotodiode(uint8_t channel, uint16_t dark, uint16_t full, uint16_t thresholdPermille, uint16_t noise);
+void nativeSetAnalog(uint8_t pin, uint16_t value);
+
+// Every LEDC duty change is appended to `file` as
+// time_us,channel,duty,resolution (virtual microseconds since boot)
+void nativeSetTimeline(FILE *file);
+uint32_t nativeLedcDuty(uint8_t channel);
+uint32_t nativeLedcFrequency(uint8_t channel);
+uint8_t nativeLedcResolution(uint8_t channel);
+
+// Called by ESP.restart(); without a handler the process exits
+void nativeSetRestartHandler(void (*handler)());
+
+// Preferences kept in `path` and rewritten on every change
+void nativeSetPreferencesFile(const char *path);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ==================== NATIVE PREFERENCES ====================
+// NVS for the native build: same calls and return values as the
+// Arduino-ESP32 Preferences, one flat namespace. Kept in memory, or in the
+// file given to nativeSetPreferencesFile() so it survives RESTART.
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() {}
+
+    bool isKey(const char *key);
+    bool remove(const char *key);
+    bool clear();
+
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putInt(const char *key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putBytes(const char *key, const void *value, size_t length);
+
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return getScalar(key, defaultValue); }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return getScalar(key, defaultValue); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return getScalar(key, defaultValue); }
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buffer, size_t length);
+
+private:
+    static const size_t MAX_ENTRIES = 64;
+    static const size_t MAX_KEY = 15; // NVS key limit
+    static const size_t MAX_VALUE = 64;
+
+    struct Entry
+    {
+        char key[MAX_KEY + 1];
+        uint8_t value[MAX_VALUE];
+        size_t length;
+        bool used;
+    };
+
+    Entry entries[MAX_ENTRIES] = {};
+    bool writable = false;
+
+    Entry *find(const char *key);
+    void load();
+    void save();
+
+    template <typename T>
+    T getScalar(const char *key, T defaultValue)
+    {
+        Entry *entry = find(key);
+        if (entry == nullptr || entry->length != sizeof(T))
+        {
+            return defaultValue;
+        }
+        T value;
+        memcpy(&value, entry->value, sizeof(T));
+        return value;
+    }
+};
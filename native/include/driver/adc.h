@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+// ==================== NATIVE ADC DRIVER ====================
+// Declarations AdcSampler needs to compile on the host. There is no
+// continuous converter: digitalPinToAnalogChannel() reports no channel, so
+// the sampler never starts and readings come from analogRead().
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_TIMEOUT 0x107
+
+#define SOC_ADC_CHANNEL_NUM(unit) 10
+#define SOC_ADC_DIGI_MAX_BITWIDTH 12
+#define SOC_ADC_DIGI_RESULT_BYTES 4
+
+#define ADC_ATTEN_DB_11 3
+
+typedef enum
+{
+    ADC_CONV_SINGLE_UNIT_1 = 1
+} adc_digi_convert_mode_t;
+
+typedef enum
+{
+    ADC_DIGI_OUTPUT_FORMAT_TYPE2 = 1
+} adc_digi_output_format_t;
+
+typedef struct
+{
+    uint32_t max_store_buf_size;
+    uint32_t conv_num_each_intr;
+    uint32_t adc1_chan_mask;
+    uint32_t adc2_chan_mask;
+} adc_digi_init_config_t;
+
+typedef struct
+{
+    uint8_t atten;
+    uint8_t channel;
+    uint8_t unit;
+    uint8_t bit_width;
+} adc_digi_pattern_config_t;
+
+typedef struct
+{
+    bool conv_limit_en;
+    uint32_t conv_limit_num;
+    uint32_t pattern_num;
+    adc_digi_pattern_config_t *adc_pattern;
+    uint32_t sample_freq_hz;
+    adc_digi_convert_mode_t conv_mode;
+    adc_digi_output_format_t format;
+} adc_digi_configuration_t;
+
+typedef struct
+{
+    union
+    {
+        struct
+        {
+            uint32_t data : 12;
+            uint32_t reserved12 : 1;
+            uint32_t channel : 4;
+            uint32_t unit : 1;
+            uint32_t reserved18 : 14;
+        } type2;
+        uint32_t val;
+    };
+} adc_digi_output_data_t;
+
+inline esp_err_t adc_digi_initialize(const adc_digi_init_config_t *config)
+{
+    (void)config;
+    return ESP_FAIL;
+}
+
+inline esp_err_t adc_digi_deinitialize() { return ESP_OK; }
+
+inline esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t *config)
+{
+    (void)config;
+    return ESP_FAIL;
+}
+
+inline esp_err_t adc_digi_start() { return ESP_OK; }
+inline esp_err_t adc_digi_stop() { return ESP_OK; }
+
+inline esp_err_t adc_digi_read_bytes(uint8_t *buffer, uint32_t length, uint32_t *read, uint32_t timeoutMs)
+{
+    (void)buffer;
+    (void)length;
+    (void)timeoutMs;
+    *read = 0;
+    return ESP_ERR_TIMEOUT;
+}
@@ -0,0 +1,732 @@
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "NativeHal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// ==================== TIME ====================
+// Virtual time = startNanos + host time since boot * clockSpeed
+static const std::chrono::steady_clock::time_point bootClock = std::chrono::steady_clock::now();
+static double clockSpeed = 1.0;
+static uint64_t clockStartNanos = 0;
+
+void nativeSetClock(double speed, uint64_t startMs)
+{
+    clockSpeed = speed > 0 ? speed : 1.0;
+    clockStartNanos = startMs * 1000000ull;
+}
+
+static uint64_t nanosSinceBoot()
+{
+    uint64_t host = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - bootClock)
+                        .count();
+    return clockStartNanos + (uint64_t)(host * clockSpeed);
+}
+
+// Host deadline for a virtual timestamp
+static std::chrono::steady_clock::time_point hostTimeAt(uint64_t virtualNanos)
+{
+    uint64_t elapsed = virtualNanos > clockStartNanos ? virtualNanos - clockStartNanos : 0;
+    return bootClock + std::chrono::nanoseconds((uint64_t)(elapsed / clockSpeed));
+}
+
+static void sleepVirtual(uint64_t nanos)
+{
+    std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)(nanos / clockSpeed)));
+}
+
+// Truncated to 32 bits so the counters wrap where the ESP32's do
+unsigned long millis()
+{
+    return (uint32_t)(nanosSinceBoot() / 1000000);
+}
+
+unsigned long micros()
+{
+    return (uint32_t)(nanosSinceBoot() / 1000);
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)(nanosSinceBoot() / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    sleepVirtual(ms * 1000000ull);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    sleepVirtual(us * 1000ull);
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return 240;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)(nanosSinceBoot() * getCpuFrequencyMhz() / 1000);
+}
+
+static void (*restartHandler)() = nullptr;
+
+void nativeSetRestartHandler(void (*handler)())
+{
+    restartHandler = handler;
+}
+
+void EspClass::restart()
+{
+    if (restartHandler != nullptr)
+    {
+        restartHandler();
+    }
+    fprintf(stderr, "native: restart requested, exiting\n");
+    exit(0);
+}
+
+// ==================== PINS AND LEDC ====================
+static const size_t NATIVE_PINS = 49;
+static const size_t NATIVE_LEDC_CHANNELS = 8;
+
+struct LedcChannel
+{
+    std::atomic<uint32_t> duty;
+    std::atomic<uint32_t> frequency;
+    std::atomic<uint8_t> resolution;
+};
+
+struct Photodiode
+{
+    bool enabled;
+    uint8_t channel;
+    uint16_t dark;
+    uint16_t full;
+    uint16_t thresholdPermille;
+    uint16_t noise;
+};
+
+static std::atomic<uint16_t> analogValues[NATIVE_PINS];
+static LedcChannel ledcChannels[NATIVE_LEDC_CHANNELS];
+static Photodiode photodiode = {};
+static std::atomic<uint32_t> noiseState(12345);
+
+// Writers are the laser task and the timer threads
+static std::mutex timelineLock;
+static FILE *timeline = nullptr;
+
+void nativeSetTimeline(FILE *file)
+{
+    timeline = file;
+    if (timeline != nullptr && ftell(timeline) == 0)
+    {
+        fprintf(timeline, "time_us,channel,duty,resolution\n");
+    }
+}
+
+void nativeSetPhotodiode(uint8_t channel, uint16_t dark, uint16_t full, uint16_t thresholdPermille, uint16_t noise)
+{
+    photodiode = {true, channel, dark, full, thresholdPermille, noise};
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+static uint16_t readPhotodiode()
+{
+    const LedcChannel &led = ledcChannels[photodiode.channel % NATIVE_LEDC_CHANNELS];
+    uint32_t maxDuty = (1u << led.resolution.load(std::memory_order_relaxed)) - 1;
+    uint32_t permille = maxDuty == 0 ? 0 : (uint32_t)((uint64_t)led.duty.load(std::memory_order_relaxed) * 1000 / maxDuty);
+
+    int32_t value = photodiode.dark;
+    if (permille > photodiode.thresholdPermille && photodiode.thresholdPermille < 1000)
+    {
+        value += (int32_t)((photodiode.full - photodiode.dark) * (int64_t)(permille - photodiode.thresholdPermille) /
+                           (1000 - photodiode.thresholdPermille));
+    }
+    if (photodiode.noise != 0)
+    {
+        // xorshift; a lost update between threads only repeats a value
+        uint32_t x = noiseState.load(std::memory_order_relaxed);
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        noiseState.store(x, std::memory_order_relaxed);
+        value += (int32_t)(x % (2u * photodiode.noise + 1)) - photodiode.noise;
+    }
+    return (uint16_t)constrain(value, 0, 4095);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    if (pin == A0 && photodiode.enabled)
+    {
+        return readPhotodiode();
+    }
+    return pin < NATIVE_PINS ? analogValues[pin].load(std::memory_order_relaxed) : 0;
+}
+
+int8_t digitalPinToAnalogChannel(uint8_t pin)
+{
+    (void)pin;
+    return -1;
+}
+
+void nativeSetAnalog(uint8_t pin, uint16_t value)
+{
+    if (pin < NATIVE_PINS)
+    {
+        analogValues[pin].store(value > 4095 ? 4095 : value, std::memory_order_relaxed);
+    }
+}
+
+uint32_t ledcSetup(uint8_t channel, uint32_t frequency, uint8_t resolution)
+{
+    return ledcChangeFrequency(channel, frequency, resolution);
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+    (void)pin;
+    (void)channel;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+    if (channel >= NATIVE_LEDC_CHANNELS)
+    {
+        return;
+    }
+    LedcChannel &led = ledcChannels[channel];
+    uint32_t previous = led.duty.exchange(duty, std::memory_order_relaxed);
+    if (timeline != nullptr && previous != duty)
+    {
+        std::lock_guard<std::mutex> guard(timelineLock);
+        fprintf(timeline, "%llu,%u,%u,%u\n", (unsigned long long)(nanosSinceBoot() / 1000), channel, duty,
+                led.resolution.load(std::memory_order_relaxed));
+    }
+}
+
+uint32_t ledcChangeFrequency(uint8_t channel, uint32_t frequency, uint8_t resolution)
+{
+    if (channel >= NATIVE_LEDC_CHANNELS)
+    {
+        return 0;
+    }
+    ledcChannels[channel].frequency.store(frequency, std::memory_order_relaxed);
+    ledcChannels[channel].resolution.store(resolution, std::memory_order_relaxed);
+    return frequency;
+}
+
+uint32_t nativeLedcDuty(uint8_t channel)
+{
+    return channel < NATIVE_LEDC_CHANNELS ? ledcChannels[channel].duty.load(std::memory_order_relaxed) : 0;
+}
+
+uint32_t nativeLedcFrequency(uint8_t channel)
+{
+    return channel < NATIVE_LEDC_CHANNELS ? ledcChannels[channel].frequency.load(std::memory_order_relaxed) : 0;
+}
+
+uint8_t nativeLedcResolution(uint8_t channel)
+{
+    return channel < NATIVE_LEDC_CHANNELS ? ledcChannels[channel].resolution.load(std::memory_order_relaxed) : 0;
+}
+
+// ==================== HARDWARE TIMERS ====================
+static const uint32_t NATIVE_TIMER_CLOCK_HZ = 80000000;
+static const size_t NATIVE_TIMERS = 4;
+
+struct hw_timer_t
+{
+    uint16_t divider;
+    void (*callback)();
+    uint64_t alarmTicks;
+    bool autoreload;
+    std::atomic<bool> running;
+    std::thread worker;
+};
+
+// Never destroyed: a running worker thread must not be joinable at exit
+static hw_timer_t *const timers = new hw_timer_t[NATIVE_TIMERS]();
+
+static void runTimer(hw_timer_t *timer)
+{
+    uint64_t period = timer->alarmTicks * timer->divider * 1000000000ull / NATIVE_TIMER_CLOCK_HZ;
+    uint64_t next = nanosSinceBoot();
+    while (timer->running.load())
+    {
+        next += period;
+        std::this_thread::sleep_until(hostTimeAt(next));
+        if (!timer->running.load())
+        {
+            break;
+        }
+        timer->callback();
+        if (!timer->autoreload)
+        {
+            timer->running.store(false);
+        }
+    }
+}
+
+hw_timer_t *timerBegin(uint8_t number, uint16_t divider, bool countUp)
+{
+    (void)countUp;
+    if (number >= NATIVE_TIMERS)
+    {
+        return nullptr;
+    }
+    timers[number].divider = divider;
+    return &timers[number];
+}
+
+void timerAttachInterrupt(hw_timer_t *timer, void (*callback)(), bool edge)
+{
+    (void)edge;
+    timer->callback = callback;
+}
+
+void timerAlarmWrite(hw_timer_t *timer, uint64_t ticks, bool autoreload)
+{
+    timer->alarmTicks = ticks;
+    timer->autoreload = autoreload;
+}
+
+void timerWrite(hw_timer_t *timer, uint64_t ticks)
+{
+    (void)timer;
+    (void)ticks; // the period restarts when the alarm is enabled
+}
+
+void timerAlarmEnable(hw_timer_t *timer)
+{
+    if (timer->running.load() || timer->callback == nullptr || timer->alarmTicks == 0)
+    {
+        return;
+    }
+    if (timer->worker.joinable())
+    {
+        timer->worker.join();
+    }
+    timer->running.store(true);
+    timer->worker = std::thread(runTimer, timer);
+}
+
+void timerAlarmDisable(hw_timer_t *timer)
+{
+    timer->running.store(false);
+    if (timer->worker.joinable() && timer->worker.get_id() != std::this_thread::get_id())
+    {
+        timer->worker.join();
+    }
+}
+
+// ==================== TASKS ====================
+// Each task is a detached thread; priorities and core affinity are ignored
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stackSize,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core)
+{
+    (void)stackSize;
+    (void)priority;
+    (void)core;
+
+    std::thread thread(task, parameter);
+    char threadName[16];
+    snprintf(threadName, sizeof(threadName), "%s", name);
+    pthread_setname_np(thread.native_handle(), threadName);
+    if (handle != nullptr)
+    {
+        *handle = reinterpret_cast<TaskHandle_t>(thread.native_handle());
+    }
+    thread.detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr)
+    {
+        pthread_exit(nullptr);
+    }
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)millis();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks);
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t period)
+{
+    TickType_t wake = *previousWake + period;
+    int32_t remaining = (int32_t)(wake - xTaskGetTickCount());
+    if (remaining > 0)
+    {
+        delay((uint32_t)remaining);
+    }
+    *previousWake = wake;
+}
+
+// Task notifications: a count per thread, all behind one lock
+static std::mutex notifyLock;
+static std::condition_variable notifyChanged;
+static std::map<TaskHandle_t, uint32_t> notifyCounts;
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return reinterpret_cast<TaskHandle_t>(pthread_self());
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(notifyLock);
+        notifyCounts[task]++;
+    }
+    notifyChanged.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(notifyLock);
+    notifyChanged.wait_until(guard, hostTimeAt(nanosSinceBoot() + ticks * 1000000ull),
+                             [self] { return notifyCounts[self] > 0; });
+    uint32_t count = notifyCounts[self];
+    if (count > 0)
+    {
+        notifyCounts[self] = clearOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+// ==================== SERIAL ====================
+// A reader thread moves the input into rxBuffer so available() never blocks.
+// Each byte is stamped with when it would finish arriving at the current
+// baud rate, and only becomes available the way the UART's RX interrupt
+// hands it over: once rxFifoFull bytes are waiting, or the line has been
+// idle for rxTimeout symbols. The same thread stands in for the interrupt
+// and runs the onReceive() callback. Output is held in txBuffer and a
+// writer thread lets it out as it would leave the wire.
+static const size_t UART_FIFO_SIZE = 128;
+
+static int serialInFd = STDIN_FILENO;
+static int serialOutFd = STDOUT_FILENO;
+static std::atomic<bool> inputClosed(false);
+static std::atomic<unsigned long> serialBaud(115200);
+
+static std::mutex rxLock;
+static std::string rxBuffer;
+static std::deque<uint64_t> rxArrivals; // wire end time of each byte in rxBuffer
+static size_t rxVisible = 0;            // bytes the RX interrupt has handed over
+static uint64_t rxHanded = 0;           // total, for the callback
+static uint64_t rxWireEnd = 0;
+static uint8_t rxFifoFull = 112; // ESP32 core defaults
+static uint8_t rxTimeout = 2;
+static OnReceiveCb rxCallback;
+
+static std::mutex txLock;
+static std::condition_variable txChanged;
+static std::string txBuffer;     // written, not yet out on the wire
+static size_t txCapacity = UART_FIFO_SIZE;
+static double txQueued = 0;      // bytes still "on the wire"
+static uint64_t txDrainedAt = 0;
+static uint64_t txWrittenAt = 0;
+
+void nativeSetSerialFd(int fd)
+{
+    serialInFd = fd;
+    serialOutFd = fd;
+}
+
+static uint64_t byteNanos()
+{
+    return 10000000000ull / serialBaud.load();
+}
+
+// Caller holds rxLock
+static void deliverRx()
+{
+    uint64_t now = nanosSinceBoot();
+    uint64_t byteNs = byteNanos();
+    uint64_t timeoutNs = rxTimeout * byteNs;
+    size_t waiting = 0;
+    for (size_t i = rxVisible; i < rxArrivals.size() && rxArrivals[i] <= now; i++)
+    {
+        waiting++;
+        uint64_t nextStart = i + 1 < rxArrivals.size() ? rxArrivals[i + 1] - byteNs : UINT64_MAX;
+        bool idle = nextStart - rxArrivals[i] >= timeoutNs && rxArrivals[i] + timeoutNs <= now;
+        if (waiting >= rxFifoFull || idle)
+        {
+            rxHanded += i + 1 - rxVisible;
+            rxVisible = i + 1;
+            waiting = 0;
+        }
+    }
+}
+
+// Caller holds rxLock. Host time until the bytes waiting would be handed
+// over by a full FIFO or the timeout.
+static timespec nextRxInterrupt()
+{
+    uint64_t wait = 100000000; // nothing waiting: just look for input
+    if (rxVisible < rxArrivals.size())
+    {
+        uint64_t at = rxArrivals.back() + rxTimeout * byteNanos();
+        if (rxVisible + rxFifoFull <= rxArrivals.size() && rxArrivals[rxVisible + rxFifoFull - 1] < at)
+        {
+            at = rxArrivals[rxVisible + rxFifoFull - 1];
+        }
+        uint64_t now = nanosSinceBoot();
+        wait = at > now ? (uint64_t)((at - now) / clockSpeed) : 0;
+    }
+    timespec result = {(time_t)(wait / 1000000000), (long)(wait % 1000000000)};
+    return result;
+}
+
+static void readSerial()
+{
+    uint8_t chunk[256];
+    pollfd input = {serialInFd, POLLIN, 0};
+    for (;;)
+    {
+        timespec wait;
+        {
+            std::lock_guard<std::mutex> guard(rxLock);
+            wait = nextRxInterrupt();
+        }
+        if (ppoll(&input, 1, &wait, nullptr) > 0)
+        {
+            ssize_t count = ::read(serialInFd, chunk, sizeof(chunk));
+            if (count < 0 && (errno == EAGAIN || errno == EINTR || errno == EIO))
+            {
+                // A pty with no client open reports EIO; wait for one
+                delay(10);
+                continue;
+            }
+            if (count <= 0)
+            {
+                inputClosed.store(true);
+                return;
+            }
+            std::lock_guard<std::mutex> guard(rxLock);
+            rxBuffer.append(reinterpret_cast<const char *>(chunk), (size_t)count);
+            uint64_t now = nanosSinceBoot();
+            for (ssize_t i = 0; i < count; i++)
+            {
+                rxWireEnd = (rxWireEnd > now ? rxWireEnd : now) + byteNanos();
+                rxArrivals.push_back(rxWireEnd);
+            }
+        }
+
+        OnReceiveCb callback;
+        {
+            std::lock_guard<std::mutex> guard(rxLock);
+            uint64_t handed = rxHanded;
+            deliverRx();
+            if (rxHanded != handed)
+            {
+                callback = rxCallback;
+            }
+        }
+        if (callback)
+        {
+            callback();
+        }
+    }
+}
+
+// Caller holds txLock
+static void drainTx()
+{
+    uint64_t now = nanosSinceBoot();
+    txQueued -= (now - txDrainedAt) * (serialBaud.load() / 10.0) / 1e9;
+    if (txQueued < 0)
+    {
+        txQueued = 0;
+    }
+    txDrainedAt = now;
+}
+
+// Nobody reading a pty: drop, as a UART with nothing attached would
+static void writeOut(const char *data, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t count = ::write(serialOutFd, data + written, size - written);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        written += (size_t)count;
+    }
+}
+
+static void writeSerial()
+{
+    std::string out;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(txLock);
+            txChanged.wait(guard, [] { return !txBuffer.empty(); });
+            drainTx();
+            size_t onWire = (size_t)ceil(txQueued);
+            size_t done = txBuffer.size() > onWire ? txBuffer.size() - onWire : 0;
+            out.assign(txBuffer, 0, done);
+            txBuffer.erase(0, done);
+            if (txBuffer.empty())
+            {
+                txChanged.notify_all(); // flush()
+            }
+        }
+        writeOut(out.data(), out.size());
+
+        // A byte at a time, but no faster than 20k wakeups/s
+        uint64_t step = byteNanos() > 50000 * clockSpeed ? byteNanos() : (uint64_t)(50000 * clockSpeed);
+        sleepVirtual(step);
+    }
+}
+
+bool nativeInputClosed()
+{
+    return inputClosed.load();
+}
+
+bool nativeOutputIdle(uint32_t ms)
+{
+    std::lock_guard<std::mutex> guard(txLock);
+    return txBuffer.empty() && nanosSinceBoot() - txWrittenAt >= ms * 1000000ull;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    serialBaud.store(baud);
+    static bool started = false;
+    if (!started)
+    {
+        started = true;
+        txDrainedAt = nanosSinceBoot();
+        std::thread(readSerial).detach();
+        std::thread(writeSerial).detach();
+    }
+}
+
+// Bytes still in the TX FIFO go out at the new rate, as on the ESP32
+void HardwareSerial::updateBaudRate(unsigned long baud)
+{
+    std::lock_guard<std::mutex> txGuard(txLock);
+    std::lock_guard<std::mutex> rxGuard(rxLock);
+    drainTx();
+    serialBaud.store(baud);
+}
+
+bool HardwareSerial::setRxFIFOFull(uint8_t fifoBytes)
+{
+    std::lock_guard<std::mutex> guard(rxLock);
+    rxFifoFull = fifoBytes == 0 ? 1 : (fifoBytes >= UART_FIFO_SIZE ? UART_FIFO_SIZE - 1 : fifoBytes);
+    return true;
+}
+
+bool HardwareSerial::setRxTimeout(uint8_t symbols)
+{
+    std::lock_guard<std::mutex> guard(rxLock);
+    rxTimeout = symbols;
+    return true;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool onlyOnTimeout)
+{
+    (void)onlyOnTimeout;
+    std::lock_guard<std::mutex> guard(rxLock);
+    rxCallback = function;
+}
+
+void HardwareSerial::setTxBufferSize(size_t size)
+{
+    txCapacity = UART_FIFO_SIZE + size;
+}
+
+int HardwareSerial::available()
+{
+    std::lock_guard<std::mutex> guard(rxLock);
+    deliverRx();
+    return (int)rxVisible;
+}
+
+int HardwareSerial::read()
+{
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+size_t HardwareSerial::read(uint8_t *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> guard(rxLock);
+    deliverRx();
+    size_t count = size < rxVisible ? size : rxVisible;
+    memcpy(buffer, rxBuffer.data(), count);
+    rxBuffer.erase(0, count);
+    rxArrivals.erase(rxArrivals.begin(), rxArrivals.begin() + count);
+    rxVisible -= count;
+    return count;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    std::lock_guard<std::mutex> guard(txLock);
+    drainTx();
+    return txQueued >= txCapacity ? 0 : (int)(txCapacity - txQueued);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> guard(txLock);
+        drainTx();
+        txQueued += size;
+        txBuffer.append(reinterpret_cast<const char *>(buffer), size);
+        txWrittenAt = nanosSinceBoot();
+    }
+    txChanged.notify_all();
+    return size;
+}
+
+void HardwareSerial::flush()
+{
+    std::unique_lock<std::mutex> guard(txLock);
+    txChanged.wait(guard, [] { return txBuffer.empty(); });
+}
@@ -0,0 +1,233 @@
+// The test runner links its own main() (see test/NativeDevice.h)
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "NativeHal.h"
+
+void setup();
+void loop();
+
+// Keeps running until stdin has been closed and the output quiet this long,
+// so the last responses go out
+const unsigned long NATIVE_EXIT_DELAY_MS = 200;
+
+static char **savedArgv = nullptr;
+static int serialFd = -1;
+static bool restarted = false; // started by restartProcess()
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signal)
+{
+    (void)signal;
+    stopRequested = 1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --pty[=LINK]        serve on a new pseudo-terminal instead of stdin/stdout;\n"
+            "                      its path goes to stderr and LINK is made a symlink to it\n"
+            "  --speed=N           virtual clock runs N times faster than real time\n"
+            "  --start-ms=N        millis() at boot, e.g. 4294900000 to cross the 32-bit wrap\n"
+            "  --nvs=FILE          keep preferences in FILE (survives RESTART and new runs)\n"
+            "  --timeline=FILE     write every LEDC duty change as time_us,channel,duty,resolution\n"
+            "                      (continued across RESTART, where time_us starts over)\n"
+            "  --a0=N              constant A0 reading (0-4095)\n"
+            "  --a0-laser=DARK,FULL,THRESHOLD[,NOISE]\n"
+            "                      A0 follows the laser duty: DARK below THRESHOLD permille,\n"
+            "                      linear up to FULL at 100%%, +-NOISE counts\n",
+            program);
+}
+
+// Opens a pty in raw mode and returns the master. The slave stays open
+// here too so the master does not report EIO between client sessions.
+static int openPty(const char *link)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("native: posix_openpt");
+        return -1;
+    }
+    const char *path = ptsname(master);
+    int slave = open(path, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    {
+        perror("native: open pty");
+        return -1;
+    }
+
+    termios settings;
+    tcgetattr(slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+
+    // Writes with no client reading are dropped instead of blocking loop()
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if (link != nullptr)
+    {
+        unlink(link);
+        if (symlink(path, link) != 0)
+        {
+            perror("native: symlink");
+        }
+    }
+    fprintf(stderr, "native: serial on %s%s%s\n", path, link ? " -> " : "", link ? link : "");
+    return master;
+}
+
+// RESTART: run the same program again on the same serial port; the clock,
+// RAM and tasks start over, preferences come back from --nvs
+static void restartProcess()
+{
+    fprintf(stderr, "native: restarting\n");
+    char fdOption[32];
+    snprintf(fdOption, sizeof(fdOption), "--serial-fd=%d", serialFd);
+
+    char *arguments[64];
+    size_t count = 0;
+    for (size_t i = 0; savedArgv[i] != nullptr && count < 62; i++)
+    {
+        if (strncmp(savedArgv[i], "--pty", 5) != 0 && strncmp(savedArgv[i], "--serial-fd=", 12) != 0)
+        {
+            arguments[count++] = savedArgv[i];
+        }
+    }
+    if (serialFd >= 0)
+    {
+        arguments[count++] = fdOption;
+    }
+    arguments[count] = nullptr;
+
+    fflush(nullptr);
+    execv("/proc/self/exe", arguments);
+    perror("native: execv");
+}
+
+static bool parseArguments(int argc, char **argv)
+{
+    double speed = 1.0;
+    uint64_t startMs = 0;
+    const char *timelinePath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        unsigned dark, full, threshold, noise = 0;
+        if (strcmp(arg, "--pty") == 0 || strncmp(arg, "--pty=", 6) == 0)
+        {
+            serialFd = openPty(arg[5] == '=' ? arg + 6 : nullptr);
+            if (serialFd < 0)
+            {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--serial-fd=", 12) == 0)
+        {
+            serialFd = atoi(arg + 12);
+            restarted = true;
+        }
+        else if (strncmp(arg, "--speed=", 8) == 0)
+        {
+            speed = atof(arg + 8);
+        }
+        else if (strncmp(arg, "--start-ms=", 11) == 0)
+        {
+            startMs = strtoull(arg + 11, nullptr, 10);
+        }
+        else if (strncmp(arg, "--nvs=", 6) == 0)
+        {
+            nativeSetPreferencesFile(arg + 6);
+        }
+        else if (strncmp(arg, "--timeline=", 11) == 0)
+        {
+            timelinePath = arg + 11;
+        }
+        else if (strncmp(arg, "--a0=", 5) == 0)
+        {
+            nativeSetAnalog(A0, (uint16_t)atoi(arg + 5));
+        }
+        else if (strncmp(arg, "--a0-laser=", 11) == 0 &&
+                 sscanf(arg + 11, "%u,%u,%u,%u", &dark, &full, &threshold, &noise) >= 3)
+        {
+            nativeSetPhotodiode(0, (uint16_t)dark, (uint16_t)full, (uint16_t)threshold, (uint16_t)noise);
+        }
+        else
+        {
+            usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (timelinePath != nullptr)
+    {
+        FILE *file = fopen(timelinePath, restarted ? "a" : "w");
+        if (file == nullptr)
+        {
+            perror("native: timeline");
+            return false;
+        }
+        nativeSetTimeline(file);
+    }
+
+    nativeSetClock(speed, startMs);
+    return true;
+}
+
+// ==================== NATIVE ENTRY POINT ====================
+// Commands on stdin, responses on stdout, same as the UART:
+//   printf 'LASER_ON\nSTATUS\n' | .pio/build/native/program
+// or a virtual device a client opens like the CH340K port:
+//   .pio/build/native/program --pty=/tmp/ttyLASER --speed=100 --nvs=laser.nvs
+int main(int argc, char **argv)
+{
+    savedArgv = argv;
+    if (!parseArguments(argc, argv))
+    {
+        return 2;
+    }
+    if (serialFd >= 0)
+    {
+        nativeSetSerialFd(serialFd);
+        nativeSetRestartHandler(restartProcess);
+    }
+
+    // Ctrl-C / kill end the run with the timeline flushed
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    setup();
+
+    unsigned long closedAt = 0;
+    while (!stopRequested)
+    {
+        loop();
+
+        if (nativeInputClosed() && Serial.available() == 0)
+        {
+            if (closedAt == 0)
+            {
+                closedAt = millis();
+            }
+            else if (millis() - closedAt >= NATIVE_EXIT_DELAY_MS && nativeOutputIdle(NATIVE_EXIT_DELAY_MS))
+            {
+                break;
+            }
+        }
+    }
+    Serial.flush();
+    fflush(nullptr);
+    // The serial, task and timer threads are still running; static
+    // destructors would pull their state out from under them
+    _exit(0);
+}
+
+#endif // PIO_UNIT_TESTING
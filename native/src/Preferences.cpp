@@ -0,0 +1,167 @@
+#include <Preferences.h>
+
+#include <stdio.h>
+
+#include "NativeHal.h"
+
+static const char *storePath = nullptr;
+
+void nativeSetPreferencesFile(const char *path)
+{
+    storePath = path;
+}
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    (void)name;
+    writable = !readOnly;
+    load();
+    return true;
+}
+
+// One entry per line: key, then the value as hex
+void Preferences::load()
+{
+    FILE *file = storePath != nullptr ? fopen(storePath, "r") : nullptr;
+    if (file == nullptr)
+    {
+        return;
+    }
+
+    char key[MAX_KEY + 1];
+    char hex[MAX_VALUE * 2 + 1];
+    for (size_t i = 0; i < MAX_ENTRIES && fscanf(file, "%15s %128s", key, hex) == 2; i++)
+    {
+        Entry &entry = entries[i];
+        strcpy(entry.key, key);
+        entry.length = strlen(hex) / 2;
+        for (size_t b = 0; b < entry.length; b++)
+        {
+            unsigned int byte = 0;
+            sscanf(hex + b * 2, "%2x", &byte);
+            entry.value[b] = (uint8_t)byte;
+        }
+        entry.used = true;
+    }
+    fclose(file);
+}
+
+void Preferences::save()
+{
+    if (storePath == nullptr)
+    {
+        return;
+    }
+
+    // Replace the file in one rename so a kill mid-write keeps the old one
+    char temporary[256];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", storePath);
+    FILE *file = fopen(temporary, "w");
+    if (file == nullptr)
+    {
+        return;
+    }
+    for (size_t i = 0; i < MAX_ENTRIES; i++)
+    {
+        if (!entries[i].used)
+        {
+            continue;
+        }
+        fprintf(file, "%s ", entries[i].key);
+        for (size_t b = 0; b < entries[i].length; b++)
+        {
+            fprintf(file, "%02x", entries[i].value[b]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    rename(temporary, storePath);
+}
+
+Preferences::Entry *Preferences::find(const char *key)
+{
+    for (size_t i = 0; i < MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && strcmp(entries[i].key, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return find(key) != nullptr;
+}
+
+bool Preferences::remove(const char *key)
+{
+    Entry *entry = find(key);
+    if (!writable || entry == nullptr)
+    {
+        return false;
+    }
+    entry->used = false;
+    save();
+    return true;
+}
+
+bool Preferences::clear()
+{
+    if (!writable)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < MAX_ENTRIES; i++)
+    {
+        entries[i].used = false;
+    }
+    save();
+    return true;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    if (!writable || strlen(key) > MAX_KEY || length > MAX_VALUE)
+    {
+        return 0;
+    }
+
+    Entry *entry = find(key);
+    for (size_t i = 0; entry == nullptr && i < MAX_ENTRIES; i++)
+    {
+        if (!entries[i].used)
+        {
+            entry = &entries[i];
+            strcpy(entry->key, key);
+            entry->used = true;
+        }
+    }
+    if (entry == nullptr)
+    {
+        return 0; // namespace full
+    }
+
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    save();
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    Entry *entry = find(key);
+    return entry != nullptr ? entry->length : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+    Entry *entry = find(key);
+    if (entry == nullptr || entry->length > length)
+    {
+        return 0;
+    }
+    memcpy(buffer, entry->value, entry->length);
+    return entry->length;
+}
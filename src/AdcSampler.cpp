@@ -0,0 +1,148 @@
+#include "AdcSampler.h"
+
+#include <driver/adc.h>
+
+// DMA pool and frame sizes in bytes; each conversion result is 4 bytes
+const uint32_t ADC_POOL_BYTES = 4096;
+const uint32_t ADC_FRAME_BYTES = 256;
+const uint32_t ADC_READ_TIMEOUT_MS = 10; // reader re-checks for stop this often
+
+// Reader task: core 0, below the laser task so control ticks stay on time
+const BaseType_t ADC_TASK_CORE = 0;
+const UBaseType_t ADC_TASK_PRIORITY = configMAX_PRIORITIES - 3;
+const uint32_t ADC_TASK_STACK_SIZE = 3072;
+
+AdcSampler::AdcSampler()
+    : sampleRate(20000), oversample(16), channel(0), readerTask(nullptr), active(false),
+      stopRequested(false), latestValue(0), conversions(0), decimated(0), lossEvents(0), foreign(0)
+{
+}
+
+bool AdcSampler::start(uint8_t pin)
+{
+    int8_t adcChannel = digitalPinToAnalogChannel(pin);
+    if (active || adcChannel < 0 || adcChannel >= SOC_ADC_CHANNEL_NUM(0))
+    {
+        return false; // already running, or not an ADC1 pin
+    }
+    channel = (uint8_t)adcChannel;
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = ADC_POOL_BYTES;
+    init.conv_num_each_intr = ADC_FRAME_BYTES;
+    init.adc1_chan_mask = 1u << channel;
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK)
+    {
+        return false;
+    }
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = ADC_ATTEN_DB_11; // same 0-3.3V range as analogRead()
+    pattern.channel = channel;
+    pattern.unit = 0; // ADC1
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = false;
+    config.pattern_num = 1;
+    config.adc_pattern = &pattern;
+    config.sample_freq_hz = sampleRate;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+    if (adc_digi_controller_configure(&config) != ESP_OK)
+    {
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    stopRequested = false;
+    active = true;
+    adc_digi_start();
+    if (xTaskCreatePinnedToCore(readerEntry, "adc", ADC_TASK_STACK_SIZE, this,
+                                ADC_TASK_PRIORITY, &readerTask, ADC_TASK_CORE) != pdPASS)
+    {
+        adc_digi_stop();
+        adc_digi_deinitialize();
+        active = false;
+        return false;
+    }
+    return true;
+}
+
+// Blocks until the reader task has released the ADC (at most one read timeout)
+void AdcSampler::stop()
+{
+    if (!active)
+    {
+        return;
+    }
+    stopRequested = true;
+    while (active)
+    {
+        delay(1);
+    }
+}
+
+AdcStats AdcSampler::stats() const
+{
+    AdcStats result;
+    result.conversions = conversions;
+    result.decimated = decimated;
+    result.lossEvents = lossEvents;
+    result.foreign = foreign;
+    return result;
+}
+
+void AdcSampler::readerEntry(void *parameter)
+{
+    static_cast<AdcSampler *>(parameter)->readLoop();
+    vTaskDelete(nullptr);
+}
+
+void AdcSampler::readLoop()
+{
+    uint8_t frame[ADC_FRAME_BYTES];
+    uint32_t sum = 0;
+    uint32_t count = 0;
+
+    while (!stopRequested)
+    {
+        uint32_t length = 0;
+        esp_err_t result = adc_digi_read_bytes(frame, sizeof(frame), &length, ADC_READ_TIMEOUT_MS);
+        if (result == ESP_ERR_INVALID_STATE)
+        {
+            // Pool overflowed; the data that did arrive is still valid
+            lossEvents++;
+        }
+        else if (result != ESP_OK)
+        {
+            continue; // timeout
+        }
+
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+        {
+            const adc_digi_output_data_t *sample = reinterpret_cast<const adc_digi_output_data_t *>(frame + i);
+            if (sample->type2.unit != 0 || sample->type2.channel != channel)
+            {
+                foreign++;
+                continue;
+            }
+
+            sum += sample->type2.data;
+            conversions++;
+            if (++count == oversample)
+            {
+                latestValue = (uint16_t)((sum + count / 2) / count);
+                decimated++;
+                sum = 0;
+                count = 0;
+            }
+        }
+    }
+
+    adc_digi_stop();
+    adc_digi_deinitialize();
+    readerTask = nullptr;
+    active = false;
+}
@@ -0,0 +1,81 @@
+#include "AllocCounter.h"
+
+#include <stddef.h>
+
+static uint32_t allocations = 0;
+static uint32_t frees = 0;
+static uint32_t failures = 0;
+
+#ifdef ALLOC_COUNTER_WRAP
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *pointer, size_t size);
+    void __real_free(void *pointer);
+
+    // Any task on either core may allocate, so the counters are atomic
+    static void *counted(void *result)
+    {
+        __atomic_fetch_add(result ? &allocations : &failures, 1, __ATOMIC_RELAXED);
+        return result;
+    }
+
+    void *__wrap_malloc(size_t size)
+    {
+        return counted(__real_malloc(size));
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        return counted(__real_calloc(count, size));
+    }
+
+    void *__wrap_realloc(void *pointer, size_t size)
+    {
+        void *result = __real_realloc(pointer, size);
+        if (size == 0)
+        {
+            // realloc(p, 0) frees p
+            if (pointer != nullptr)
+            {
+                __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+            }
+            return result;
+        }
+        return counted(result);
+    }
+
+    void __wrap_free(void *pointer)
+    {
+        if (pointer != nullptr)
+        {
+            __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+        }
+        __real_free(pointer);
+    }
+}
+
+bool allocationCounting()
+{
+    return true;
+}
+
+#else
+
+bool allocationCounting()
+{
+    return false;
+}
+
+#endif
+
+AllocStats allocationStats()
+{
+    AllocStats stats;
+    stats.allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    stats.frees = __atomic_load_n(&frees, __ATOMIC_RELAXED);
+    stats.failures = __atomic_load_n(&failures, __ATOMIC_RELAXED);
+    return stats;
+}
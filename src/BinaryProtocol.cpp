@@ -0,0 +1,185 @@
+#include "BinaryProtocol.h"
+
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+uint32_t frameCrc32(const uint8_t *data, size_t length)
+{
+#ifdef ESP_PLATFORM
+    // ROM routine, same IEEE polynomial and conditioning as the fallback
+    return esp_rom_crc32_le(0, data, length);
+#else
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+#endif
+}
+
+size_t cobsEncode(const uint8_t *in, size_t length, uint8_t *out, size_t capacity)
+{
+    if (capacity == 0)
+    {
+        return 0;
+    }
+
+    size_t codeIndex = 0;
+    size_t written = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (in[i] != 0)
+        {
+            if (written >= capacity)
+            {
+                return 0;
+            }
+            out[written++] = in[i];
+            code++;
+        }
+
+        if (in[i] == 0 || code == 0xFF)
+        {
+            out[codeIndex] = code;
+            code = 1;
+            codeIndex = written;
+            if (in[i] == 0 || i + 1 < length)
+            {
+                if (written >= capacity)
+                {
+                    return 0;
+                }
+                written++;
+            }
+        }
+    }
+
+    if (codeIndex < written)
+    {
+        out[codeIndex] = code;
+    }
+    return written;
+}
+
+size_t cobsDecode(const uint8_t *in, size_t length, uint8_t *out, size_t capacity)
+{
+    size_t read = 0;
+    size_t written = 0;
+
+    while (read < length)
+    {
+        uint8_t code = in[read++];
+        if (code == 0 || read + code - 1 > length)
+        {
+            return 0;
+        }
+
+        for (uint8_t i = 1; i < code; i++)
+        {
+            if (written >= capacity)
+            {
+                return 0;
+            }
+            out[written++] = in[read++];
+        }
+
+        if (code != 0xFF && read < length)
+        {
+            if (written >= capacity)
+            {
+                return 0;
+            }
+            out[written++] = 0;
+        }
+    }
+    return written;
+}
+
+size_t encodeFrame(uint8_t opcode, uint8_t sequence,
+                   const uint8_t *payload, size_t length,
+                   uint8_t *out, size_t capacity)
+{
+    if (length > FRAME_MAX_PAYLOAD)
+    {
+        return 0;
+    }
+
+    uint8_t raw[FRAME_MAX_DECODED];
+    raw[0] = opcode;
+    raw[1] = sequence;
+    memcpy(raw + FRAME_HEADER_SIZE, payload, length);
+    size_t rawLength = FRAME_HEADER_SIZE + length;
+    writeInt32LE(raw + rawLength, (int32_t)frameCrc32(raw, rawLength));
+    rawLength += FRAME_CRC_SIZE;
+
+    size_t encodedLength = cobsEncode(raw, rawLength, out, capacity);
+    if (encodedLength == 0 || encodedLength >= capacity)
+    {
+        return 0;
+    }
+    out[encodedLength++] = 0;
+    return encodedLength;
+}
+
+bool FrameDecoder::feed(uint8_t byte, BinaryFrame &frame)
+{
+    if (byte != 0)
+    {
+        if (received < sizeof(encoded))
+        {
+            encoded[received++] = byte;
+        }
+        else if (!overflowing)
+        {
+            overflowing = true;
+            overflows++;
+        }
+        return false;
+    }
+
+    // Delimiter: decode whatever was collected since the last one
+    size_t length = received;
+    bool skip = overflowing || length == 0;
+    received = 0;
+    overflowing = false;
+    if (skip)
+    {
+        return false;
+    }
+
+    size_t decodedLength = cobsDecode(encoded, length, decoded, sizeof(decoded));
+    if (decodedLength < FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+    {
+        badFrames++;
+        return false;
+    }
+
+    size_t bodyLength = decodedLength - FRAME_CRC_SIZE;
+    if ((uint32_t)readInt32LE(decoded + bodyLength) != frameCrc32(decoded, bodyLength))
+    {
+        badFrames++;
+        return false;
+    }
+
+    frame.opcode = decoded[0];
+    frame.sequence = decoded[1];
+    frame.payload = decoded + FRAME_HEADER_SIZE;
+    frame.length = bodyLength - FRAME_HEADER_SIZE;
+    return true;
+}
+
+void FrameDecoder::reset()
+{
+    received = 0;
+    overflowing = false;
+}
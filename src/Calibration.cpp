@@ -0,0 +1,107 @@
+#include "Calibration.h"
+
+bool Calibration::load(const uint16_t curve[CAL_POINTS])
+{
+    for (size_t k = 1; k < CAL_POINTS; k++)
+    {
+        if (curve[k] < curve[k - 1])
+        {
+            return false;
+        }
+    }
+    uint32_t dark = curve[0];
+    uint32_t span = curve[CAL_POINTS - 1] - dark;
+    if (span < CAL_MIN_SPAN)
+    {
+        return false;
+    }
+
+    for (size_t k = 0; k < CAL_POINTS; k++)
+    {
+        knots[k] = curve[k];
+    }
+
+    // Targets are compared scaled by 65535 to keep the division exact
+    lut[0] = 0;
+    size_t k = 0;
+    for (size_t i = 1; i < CAL_LUT_SIZE; i++)
+    {
+        uint64_t target = (uint64_t)dark * 65535 + (uint64_t)(i * 257) * span;
+
+        // Targets only grow, so the segment search resumes where it stopped
+        while (k + 2 < CAL_POINTS &&
+               (knots[k + 1] == knots[k] || (uint64_t)knots[k + 1] * 65535 < target))
+        {
+            k++;
+        }
+
+        uint64_t low = (uint64_t)knots[k] * 65535;
+        uint64_t high = (uint64_t)knots[k + 1] * 65535;
+        uint32_t from = calibrationSetpoint(k);
+        uint32_t to = calibrationSetpoint(k + 1);
+        uint32_t setpoint;
+        if (target <= low)
+        {
+            setpoint = from;
+        }
+        else if (target >= high)
+        {
+            setpoint = to;
+        }
+        else
+        {
+            setpoint = from + (uint32_t)((target - low) * (to - from) / (high - low));
+        }
+        lut[i] = (uint16_t)setpoint;
+    }
+
+    enabled = true;
+    return true;
+}
+
+void Calibration::fitMonotonic(const uint16_t *sweep, size_t count, uint16_t curve[CAL_POINTS])
+{
+    // Pool adjacent violators: merge neighbouring blocks until block means
+    // never decrease
+    uint32_t sums[CAL_MAX_SWEEP];
+    uint16_t sizes[CAL_MAX_SWEEP];
+    size_t blocks = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sums[blocks] = sweep[i];
+        sizes[blocks] = 1;
+        blocks++;
+        while (blocks > 1 &&
+               (uint64_t)sums[blocks - 2] * sizes[blocks - 1] > (uint64_t)sums[blocks - 1] * sizes[blocks - 2])
+        {
+            sums[blocks - 2] += sums[blocks - 1];
+            sizes[blocks - 2] += sizes[blocks - 1];
+            blocks--;
+        }
+    }
+
+    uint16_t fitted[CAL_MAX_SWEEP];
+    size_t index = 0;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        uint16_t mean = (uint16_t)((sums[b] + sizes[b] / 2) / sizes[b]);
+        for (uint16_t j = 0; j < sizes[b]; j++)
+        {
+            fitted[index++] = mean;
+        }
+    }
+
+    // Resample at the curve points; sweep sample i sits at i * 65535 / (count - 1)
+    for (size_t k = 0; k < CAL_POINTS; k++)
+    {
+        uint64_t position = (uint64_t)calibrationSetpoint(k) * (count - 1);
+        size_t i = (size_t)(position / 65535);
+        uint32_t fraction = (uint32_t)(position % 65535);
+        if (i + 1 >= count)
+        {
+            curve[k] = fitted[count - 1];
+            continue;
+        }
+        curve[k] = (uint16_t)(fitted[i] + ((uint64_t)(fitted[i + 1] - fitted[i]) * fraction + 32767) / 65535);
+    }
+}
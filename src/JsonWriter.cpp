@@ -0,0 +1,226 @@
+#include "JsonWriter.h"
+
+JsonWriter::JsonWriter(char *buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity), used(0), overflow(false), needComma(false)
+{
+    if (capacity > 0)
+    {
+        buffer[0] = '\0';
+    }
+}
+
+JsonWriter &JsonWriter::beginObject()
+{
+    if (needComma)
+    {
+        put(',');
+    }
+    put('{');
+    needComma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject()
+{
+    put('}');
+    needComma = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::stringField(const char *name, const char *value)
+{
+    key(name);
+    put('"');
+    putEscaped(value);
+    put('"');
+    return *this;
+}
+
+JsonWriter &JsonWriter::boolField(const char *name, bool value)
+{
+    key(name);
+    putRaw(value ? "true" : "false");
+    return *this;
+}
+
+JsonWriter &JsonWriter::intField(const char *name, int32_t value)
+{
+    key(name);
+    if (value < 0)
+    {
+        put('-');
+        putUnsigned(0u - (uint32_t)value, 1);
+    }
+    else
+    {
+        putUnsigned((uint32_t)value, 1);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::uintField(const char *name, uint32_t value)
+{
+    key(name);
+    putUnsigned(value, 1);
+    return *this;
+}
+
+JsonWriter &JsonWriter::uint64Field(const char *name, uint64_t value)
+{
+    key(name);
+    char digits[20];
+    uint8_t count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    while (count > 0)
+    {
+        put(digits[--count]);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::fixedField(const char *name, int32_t scaled, uint8_t decimals)
+{
+    key(name);
+
+    uint32_t magnitude = scaled < 0 ? 0u - (uint32_t)scaled : (uint32_t)scaled;
+    if (scaled < 0)
+    {
+        put('-');
+    }
+
+    uint32_t divisor = 1;
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        divisor *= 10;
+    }
+
+    putUnsigned(magnitude / divisor, 1);
+    if (decimals > 0)
+    {
+        put('.');
+        putUnsigned(magnitude % divisor, decimals);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::uintArrayField(const char *name, const uint16_t *values, size_t count)
+{
+    key(name);
+    put('[');
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            put(',');
+        }
+        putUnsigned(values[i], 1);
+    }
+    put(']');
+    return *this;
+}
+
+JsonWriter &JsonWriter::endLine()
+{
+    put('\r');
+    put('\n');
+    return *this;
+}
+
+void JsonWriter::key(const char *name)
+{
+    if (needComma)
+    {
+        put(',');
+    }
+    needComma = true;
+
+    put('"');
+    putEscaped(name);
+    put('"');
+    put(':');
+}
+
+void JsonWriter::put(char c)
+{
+    // Always keep room for the terminating NUL
+    if (used + 1 >= capacity)
+    {
+        overflow = true;
+        return;
+    }
+    buffer[used++] = c;
+    buffer[used] = '\0';
+}
+
+void JsonWriter::putRaw(const char *text)
+{
+    while (*text)
+    {
+        put(*text++);
+    }
+}
+
+void JsonWriter::putEscaped(const char *text)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    for (; *text; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        switch (c)
+        {
+        case '"':
+            putRaw("\\\"");
+            break;
+        case '\\':
+            putRaw("\\\\");
+            break;
+        case '\n':
+            putRaw("\\n");
+            break;
+        case '\r':
+            putRaw("\\r");
+            break;
+        case '\t':
+            putRaw("\\t");
+            break;
+        default:
+            if (c < 0x20)
+            {
+                putRaw("\\u00");
+                put(HEX_DIGITS[c >> 4]);
+                put(HEX_DIGITS[c & 0x0F]);
+            }
+            else
+            {
+                put((char)c);
+            }
+        }
+    }
+}
+
+void JsonWriter::putUnsigned(uint32_t value, uint8_t minDigits)
+{
+    char digits[10];
+    uint8_t count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && count < sizeof(digits));
+
+    while (minDigits > count)
+    {
+        put('0');
+        minDigits--;
+    }
+    while (count > 0)
+    {
+        put(digits[--count]);
+    }
+}
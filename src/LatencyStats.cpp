@@ -0,0 +1,41 @@
+#include "LatencyStats.h"
+
+#include <string.h>
+
+uint8_t LatencyStats::slotFor(uint8_t opcode)
+{
+    for (size_t i = 0; i < used; i++)
+    {
+        if (opcodes[i] == opcode)
+        {
+            return (uint8_t)i;
+        }
+    }
+    if (used < LATENCY_SLOTS - 1)
+    {
+        opcodes[used] = opcode;
+        return (uint8_t)used++;
+    }
+
+    // Out of slots: everything else shares the last one
+    opcodes[LATENCY_SLOTS - 1] = LATENCY_OTHER;
+    used = LATENCY_SLOTS;
+    return (uint8_t)(LATENCY_SLOTS - 1);
+}
+
+void LatencyStats::reset()
+{
+    memset(histograms, 0, sizeof(histograms));
+    memset(opcodes, 0, sizeof(opcodes));
+    used = 0;
+}
+
+uint32_t LatencyStats::samples(size_t slot, LatencyStage stage) const
+{
+    uint32_t total = 0;
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        total += histograms[slot][(size_t)stage].counts[b];
+    }
+    return total;
+}
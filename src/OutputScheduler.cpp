@@ -0,0 +1,62 @@
+#include "OutputScheduler.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#endif
+
+// Hardware timer 1 at 10MHz (80MHz APB / 8); 2 and 3 belong to the stream and waveform
+const uint8_t SCHEDULE_TIMER = 1;
+const uint16_t SCHEDULE_TIMER_DIVIDER = 8;
+const uint32_t SCHEDULE_TICKS_PER_US = 10;
+
+static OutputScheduler *timerOwner = nullptr;
+
+static void IRAM_ATTR onScheduleTimer()
+{
+    timerOwner->onTimer();
+}
+
+OutputScheduler::OutputScheduler()
+    : channel(0), duty(0), timer(nullptr), pending(false), done(false), firedTime(0)
+{
+}
+
+void OutputScheduler::arm(uint8_t ledcChannel, uint32_t ledcDuty, uint64_t at)
+{
+    if (timer == nullptr)
+    {
+        timerOwner = this;
+        timer = timerBegin(SCHEDULE_TIMER, SCHEDULE_TIMER_DIVIDER, true);
+        timerAttachInterrupt(timer, &onScheduleTimer, true);
+    }
+
+    channel = ledcChannel;
+    duty = ledcDuty;
+    done = false;
+    pending = true;
+
+    uint64_t now = (uint64_t)esp_timer_get_time();
+    uint64_t ticks = at > now ? (at - now) * SCHEDULE_TICKS_PER_US : 1;
+    timerAlarmWrite(timer, ticks, false);
+    timerWrite(timer, 0);
+    timerAlarmEnable(timer);
+}
+
+// If the alarm has fired its duty stays written; the caller's next output
+// replaces it
+void OutputScheduler::cancel()
+{
+    if (timer != nullptr)
+    {
+        timerAlarmDisable(timer);
+    }
+    pending = false;
+    done = false;
+}
+
+void IRAM_ATTR OutputScheduler::onTimer()
+{
+    ledcWrite(channel, duty);
+    firedTime = (uint64_t)esp_timer_get_time();
+    done = true;
+}
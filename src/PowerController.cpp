@@ -0,0 +1,105 @@
+#include "PowerController.h"
+
+// Settling band: 2% of the target, but never tighter than ADC noise
+const int32_t SETTLE_BAND_MIN = 8;
+
+PowerController::PowerController()
+    : target(0), kp(1024), ki(64), kd(0), integral(0), previousMeasurement(0), primed(false)
+{
+    restartTelemetry();
+}
+
+void PowerController::setTarget(int32_t counts)
+{
+    counts = counts < 0 ? 0 : (counts > ADC_MAX ? ADC_MAX : counts);
+    if (counts != target)
+    {
+        target = counts;
+        restartTelemetry();
+    }
+}
+
+void PowerController::setGains(int32_t newKp, int32_t newKi, int32_t newKd)
+{
+    kp = newKp < 0 ? 0 : (newKp > GAIN_MAX ? GAIN_MAX : newKp);
+    ki = newKi < 0 ? 0 : (newKi > GAIN_MAX ? GAIN_MAX : newKi);
+    kd = newKd < 0 ? 0 : (newKd > GAIN_MAX ? GAIN_MAX : newKd);
+}
+
+void PowerController::reset(uint32_t output)
+{
+    integral = (int32_t)((output > OUTPUT_MAX ? OUTPUT_MAX : output) << 8);
+    primed = false;
+    restartTelemetry();
+}
+
+uint32_t PowerController::update(int32_t measurement)
+{
+    int32_t error = target - measurement;
+    int32_t derivative = primed ? measurement - previousMeasurement : 0;
+    previousMeasurement = measurement;
+    primed = true;
+
+    // Q8 sum; |kp * error| and |kd * derivative| stay below 2^27
+    int32_t proportional = kp * error;
+    int32_t output = (proportional + integral - kd * derivative) >> 8;
+
+    // Conditional integration: only wind toward the unsaturated side
+    bool high = output >= (int32_t)OUTPUT_MAX;
+    bool low = output <= 0;
+    if (!(high && error > 0) && !(low && error < 0))
+    {
+        integral += ki * error;
+        if (integral < 0)
+        {
+            integral = 0;
+        }
+        else if (integral > (int32_t)(OUTPUT_MAX << 8))
+        {
+            integral = (int32_t)(OUTPUT_MAX << 8);
+        }
+    }
+
+    output = output < 0 ? 0 : (output > (int32_t)OUTPUT_MAX ? (int32_t)OUTPUT_MAX : output);
+
+    // Telemetry
+    stats.ticks++;
+    stats.lastError = error;
+    stats.lastMeasurement = measurement;
+    stats.lastOutput = (uint32_t)output;
+    if (high || low)
+    {
+        stats.saturatedTicks++;
+    }
+
+    uint32_t magnitude = (uint32_t)(error < 0 ? -error : error);
+    int32_t band = target / 50 > SETTLE_BAND_MIN ? target / 50 : SETTLE_BAND_MIN;
+    if (stats.settlingTicks == 0)
+    {
+        inBand = magnitude <= (uint32_t)band ? inBand + 1 : 0;
+        if (inBand >= SETTLE_HOLD)
+        {
+            stats.settlingTicks = stats.ticks - SETTLE_HOLD + 1;
+        }
+    }
+    else
+    {
+        errorSum += error;
+        errorCount++;
+        stats.meanErrorCenti = (int32_t)(errorSum * 100 / (int64_t)errorCount);
+        if (magnitude > stats.peakError)
+        {
+            stats.peakError = magnitude;
+        }
+    }
+
+    return (uint32_t)output;
+}
+
+void PowerController::restartTelemetry()
+{
+    inBand = 0;
+    errorSum = 0;
+    errorCount = 0;
+    stats = PowerTelemetry();
+}
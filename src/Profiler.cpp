@@ -0,0 +1,87 @@
+#include "Profiler.h"
+
+#include <string.h>
+
+void ProfileScope::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    totalUs = 0;
+    minUs = UINT32_MAX;
+    maxUs = 0;
+}
+
+uint32_t ProfileScope::bucketLow(size_t bucket)
+{
+    if (bucket < 4)
+    {
+        return (uint32_t)bucket;
+    }
+    uint32_t msb = (uint32_t)(bucket / 4) + 1;
+    return (uint32_t)(4 + bucket % 4) << (msb - 2);
+}
+
+uint32_t ProfileScope::percentile(uint16_t permille) const
+{
+    // Ranks come from the buckets themselves so saturated counts stay consistent
+    uint32_t total = 0;
+    for (size_t b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        total += counts[b];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint32_t rank = (uint32_t)(((uint64_t)total * permille + 999) / 1000);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint32_t seen = 0;
+    size_t bucket = 0;
+    for (; bucket < PROFILE_BUCKETS; bucket++)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+
+    uint32_t value;
+    if (bucket >= PROFILE_BUCKETS - 1)
+    {
+        value = maxUs;
+    }
+    else
+    {
+        uint32_t low = bucketLow(bucket);
+        uint32_t high = bucketLow(bucket + 1);
+        value = low + (high - low - 1) / 2;
+    }
+    if (value < minUs)
+    {
+        value = minUs;
+    }
+    if (value > maxUs)
+    {
+        value = maxUs;
+    }
+    return value;
+}
+
+ProfileSummary ProfileScope::summary() const
+{
+    ProfileSummary s;
+    s.count = count;
+    s.minUs = count ? minUs : 0;
+    s.meanUs = count ? (uint32_t)(totalUs / count) : 0;
+    s.p50Us = percentile(500);
+    s.p90Us = percentile(900);
+    s.p99Us = percentile(990);
+    s.maxUs = maxUs;
+    return s;
+}
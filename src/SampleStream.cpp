@@ -0,0 +1,101 @@
+#include "SampleStream.h"
+
+// Hardware timer 2 at 10MHz (80MHz APB / 8); timer 3 belongs to the waveform engine
+const uint8_t STREAM_TIMER = 2;
+const uint16_t STREAM_TIMER_DIVIDER = 8;
+const uint32_t STREAM_TIMER_CLOCK_HZ = 10000000;
+
+static SampleStream *timerOwner = nullptr;
+
+static void IRAM_ATTR onStreamTimer()
+{
+    timerOwner->onTimer();
+}
+
+SampleStream::SampleStream()
+    : sampleRate(1000), prefill(64), channel(0), timer(nullptr), active(false),
+      primed(false), idleTicks(0), played(0), underruns(0), writtenDuty(0), overruns(0)
+{
+}
+
+bool SampleStream::push(uint16_t duty)
+{
+    if (!buffer.push(duty))
+    {
+        overruns++;
+        return false;
+    }
+    return true;
+}
+
+void SampleStream::clear()
+{
+    uint16_t discarded;
+    while (buffer.pop(discarded))
+    {
+    }
+    played = 0;
+    underruns = 0;
+    overruns = 0;
+    idleTicks = 0;
+    primed = false;
+}
+
+void SampleStream::start(uint8_t ledcChannel)
+{
+    if (timer == nullptr)
+    {
+        timerOwner = this;
+        timer = timerBegin(STREAM_TIMER, STREAM_TIMER_DIVIDER, true);
+        timerAttachInterrupt(timer, &onStreamTimer, true);
+    }
+
+    channel = ledcChannel;
+    idleTicks = 0;
+    primed = false;
+
+    timerAlarmWrite(timer, STREAM_TIMER_CLOCK_HZ / sampleRate, true);
+    timerWrite(timer, 0);
+    active = true;
+    timerAlarmEnable(timer);
+}
+
+void SampleStream::stop()
+{
+    if (timer != nullptr)
+    {
+        timerAlarmDisable(timer);
+    }
+    active = false;
+}
+
+void IRAM_ATTR SampleStream::onTimer()
+{
+    if (!active)
+    {
+        return;
+    }
+
+    if (!primed && buffer.size() >= prefill)
+    {
+        primed = true;
+    }
+
+    uint16_t duty;
+    if (primed && buffer.pop(duty))
+    {
+        ledcWrite(channel, duty);
+        writtenDuty = duty;
+        played++;
+        idleTicks = 0;
+        return;
+    }
+
+    // Nothing to play: hold the last value and wait for a refill
+    if (primed)
+    {
+        primed = false;
+        underruns++;
+    }
+    idleTicks++;
+}
@@ -0,0 +1,245 @@
+#include "SettingsCache.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+SettingsCache::SettingsCache(Preferences &preferences)
+    : prefs(preferences), count(0), dirty(false), firstChangeMs(0), lastChangeMs(0), counters()
+{
+}
+
+uint32_t SettingsCache::getUInt(const char *key, uint32_t defaultValue)
+{
+    Entry *entry = lookup(key, Type::UInt, defaultValue);
+    return entry ? entry->value : prefs.getUInt(key, defaultValue);
+}
+
+uint8_t SettingsCache::getUChar(const char *key, uint8_t defaultValue)
+{
+    Entry *entry = lookup(key, Type::UChar, defaultValue);
+    return entry ? (uint8_t)entry->value : prefs.getUChar(key, defaultValue);
+}
+
+int32_t SettingsCache::getInt(const char *key, int32_t defaultValue)
+{
+    Entry *entry = lookup(key, Type::Int, (uint32_t)defaultValue);
+    return entry ? (int32_t)entry->value : prefs.getInt(key, defaultValue);
+}
+
+void SettingsCache::putUInt(const char *key, uint32_t value)
+{
+    put(key, Type::UInt, value);
+}
+
+void SettingsCache::putUChar(const char *key, uint8_t value)
+{
+    put(key, Type::UChar, value);
+}
+
+void SettingsCache::putInt(const char *key, int32_t value)
+{
+    put(key, Type::Int, (uint32_t)value);
+}
+
+size_t SettingsCache::getBytes(const char *key, void *data, size_t length)
+{
+    size_t stored = prefs.isKey(key) ? prefs.getBytesLength(key) : 0;
+    if (stored == 0 || stored > length)
+    {
+        return 0;
+    }
+    return prefs.getBytes(key, data, stored);
+}
+
+bool SettingsCache::putBytes(const char *key, const void *data, size_t length)
+{
+    uint32_t start = micros();
+    if (prefs.putBytes(key, data, length) != length)
+    {
+        return false;
+    }
+    counters.commits++;
+    counters.writes++;
+    counters.lastCommitUs = micros() - start;
+    if (counters.lastCommitUs > counters.maxCommitUs)
+    {
+        counters.maxCommitUs = counters.lastCommitUs;
+    }
+    return true;
+}
+
+void SettingsCache::remove(const char *key)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+        {
+            entries[i] = entries[--count];
+            break;
+        }
+    }
+
+    if (prefs.isKey(key) && prefs.remove(key))
+    {
+        counters.erases++;
+    }
+}
+
+bool SettingsCache::poll(uint32_t nowMs)
+{
+    if (!dirty ||
+        (nowMs - lastChangeMs < QUIET_PERIOD && nowMs - firstChangeMs < MAX_DELAY))
+    {
+        return false;
+    }
+    return flush();
+}
+
+bool SettingsCache::flush()
+{
+    dirty = false;
+    uint32_t start = micros();
+    uint32_t written = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Entry &entry = entries[i];
+        if (!entry.pending)
+        {
+            continue;
+        }
+
+        size_t result = 0;
+        switch (entry.type)
+        {
+        case Type::UInt:
+            result = prefs.putUInt(entry.key, entry.value);
+            break;
+        case Type::UChar:
+            result = prefs.putUChar(entry.key, (uint8_t)entry.value);
+            break;
+        case Type::Int:
+            result = prefs.putInt(entry.key, (int32_t)entry.value);
+            break;
+        }
+
+        // A failed write stays dirty and is retried by the next commit
+        if (result == 0)
+        {
+            dirty = true;
+            continue;
+        }
+        entry.stored = true;
+        entry.pending = false;
+        entry.committed = entry.value;
+        written++;
+    }
+
+    if (dirty)
+    {
+        // Back off a quiet period before retrying
+        firstChangeMs = lastChangeMs = millis();
+    }
+    if (written == 0)
+    {
+        return false;
+    }
+
+    counters.commits++;
+    counters.writes += written;
+    counters.lastCommitUs = micros() - start;
+    if (counters.lastCommitUs > counters.maxCommitUs)
+    {
+        counters.maxCommitUs = counters.lastCommitUs;
+    }
+    return true;
+}
+
+size_t SettingsCache::pendingKeys() const
+{
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entries[i].pending)
+        {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+// Finds the key's entry, creating it from NVS (or the default) on first
+// use. Returns nullptr when the table is full; callers then go straight
+// to NVS.
+SettingsCache::Entry *SettingsCache::lookup(const char *key, Type type, uint32_t defaultValue)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    if (count == MAX_KEYS)
+    {
+        return nullptr;
+    }
+
+    Entry &entry = entries[count++];
+    entry.key = key;
+    entry.type = type;
+    entry.stored = prefs.isKey(key);
+    switch (type)
+    {
+    case Type::UInt:
+        entry.value = prefs.getUInt(key, defaultValue);
+        break;
+    case Type::UChar:
+        entry.value = prefs.getUChar(key, (uint8_t)defaultValue);
+        break;
+    case Type::Int:
+        entry.value = (uint32_t)prefs.getInt(key, (int32_t)defaultValue);
+        break;
+    }
+    entry.committed = entry.value;
+    entry.pending = false;
+    return &entry;
+}
+
+void SettingsCache::put(const char *key, Type type, uint32_t value)
+{
+    Entry *entry = lookup(key, type, value);
+    if (entry == nullptr)
+    {
+        // Out of cache slots: fall back to a direct write
+        switch (type)
+        {
+        case Type::UInt:
+            prefs.putUInt(key, value);
+            break;
+        case Type::UChar:
+            prefs.putUChar(key, (uint8_t)value);
+            break;
+        case Type::Int:
+            prefs.putInt(key, (int32_t)value);
+            break;
+        }
+        counters.writes++;
+        return;
+    }
+
+    entry->value = value;
+    entry->pending = !entry->stored || value != entry->committed;
+    if (!entry->pending)
+    {
+        return;
+    }
+
+    uint32_t now = millis();
+    if (!dirty)
+    {
+        dirty = true;
+        firstChangeMs = now;
+    }
+    lastChangeMs = now;
+}
@@ -0,0 +1,86 @@
+#include "Telemetry.h"
+
+void TelemetryPublisher::begin(const TelemetryFieldConfig *defaults, size_t count, uint32_t subscribed)
+{
+    fieldCount = count < MAX_FIELDS ? count : MAX_FIELDS;
+    for (size_t i = 0; i < fieldCount; i++)
+    {
+        configs[i] = defaults[i];
+    }
+    reportedFields = 0;
+    subscribe(subscribed);
+}
+
+void TelemetryPublisher::subscribe(uint32_t fields)
+{
+    uint32_t all = fieldCount < 32 ? (1u << fieldCount) - 1 : UINT32_MAX;
+    subscribedFields = fields & all;
+    // Newly added fields go out with the next collect
+    reportedFields &= subscribedFields;
+}
+
+bool TelemetryPublisher::configure(size_t field, const TelemetryFieldConfig &config)
+{
+    if (field >= fieldCount ||
+        (config.maxIntervalMs != 0 && config.maxIntervalMs < config.minIntervalMs))
+    {
+        return false;
+    }
+    configs[field] = config;
+    return true;
+}
+
+uint32_t TelemetryPublisher::collectChanges(const int32_t *values, uint32_t now)
+{
+    uint32_t due = 0;
+    for (size_t i = 0; i < fieldCount; i++)
+    {
+        uint32_t bit = 1u << i;
+        if ((subscribedFields & bit) == 0)
+        {
+            continue;
+        }
+
+        const TelemetryFieldConfig &config = configs[i];
+        uint32_t sinceReport = now - lastReports[i];
+        bool changed;
+        if (reportedFields & bit)
+        {
+            // Widened so extreme values cannot overflow the difference
+            int64_t delta = (int64_t)values[i] - lastValues[i];
+            changed = (uint64_t)(delta < 0 ? -delta : delta) > config.deadband;
+        }
+        else
+        {
+            changed = true;
+            sinceReport = UINT32_MAX;
+        }
+
+        if ((changed && sinceReport >= config.minIntervalMs) ||
+            (config.maxIntervalMs != 0 && sinceReport >= config.maxIntervalMs))
+        {
+            markReported(i, values[i], now);
+            due |= bit;
+        }
+    }
+    return due;
+}
+
+uint32_t TelemetryPublisher::collectKeyframe(const int32_t *values, uint32_t now)
+{
+    for (size_t i = 0; i < fieldCount; i++)
+    {
+        if (subscribedFields & (1u << i))
+        {
+            markReported(i, values[i], now);
+        }
+    }
+    return subscribedFields;
+}
+
+void TelemetryPublisher::markReported(size_t field, int32_t value, uint32_t now)
+{
+    lastValues[field] = value;
+    lastReports[field] = now;
+    reportedFields |= 1u << field;
+}
@@ -0,0 +1,143 @@
+#include "TelemetryHistory.h"
+
+#include <string.h>
+
+static const uint32_t TIER_INTERVAL_MS[HISTORY_TIERS] = {0, TelemetryHistory::SECOND_MS, TelemetryHistory::MINUTE_MS};
+
+static uint8_t *putUint32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+    return out + 4;
+}
+
+TelemetryHistory::TelemetryHistory() : tiers(), rawRows(nullptr), rollupRows(), open()
+{
+}
+
+void TelemetryHistory::begin(HistorySample *raw, size_t rawCapacity,
+                             HistoryRollup *seconds, size_t secondsCapacity,
+                             HistoryRollup *minutes, size_t minutesCapacity)
+{
+    rawRows = raw;
+    rollupRows[HISTORY_SECONDS] = seconds;
+    rollupRows[HISTORY_MINUTES] = minutes;
+    tiers[HISTORY_RAW] = {raw ? rawCapacity : 0, 0};
+    tiers[HISTORY_SECONDS] = {seconds ? secondsCapacity : 0, 0};
+    tiers[HISTORY_MINUTES] = {minutes ? minutesCapacity : 0, 0};
+    memset(open, 0, sizeof(open));
+}
+
+void TelemetryHistory::record(uint32_t nowMs, const int32_t values[HISTORY_CHANNELS])
+{
+    Tier &tier = tiers[HISTORY_RAW];
+    if (tier.capacity > 0)
+    {
+        HistorySample &row = rawRows[tier.written % tier.capacity];
+        row.timeMs = nowMs;
+        memcpy(row.values, values, sizeof(row.values));
+        tier.written++;
+    }
+
+    int64_t sum[HISTORY_CHANNELS];
+    for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        sum[c] = values[c];
+    }
+    accumulate(HISTORY_SECONDS, nowMs, 1, values, values, sum);
+}
+
+// Adds samples to the tier's open row, first closing it if `timeMs` falls
+// in a later interval
+void TelemetryHistory::accumulate(uint8_t tier, uint32_t timeMs, uint32_t samples,
+                                  const int32_t *minimum, const int32_t *maximum, const int64_t *sum)
+{
+    Accumulator &row = open[tier];
+    uint32_t startMs = timeMs - timeMs % TIER_INTERVAL_MS[tier];
+    if (row.samples > 0 && startMs != row.startMs)
+    {
+        close(tier);
+    }
+
+    if (row.samples == 0)
+    {
+        row.startMs = startMs;
+        memcpy(row.minimum, minimum, sizeof(row.minimum));
+        memcpy(row.maximum, maximum, sizeof(row.maximum));
+        memset(row.sum, 0, sizeof(row.sum));
+    }
+    for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        row.minimum[c] = minimum[c] < row.minimum[c] ? minimum[c] : row.minimum[c];
+        row.maximum[c] = maximum[c] > row.maximum[c] ? maximum[c] : row.maximum[c];
+        row.sum[c] += sum[c];
+    }
+    row.samples += samples;
+}
+
+void TelemetryHistory::close(uint8_t tier)
+{
+    Accumulator &row = open[tier];
+    HistoryRollup closed;
+    closed.timeMs = row.startMs;
+    closed.samples = row.samples;
+    memcpy(closed.minimum, row.minimum, sizeof(closed.minimum));
+    memcpy(closed.maximum, row.maximum, sizeof(closed.maximum));
+    for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        closed.mean[c] = (int32_t)(row.sum[c] / (int64_t)row.samples);
+    }
+    row.samples = 0;
+
+    Tier &stored = tiers[tier];
+    if (stored.capacity > 0)
+    {
+        rollupRows[tier][stored.written % stored.capacity] = closed;
+        stored.written++;
+    }
+
+    // A closed second feeds the minute with its own min, max and sum
+    if ((size_t)tier + 1 < HISTORY_TIERS)
+    {
+        accumulate(tier + 1, closed.timeMs, closed.samples, closed.minimum, closed.maximum, row.sum);
+    }
+}
+
+uint32_t TelemetryHistory::oldest(uint8_t tier) const
+{
+    const Tier &stored = tiers[tier];
+    return stored.written > stored.capacity ? stored.written - (uint32_t)stored.capacity : 0;
+}
+
+bool TelemetryHistory::packRow(uint8_t tier, uint32_t index, uint8_t *out) const
+{
+    if (tier >= HISTORY_TIERS || index < oldest(tier) || index >= tiers[tier].written)
+    {
+        return false;
+    }
+    const Tier &stored = tiers[tier];
+
+    if (tier == HISTORY_RAW)
+    {
+        const HistorySample &row = rawRows[index % stored.capacity];
+        out = putUint32(out, row.timeMs);
+        for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+        {
+            out = putUint32(out, (uint32_t)row.values[c]);
+        }
+        return true;
+    }
+
+    const HistoryRollup &row = rollupRows[tier][index % stored.capacity];
+    out = putUint32(out, row.timeMs);
+    out = putUint32(out, row.samples);
+    for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        out = putUint32(out, (uint32_t)row.minimum[c]);
+        out = putUint32(out, (uint32_t)row.maximum[c]);
+        out = putUint32(out, (uint32_t)row.mean[c]);
+    }
+    return true;
+}
@@ -0,0 +1,182 @@
+#include "TxQueue.h"
+
+#include <string.h>
+
+// Response space holds a listing page beside a full reply to another
+// command (PAGE_RESERVE in main.cpp); longer listings are paged
+static char responseBuffer[4096];
+static char eventBuffer[1024];
+static char heartbeatBuffer[512];
+static char streamBuffer[2048]; // ~150ms of 1kHz telemetry
+static char logBuffer[512];
+
+// Each message is stored as a 16-bit length followed by its bytes
+static const size_t HEADER_SIZE = 2;
+
+TxQueue::TxQueue() : rings(), active(-1)
+{
+    rings[(uint8_t)TxClass::Response].data = responseBuffer;
+    rings[(uint8_t)TxClass::Response].size = sizeof(responseBuffer);
+    rings[(uint8_t)TxClass::Event].data = eventBuffer;
+    rings[(uint8_t)TxClass::Event].size = sizeof(eventBuffer);
+    rings[(uint8_t)TxClass::Heartbeat].data = heartbeatBuffer;
+    rings[(uint8_t)TxClass::Heartbeat].size = sizeof(heartbeatBuffer);
+    rings[(uint8_t)TxClass::Heartbeat].coalesce = true;
+    rings[(uint8_t)TxClass::Stream].data = streamBuffer;
+    rings[(uint8_t)TxClass::Stream].size = sizeof(streamBuffer);
+    rings[(uint8_t)TxClass::Log].data = logBuffer;
+    rings[(uint8_t)TxClass::Log].size = sizeof(logBuffer);
+}
+
+bool TxQueue::pushLine(TxClass cls, const char *text, size_t length)
+{
+    return enqueue(cls, text, length, true);
+}
+
+bool TxQueue::push(TxClass cls, const char *data, size_t length)
+{
+    return enqueue(cls, data, length, false);
+}
+
+bool TxQueue::enqueue(TxClass cls, const char *data, size_t length, bool newline)
+{
+    Ring &ring = rings[(uint8_t)cls];
+    size_t messageLength = length + (newline ? 2 : 0);
+
+    if (ring.coalesce && ring.messages > 0)
+    {
+        // Keep only a message that is already on the wire
+        size_t kept = ring.remaining > 0 ? 1 : 0;
+        size_t discarded = ring.messages - kept;
+        ring.stats.coalescedMessages += discarded;
+        ring.stats.droppedBytes += ring.used - ring.remaining - discarded * HEADER_SIZE;
+        ring.used = ring.remaining;
+        ring.messages = kept;
+    }
+
+    if (messageLength > 0xFFFF || HEADER_SIZE + messageLength > ring.size - ring.used)
+    {
+        ring.stats.droppedBytes += messageLength;
+        ring.stats.droppedMessages++;
+        return false;
+    }
+
+    size_t tail = (ring.head + ring.used) % ring.size;
+    uint8_t header[HEADER_SIZE] = {(uint8_t)(messageLength >> 8), (uint8_t)messageLength};
+    copyIn(ring, tail, reinterpret_cast<const char *>(header), HEADER_SIZE);
+    copyIn(ring, tail, data, length);
+    if (newline)
+    {
+        copyIn(ring, tail, "\r\n", 2);
+    }
+
+    ring.used += HEADER_SIZE + messageLength;
+    ring.messages++;
+    ring.stats.queuedBytes += messageLength;
+    return true;
+}
+
+void TxQueue::copyIn(Ring &ring, size_t &tail, const char *data, size_t length)
+{
+    size_t first = ring.size - tail < length ? ring.size - tail : length;
+    memcpy(ring.data + tail, data, first);
+    memcpy(ring.data, data + first, length - first);
+    tail = (tail + length) % ring.size;
+}
+
+size_t TxQueue::nextChunk(const char *&chunk, size_t limit, TxClass last)
+{
+    if (active < 0)
+    {
+        // Start the next message from the highest priority non-empty class
+        for (uint8_t i = 0; i <= (uint8_t)last; i++)
+        {
+            Ring &ring = rings[i];
+            if (ring.messages == 0)
+            {
+                continue;
+            }
+
+            uint8_t high = (uint8_t)ring.data[ring.head];
+            uint8_t low = (uint8_t)ring.data[(ring.head + 1) % ring.size];
+            ring.head = (ring.head + HEADER_SIZE) % ring.size;
+            ring.used -= HEADER_SIZE;
+            ring.remaining = ((size_t)high << 8) | low;
+            active = (int8_t)i;
+            break;
+        }
+        if (active < 0)
+        {
+            return 0;
+        }
+    }
+
+    Ring &ring = rings[active];
+    size_t length = ring.remaining;
+    if (length > ring.size - ring.head)
+    {
+        length = ring.size - ring.head;
+    }
+    if (length > limit)
+    {
+        length = limit;
+    }
+    chunk = ring.data + ring.head;
+    return length;
+}
+
+void TxQueue::consume(size_t length)
+{
+    Ring &ring = rings[active];
+    ring.head = (ring.head + length) % ring.size;
+    ring.used -= length;
+    ring.remaining -= length;
+    ring.stats.sentBytes += length;
+
+    if (ring.remaining == 0)
+    {
+        ring.messages--;
+        active = -1;
+    }
+}
+
+size_t TxQueue::pendingBytes() const
+{
+    size_t total = 0;
+    for (uint8_t i = 0; i < (uint8_t)TxClass::Count; i++)
+    {
+        total += rings[i].used;
+    }
+    return total;
+}
+
+bool TxQueue::drained(TxClass last) const
+{
+    if (active >= 0)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i <= (uint8_t)last; i++)
+    {
+        if (rings[i].messages > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TxStats TxQueue::totals() const
+{
+    TxStats total = {};
+    for (uint8_t i = 0; i < (uint8_t)TxClass::Count; i++)
+    {
+        const TxStats &stats = rings[i].stats;
+        total.queuedBytes += stats.queuedBytes;
+        total.sentBytes += stats.sentBytes;
+        total.droppedBytes += stats.droppedBytes;
+        total.droppedMessages += stats.droppedMessages;
+        total.coalescedMessages += stats.coalescedMessages;
+    }
+    return total;
+}
@@ -0,0 +1,198 @@
+#include "Waveform.h"
+
+#include <math.h>
+
+// Hardware timer 3 at 10MHz (80MHz APB / 8) gives 0.1us alarm resolution
+const uint8_t WAVE_TIMER = 3;
+const uint16_t WAVE_TIMER_DIVIDER = 8;
+const uint32_t WAVE_TIMER_CLOCK_HZ = 10000000;
+
+static portMUX_TYPE waveLock = portMUX_INITIALIZER_UNLOCKED;
+static WaveformEngine *timerOwner = nullptr;
+
+static void IRAM_ATTR onWaveTimer()
+{
+    timerOwner->onTimer();
+}
+
+void generateWave(WaveShape shape, uint16_t amplitude, uint16_t offset,
+                  const uint16_t *points, size_t pointCount,
+                  uint16_t out[WAVE_TABLE_SIZE])
+{
+    const size_t half = WAVE_TABLE_SIZE / 2;
+
+    for (size_t i = 0; i < WAVE_TABLE_SIZE; i++)
+    {
+        // Shape value in permille, -1000..+1000
+        int32_t value;
+        switch (shape)
+        {
+        case WaveShape::Sine:
+            value = (int32_t)lroundf(1000.0f * sinf(2.0f * (float)M_PI * i / WAVE_TABLE_SIZE));
+            break;
+        case WaveShape::Square:
+            value = i < half ? 1000 : -1000;
+            break;
+        case WaveShape::Triangle:
+            value = i < half ? -1000 + (int32_t)(i * 2000 / half)
+                             : 1000 - (int32_t)((i - half) * 2000 / half);
+            break;
+        case WaveShape::Sawtooth:
+            value = -1000 + (int32_t)(i * 2000 / (WAVE_TABLE_SIZE - 1));
+            break;
+        default:
+        {
+            if (pointCount == 0)
+            {
+                value = 0;
+                break;
+            }
+            // Periodic linear interpolation in 16.16 fixed point
+            uint32_t position = (uint32_t)((i * pointCount << 16) / WAVE_TABLE_SIZE);
+            size_t index = position >> 16;
+            int32_t fraction = position & 0xFFFF;
+            int32_t a = points[index];
+            int32_t b = points[(index + 1) % pointCount];
+            int32_t point = a + (((b - a) * fraction) >> 16);
+            value = (point - 500) * 2;
+            break;
+        }
+        }
+
+        int32_t power = offset + amplitude * value / 1000;
+        power = constrain(power, 0, 1000);
+        out[i] = (uint16_t)((power * 65535 + 500) / 1000);
+    }
+}
+
+WaveformEngine::WaveformEngine()
+    : tables(), current(0), swapPending(false), phase(0), phaseStep(0), pendingStep(0),
+      sampleRate(10000), targetCycles(0), cycles(0), active(false), done(false),
+      writtenDuty(0), channel(0), timer(nullptr), lastTick(0), stats()
+{
+}
+
+uint32_t WaveformEngine::stepFor(uint32_t frequencyMilliHz) const
+{
+    return (uint32_t)(((uint64_t)frequencyMilliHz << 32) / ((uint64_t)sampleRate * 1000));
+}
+
+void WaveformEngine::loadTable(const uint16_t duties[WAVE_TABLE_SIZE], uint32_t frequencyMilliHz)
+{
+    uint32_t step = stepFor(frequencyMilliHz);
+
+    portENTER_CRITICAL(&waveLock);
+    if (active)
+    {
+        memcpy(tables[current ^ 1], duties, sizeof(tables[0]));
+        pendingStep = step;
+        swapPending = true;
+    }
+    else
+    {
+        memcpy(tables[current], duties, sizeof(tables[0]));
+        phaseStep = step;
+        swapPending = false;
+    }
+    portEXIT_CRITICAL(&waveLock);
+}
+
+void WaveformEngine::rearm()
+{
+    cycles = 0;
+    done = false;
+}
+
+void WaveformEngine::start(uint8_t ledcChannel)
+{
+    if (timer == nullptr)
+    {
+        timerOwner = this;
+        timer = timerBegin(WAVE_TIMER, WAVE_TIMER_DIVIDER, true);
+        timerAttachInterrupt(timer, &onWaveTimer, true);
+    }
+
+    channel = ledcChannel;
+    phase = 0;
+    resetTiming();
+
+    timerAlarmWrite(timer, WAVE_TIMER_CLOCK_HZ / sampleRate, true);
+    timerWrite(timer, 0);
+    active = true;
+    timerAlarmEnable(timer);
+}
+
+void WaveformEngine::stop()
+{
+    if (timer != nullptr)
+    {
+        timerAlarmDisable(timer);
+    }
+    active = false;
+}
+
+WaveTiming WaveformEngine::timing()
+{
+    portENTER_CRITICAL(&waveLock);
+    WaveTiming snapshot = stats;
+    portEXIT_CRITICAL(&waveLock);
+    return snapshot;
+}
+
+void WaveformEngine::resetTiming()
+{
+    portENTER_CRITICAL(&waveLock);
+    stats = WaveTiming();
+    stats.expectedCycles = getCpuFrequencyMhz() * 1000000 / sampleRate;
+    stats.minCycles = UINT32_MAX;
+    portEXIT_CRITICAL(&waveLock);
+}
+
+void IRAM_ATTR WaveformEngine::onTimer()
+{
+    uint32_t now = ESP.getCycleCount();
+    bool write = false;
+    uint16_t duty = 0;
+
+    portENTER_CRITICAL_ISR(&waveLock);
+    if (active && !done)
+    {
+        if (stats.samples > 0)
+        {
+            uint32_t interval = now - lastTick;
+            stats.minCycles = interval < stats.minCycles ? interval : stats.minCycles;
+            stats.maxCycles = interval > stats.maxCycles ? interval : stats.maxCycles;
+            stats.totalCycles += interval;
+        }
+        stats.samples++;
+        lastTick = now;
+
+        duty = tables[current][phase >> 24];
+        write = true;
+
+        uint32_t next = phase + phaseStep;
+        if (next < phase)
+        {
+            // Cycle boundary: the only place shape and frequency change
+            cycles++;
+            if (targetCycles != 0 && cycles >= targetCycles)
+            {
+                done = true;
+            }
+            if (swapPending)
+            {
+                current ^= 1;
+                phaseStep = pendingStep;
+                swapPending = false;
+            }
+        }
+        phase = next;
+    }
+    portEXIT_CRITICAL_ISR(&waveLock);
+
+    if (write)
+    {
+        ledcWrite(channel, duty);
+        writtenDuty = duty;
+    }
+}
@@ -1,65 +1,769 @@
 #include <Arduino.h>
 #include <Preferences.h>
+#include <stdarg.h>
+#include "AdcSampler.h"
+#include "AllocCounter.h"
+#include "BinaryProtocol.h"
+#include "Calibration.h"
+#include "CommandRegistry.h"
+#include "JsonWriter.h"
+#include "LatencyStats.h"
+#include "LineAssembler.h"
+#include "OutputScheduler.h"
+#include "PowerController.h"
+#include "Profiler.h"
+#include "SampleStream.h"
+#include "SettingsCache.h"
+#include "SpscQueue.h"
+#include "Telemetry.h"
+#include "TelemetryHistory.h"
+#include "TelemetryRecord.h"
+#include "TxQueue.h"
+#include "Waveform.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#endif
+
+// Outcome of writing one line of a paged listing (see servicePagedReply)
+enum class PageLine : uint8_t
+{
+    Next,  // line queued, or nothing to send at this position
+    Retry, // the response ring was full; write the same line again later
+    End    // past the last line
+};
 
 // ==================== FUNCTION DECLARATIONS ====================
 void setup();
 void loop();
-void handleCommand(String command);
-void sendHeartbeat();
+void handleCommand(const char *command, size_t length, uint32_t rxCycles, uint32_t readyCycles);
+int32_t takeRequestId(const char *&command, size_t &length);
+bool takeScheduleTime(const char *&command, size_t &length, uint64_t &at);
+void sendCommandReply(int32_t requestId, DispatchResult result);
+void rejectCommand();
+void setAppliedValue(int32_t value);
+void beginCommand();
+DispatchResult finishCommand(DispatchResult result);
+void collectField(int32_t value, void (*finisher)());
+void sendTimeSync();
+DispatchResult scheduleCommand(uint64_t at, const CommandSpec &spec, bool hasArgument, int32_t value, int32_t id);
+DispatchResult scheduleTextCommand(const CommandSpec &spec, const char *command, size_t length, uint64_t at, int32_t id);
+void handleScheduleFrame(const BinaryFrame &frame);
+void serviceSchedule();
+void clearSchedule(const char *reason, bool inFlight);
+uint64_t scheduleHoldUntil();
+void sendScheduleStatus();
+void openSession();
+void closeSession(const char *reason);
+void requestBaudRate(int32_t rate);
+void confirmBaudRate(int32_t rate);
+void serviceBaudRate();
+void applyBaudRate(uint32_t rate);
+void restoreDefaultBaudRate();
+void applyRequestedMode();
+bool subscribed(TxClass cls);
+uint32_t deviceCapabilities();
+void publishTelemetry();
+void sampleTelemetry(int32_t values[]);
+void sendTelemetry(TxClass cls, const char *type, uint32_t fields, const int32_t values[]);
+void configureTelemetryField();
+void sendTelemetryConfig();
+PageLine sendTelemetryConfigLine(size_t line);
+void setTelemetryStreamRate(int32_t hz);
+void sendTelemetryRecords();
+void sendTelemetryLayout();
+PageLine sendTelemetryLayoutLine(size_t line);
+void allocateHistory();
+void recordHistory();
+void startHistoryDump(uint8_t tier);
+void serviceHistoryDump();
+void sendHistoryStatus();
+PageLine sendHistoryStatusLine(size_t line);
+bool startPagedReply(PageLine (*writer)(size_t line));
+void servicePagedReply();
 void sendStatusUpdate();
+void sendAllocationStats();
+uint32_t traceBegin(uint8_t opcode, uint32_t rxCycles, uint32_t readyCycles);
+void traceEnd(uint32_t startCycles);
+void recordAppliedTraces();
+void sendLatencyStats();
+PageLine sendLatencyLine(size_t line);
+uint32_t profileMark(uint8_t scope, uint32_t startMicros);
+bool readCoreLoad(uint16_t load[2]);
+void sendProfile();
+PageLine sendProfileLine(size_t line);
+void sendProfileFrame();
+void setProfileStreamInterval(int32_t ms);
+void resetProfileWindow();
 void sendSystemInfo();
 void setLaserState(bool state);
 void setLaserBrightness(int brightness);
+void setLaserSetpoint(uint32_t setpoint);
+bool configurePwm(uint32_t frequency, uint8_t resolution);
+uint32_t setpointToDuty(uint32_t setpoint);
+uint32_t setpointToRawDuty(uint32_t setpoint);
+void setLaserDuty(int32_t duty);
+void setPwmFrequency(int32_t frequency);
+void setPwmResolution(int32_t resolution);
+void postLaserOutput();
+void laserTask(void *parameter);
 void readAnalogPins();
-String getFormattedTime();
-String getFormattedUptime();
-float getVoltageFromAnalog(int analogValue);
+int readAnalogA0();
+void stopAdcSampler();
+void setAdcSampleRate(int32_t hz);
+void setAdcOversample(int32_t count);
+void sendAdcStatus();
+void getFormattedTime(char *buffer, size_t size);
+void getFormattedUptime(char *buffer, size_t size);
+int32_t getCentivoltsFromAnalog(int analogValue);
+bool sendJson(TxClass cls, const JsonWriter &json);
+bool sendLine(TxClass cls, const char *text);
+void sendLinef(TxClass cls, const char *format, ...) __attribute__((format(printf, 2, 3)));
 void printHelp();
+PageLine sendHelpLine(size_t line);
 void printSystemStatus();
 void runDiagnostics();
 void memoryTest();
 void saveBrightnessToPreferences();
 void loadBrightnessFromPreferences();
+void savePwmConfigToPreferences();
+void loadPwmConfigFromPreferences();
 void sendInitialDeviceState(); // New function
+void printVersion();
+void printAnalogReading();
+void printLaserStatus();
+void restartDevice();
+void enterBinaryMode();
+void exitBinaryMode();
+size_t pollBinaryFrames();
+void handleFrame(const BinaryFrame &frame, uint32_t rxCycles);
+bool sendFrame(TxClass cls, uint8_t opcode, const uint8_t *payload, size_t length);
+void updateWaveform();
+void startWaveform();
+void stopWaveform();
+void setWaveShape(int32_t shape);
+void setWaveFrequency(int32_t milliHz);
+void setWaveSampleRate(int32_t hz);
+void sendWaveformStatus();
+void startStream();
+void pushStreamSample(int32_t permille);
+void setStreamSampleRate(int32_t hz);
+void sendStreamStatus(TxClass cls);
+void startPowerControl();
+void stopPowerControl();
+void setPowerTarget(int32_t counts);
+void setPowerGain(int32_t *gain, const char *key, int32_t value);
+void loadPowerControlFromPreferences();
+void sendPowerStatus();
+void refreshCalibratedOutput();
+bool saveCalibrationCurve(uint8_t profile, const uint16_t curve[CAL_POINTS]);
+void loadCalibrationFromPreferences();
+bool selectCalibrationProfile(uint8_t profile);
+void startCalibration(uint8_t profile);
+void stopCalibration(const char *reason);
+void serviceCalibration();
+void beginCalibrationUpload(uint8_t profile);
+void addCalibrationPoint(int32_t reading);
+void sendCalibration(uint8_t profile);
 
 // ==================== GLOBAL VARIABLES ====================
-String receivedData = "";
+LineAssembler serialLines;
+TxQueue txQueue;
 unsigned long lastHeartbeat = 0;
 unsigned long bootTime = 0;
+uint32_t setupAllocations = 0; // heap allocations made by setup(); none should follow
 bool heartbeatEnabled = true;
-int heartbeatInterval = 5000; // 5 seconds default
+int heartbeatInterval = 5000; // 5 seconds default; keyframe interval
+
+// Heartbeat fields: a keyframe with every subscribed field goes out each
+// heartbeatInterval, and fields that change in between are reported
+// straight away as "telemetry" events (see Telemetry.h)
+enum TelemetryFieldId : uint8_t
+{
+    TELEMETRY_LASER_STATE,
+    TELEMETRY_LASER_BRIGHTNESS,
+    TELEMETRY_LASER_DUTY,
+    TELEMETRY_OUTPUT_MODE,
+    TELEMETRY_CALIBRATION_PROFILE,
+    TELEMETRY_ANALOG_A0,
+    TELEMETRY_FREE_HEAP,
+    TELEMETRY_TX_DROPPED,
+    TELEMETRY_FIELDS
+};
+const char *const TELEMETRY_NAMES[TELEMETRY_FIELDS] = {
+    "laser_state", "laser_brightness", "laser_pwm_value", "output_mode",
+    "calibration_profile", "analog_a0", "free_heap_bytes", "tx_dropped_messages"};
+const TelemetryFieldConfig TELEMETRY_DEFAULTS[TELEMETRY_FIELDS] = {
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {100, 0, 16}, // A0: ~13mV, at most 10 reports/s
+    {1000, 0, 1024},
+    {1000, 0, 0}};
+// The fields the heartbeat always carried
+const uint32_t TELEMETRY_DEFAULT_FIELDS = (1u << TELEMETRY_LASER_STATE) | (1u << TELEMETRY_LASER_BRIGHTNESS) |
+                                          (1u << TELEMETRY_FREE_HEAP);
+TelemetryPublisher telemetry;
 
 // Laser control variables
 bool laserState = false;
-int laserBrightness = 50; // 0-100%
-int laserPwmValue = 127;  // 0-255 PWM value
+// The setpoint is a 16-bit fraction of full power (LASER_SETPOINT_MAX = 100%)
+// so percent, permille and raw duty requests all survive any PWM resolution
+const uint32_t LASER_SETPOINT_MAX = 65535;
+uint32_t laserSetpoint = LASER_SETPOINT_MAX / 2;
+int laserBrightness = 50; // 0-100%, rounded from laserSetpoint for display
+uint32_t laserDuty = 127; // LEDC duty counts for laserSetpoint
+
+// Laser control task: owns the LEDC output and runs on the core loop() does
+// not use, so UART writes and flash access on core 1 never delay it
+enum class OutputMode : uint8_t
+{
+    Steady,   // laserState/laserDuty
+    Waveform, // timer ISR plays the waveform table
+    Stream,   // timer ISR plays host-streamed samples
+    PowerLoop // laser task regulates the A0 photodiode reading
+};
+
+struct LaserOutput
+{
+    bool on;
+    uint32_t duty;
+    uint32_t frequency;
+    uint8_t resolution;
+    OutputMode mode;
+    uint8_t modeRun; // bumped by every start so a finished run can restart
+    uint8_t traceSlot; // latency slot of the command that posted this, or NO_TRACE
+    uint32_t traceCycles; // first byte to post, loop() core cycles
+    uint32_t tracePostedMicros;
+    uint64_t applyAt; // esp_timer time to apply it at, 0 = on arrival
+};
+
+// Command latency (LATENCY_STATS). Stages on the loop() core are CCOUNT
+// cycles. The apply stage ends on core 0, whose cycle counter does not run
+// in step, so the laser task reports that one in microseconds.
+const uint8_t NO_TRACE = 0xFF;
+struct LatencyApply
+{
+    uint8_t slot;
+    uint32_t traceCycles;
+    uint32_t applyMicros;
+};
+LatencyStats latency;
+LatencyStats latencyReport; // window being sent by LATENCY_STATS
+SpscQueue<LatencyApply, 16> latencyApplyQueue; // laserTask -> loop()
+uint32_t cyclesPerMicro = 240;
+uint32_t rxStartCycles = 0; // poll that brought the first byte of the pending line
+bool rxLinePending = false;
+uint8_t traceSlot = NO_TRACE; // command whose handler is running
+uint32_t traceRxCycles = 0;
+
+// TELEMETRY_STREAM: the laser task takes a record every telemetryDivider
+// ticks and loop() packs whatever has queued up into FRAME_TELEMETRY frames
+SpscQueue<TelemetryRecord, 64> telemetryQueue; // laserTask -> loop()
+volatile uint16_t telemetryDivider = 0;        // laser ticks per record, 0 = off
+volatile uint32_t telemetryOverruns = 0;       // records lost to a full queue
+const uint32_t TELEMETRY_MAX_RATE = 1000;      // the laser task tick
+const size_t TELEMETRY_FRAME_RECORDS = 32;
+
+// On-device history (HISTORY_DUMP): a raw sample every 10ms, rolled up per
+// second and per minute. Sized for PSRAM, with a much shorter fallback in
+// internal RAM on boards without it.
+const uint32_t HISTORY_RAW_INTERVAL = 10;
+const size_t HISTORY_PSRAM_ROWS[HISTORY_TIERS] = {1000, 3600, 1440}; // 10s, 1h, 1 day
+const size_t HISTORY_INTERNAL_ROWS[HISTORY_TIERS] = {300, 120, 120}; // 3s, 2min, 2h
+const char *const HISTORY_CHANNEL_NAMES = "laser_brightness,laser_on_permille,analog_a0,free_heap_bytes,loop_us";
+TelemetryHistory history;
+bool historyInPsram = false;
+unsigned long lastHistorySample = 0;
+uint32_t historyLoopMaxUs = 0; // longest loop() pass since the last sample
+int16_t historyDumpTier = -1;  // tier being dumped, -1 = none
+uint32_t historyDumpNext = 0;  // absolute row index
+uint32_t historyDumpEnd = 0;
+
+// Listing being sent a line at a time (HELP, ...), nullptr = none
+PageLine (*pageWriter)(size_t line) = nullptr;
+size_t pageLine = 0;
+
+// Scheduled commands ("@<time_us> NAME", SCHEDULE frames). loop() runs
+// each one SCHEDULE_LEAD_US before its time; the output it posts carries
+// the time and the laser task holds it until then (see OutputScheduler.h).
+// Outputs posted meanwhile queue up behind it, so nothing overtakes a
+// scheduled change except an immediate LASER_OFF, which drops the schedule.
+struct ScheduledCommand
+{
+    uint64_t at; // esp_timer microseconds
+    const CommandSpec *spec;
+    uint8_t argument[4];
+    uint8_t argumentLength;
+    int32_t id; // request id or frame sequence, -1 = none
+};
+
+struct ScheduleReport
+{
+    uint64_t requested;
+    uint64_t achieved;
+    bool exact; // written by the timer alarm rather than on a task tick
+};
+
+// Commands that only change the laser output. Level and on/off changes are
+// written by the timer alarm; mode starts and stops take effect on the
+// laser task tick at or after their time.
+const uint8_t SCHEDULABLE_OPCODES[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x07, 0x08, 0x48, 0x49, 0x52, 0x54, 0x5C, 0x5D};
+const size_t SCHEDULE_CAPACITY = 16;
+const uint64_t SCHEDULE_LEAD_US = 30000;              // a loop() pass plus a laser tick, with margin
+const uint64_t SCHEDULE_MAX_AHEAD_US = 3600000000ull; // 1 hour
+const uint64_t SCHEDULE_ARM_US = 2000;                // alarm armed this close to the time
+ScheduledCommand schedule[SCHEDULE_CAPACITY];         // waiting, by time
+size_t scheduleCount = 0;
+ScheduledCommand scheduleInFlight[SCHEDULE_CAPACITY]; // run, output not applied yet
+size_t scheduleInFlightCount = 0;
+uint64_t commandApplyAt = 0; // time of the scheduled command running, 0 = none
+bool scheduledOutputPosted = false;
+SpscQueue<ScheduleReport, 16> scheduleReportQueue; // laserTask -> loop()
+volatile uint32_t scheduleReportsLost = 0;         // queue full; written by laserTask
+uint32_t scheduleReportsSettled = 0;               // losses loop() has caught up with
+OutputScheduler outputScheduler;
+uint32_t scheduleApplied = 0;
+uint32_t scheduleExact = 0;
+uint32_t scheduleCancelled = 0;
+int32_t scheduleErrorMin = 0;
+int32_t scheduleErrorMax = 0;
+uint64_t scheduleErrorAbsSum = 0;
+
+// TIME_SYNC receive stamp: the poll that brought the command in
+uint64_t rxStartTime = 0;
+uint64_t commandRxTime = 0;
+
+// loop() profiling (PROFILE). Each stage of loop() is a scope; "period" is
+// loop start to loop start and "heartbeat_late" how far past its interval
+// each heartbeat went out. Every report starts a new window.
+enum ProfileScopeId : uint8_t
+{
+    PROFILE_PERIOD,
+    PROFILE_LOOP,
+    PROFILE_OUTPUT,
+    PROFILE_SERIAL,
+    PROFILE_COMMANDS,
+    PROFILE_SESSION,
+    PROFILE_TELEMETRY,
+    PROFILE_HEARTBEAT_LATE,
+    PROFILE_SETTINGS,
+    PROFILE_TRANSMIT,
+    PROFILE_SCOPES
+};
+const char *const PROFILE_NAMES[PROFILE_SCOPES] = {"period", "loop", "output", "serial", "commands",
+                                                   "session", "telemetry", "heartbeat_late", "settings", "transmit"};
+ProfileScope profileScopes[PROFILE_SCOPES];
+uint32_t profileWindowStart = 0; // micros
+// Window being sent by PROFILE
+ProfileScope profileReport[PROFILE_SCOPES];
+uint32_t profileReportUs = 0;
+uint16_t profileReportLoad[2] = {0, 0};
+bool profileReportHasLoad = false;
+uint32_t lastLoopStart = 0;
+bool loopStarted = false;
+uint32_t profileStreamInterval = 0; // ms between FRAME_PROFILE frames, 0 = off
+unsigned long lastProfileFrame = 0;
+const uint32_t PROFILE_STREAM_MIN_INTERVAL = 100;
+
+SpscQueue<LaserOutput, 16> laserOutputQueue; // loop() -> laserTask
+bool laserOutputPending = false;             // last post hit a full queue
+TaskHandle_t laserTaskHandle = nullptr;
+
+const BaseType_t LASER_TASK_CORE = 0;
+const UBaseType_t LASER_TASK_PRIORITY = configMAX_PRIORITIES - 2;
+const uint32_t LASER_TASK_STACK_SIZE = 2048;
+const TickType_t LASER_TASK_PERIOD = pdMS_TO_TICKS(1); // 1kHz control tick
+
+// Waveform playback: shape parameters live here, the table is generated in
+// loop() and played from a timer ISR started by the laser task
+WaveformEngine waveform;
+WaveShape waveShape = WaveShape::Sine;
+uint32_t waveFrequency = 1000; // millihertz
+uint16_t waveAmplitude = 500;  // permille of full power around the offset
+uint16_t waveOffset = 500;     // permille of full power
+uint16_t wavePoints[WAVE_TABLE_SIZE];
+size_t wavePointCount = 0;
+
+// Host-streamed setpoints: samples bypass setLaserSetpoint(), so nothing
+// is written to preferences while streaming
+SampleStream sampleStream;
+unsigned long lastStreamReport = 0;
+const unsigned long STREAM_REPORT_INTERVAL = 100; // fill reports while streaming
+
+// Output calibration. Profiles 1-CAL_PROFILES each hold a curve saved under
+// CAL_KEYS; profile 0 is the uncalibrated linear mapping.
+const uint8_t CAL_PROFILES = 4;
+const char *const CAL_KEYS[CAL_PROFILES] = {"cal1", "cal2", "cal3", "cal4"};
+Calibration calibration;
+uint8_t calibrationProfile = 0;
+
+// Calibration sweep: raw duty steps from 0 to full, each held for
+// CAL_SETTLE_MS and then averaged over CAL_READS_PER_STEP loop() passes
+const size_t CAL_SWEEP_STEPS = 65;
+const unsigned long CAL_SETTLE_MS = 30;
+const uint8_t CAL_READS_PER_STEP = 4;
+bool calibrating = false;
+uint8_t sweepProfile = 0;
+size_t sweepStep = 0;
+unsigned long sweepStepStart = 0;
+uint32_t sweepSum = 0;
+uint8_t sweepReads = 0;
+uint32_t sweepDuty = 0;
+uint16_t sweepReadings[CAL_SWEEP_STEPS];
+
+// Bulk upload through CAL_WRITE + CAL_DATA
+uint8_t uploadProfile = 0;
+size_t uploadCount = 0;
+uint16_t uploadCurve[CAL_POINTS];
+
+// Continuous A0 sampling; readAnalogA0() serves the latest filtered value
+AdcSampler adcSampler;
+// Last one-shot A0 reading taken by loop(); analogRead() is only ever called
+// on that core, so the laser task reads this while the sampler is stopped
+volatile uint16_t lastOneShotA0 = 0;
+
+// Closed-loop power control, stepped by the laser task. Shared with loop()
+// under powerLock; gains and target mirror the saved values.
+PowerController powerController;
+portMUX_TYPE powerLock = portMUX_INITIALIZER_UNLOCKED;
+int32_t powerKp = 1024; // Q8.8
+int32_t powerKi = 64;
+int32_t powerKd = 0;
+uint32_t reportedSettling = 0; // last settling time announced by loop()
+
+OutputMode outputMode = OutputMode::Steady;
+uint8_t outputModeRun = 0;
 
 // Pin configuration
 const int LASER_PIN = 6; // GPIO 6 for laser control
 const int DEFAULT_ANALOG_PIN = A0;
 
-// PWM configuration for laser
+// PWM configuration for laser (defaults, runtime values are saved in preferences)
 const int PWM_FREQ = 1000;    // 1kHz PWM frequency
 const int PWM_RESOLUTION = 8; // 8-bit resolution (0-255)
 const int PWM_CHANNEL = 0;    // PWM channel 0
 
+// ESP32-S3 LEDC timers run from the 80MHz APB clock, so frequency * 2^bits
+// must not exceed it (e.g. 14-bit up to ~4.9kHz, 8-bit up to ~312kHz)
+const uint32_t LEDC_SOURCE_CLOCK_HZ = 80000000;
+const uint8_t PWM_MAX_RESOLUTION = 14;
+
+uint32_t pwmFrequency = PWM_FREQ;
+uint8_t pwmResolution = PWM_RESOLUTION;
+uint32_t pwmMaxDuty = (1u << PWM_RESOLUTION) - 1;
+uint32_t pwmDutyScale = 0; // duty = (setpoint * pwmDutyScale + 0x8000) >> 16
+
+// UART driver TX ring, big enough for a loop() pass at 2Mbaud; txQueue
+// holds everything beyond this. Only UART_TX_BACKLOG_US of wire time is
+// handed over at a time, so at any rate a response waits behind at most
+// that much output already given to the driver.
+const size_t UART_TX_BUFFER_SIZE = 4096;
+const uint32_t UART_TX_BACKLOG_US = 20000;
+// UART driver RX ring: loop() empties it every pass, at most LOOP_IDLE
+// apart (2000 bytes at 2Mbaud)
+const size_t UART_RX_BUFFER_SIZE = 4096;
+// loop() sleeps this long between passes unless the RX interrupt wakes it
+const TickType_t LOOP_IDLE = pdMS_TO_TICKS(10);
+TaskHandle_t loopTaskHandle = nullptr;
+
+// Rates SET_BAUD accepts, up to the CH340K's 2Mbaud. The RX interrupt moves
+// the FIFO into the driver's ring once rxFifoFull bytes are waiting or the
+// line has been idle for rxTimeout symbols (10 bits each). A command ends
+// on the timeout, so it stays at 2 symbols up to 460800 (174us at 115200)
+// and near 40us above, where fewer symbols would interrupt on every gap in
+// a burst. The FIFO threshold drops as the rate rises so the interrupt
+// still has about 0.5ms before the FIFO overflows.
+struct BaudSetting
+{
+    uint32_t rate;
+    uint8_t rxFifoFull; // bytes
+    uint8_t rxTimeout;  // symbols
+};
+const BaudSetting BAUD_SETTINGS[] = {
+    {115200, 112, 2}, {230400, 112, 2}, {460800, 96, 2}, {921600, 64, 4},
+    {1000000, 64, 4}, {1500000, 48, 6}, {2000000, 32, 8},
+};
+const uint32_t BAUD_DEFAULT = 115200;
+const unsigned long BAUD_CONFIRM_TIMEOUT = 1000; // ms at the new rate before reverting
+
+// SET_BAUD: the ACK goes out at the old rate (Draining), the UART finishes
+// what it holds (Flushing), then the new rate must be confirmed
+enum class BaudState : uint8_t
+{
+    Idle,
+    Draining,
+    Flushing,
+    Confirming
+};
+BaudState baudState = BaudState::Idle;
+uint32_t baudRate = BAUD_DEFAULT;
+uint32_t baudPrevious = BAUD_DEFAULT; // restored if the new rate is not confirmed
+uint32_t baudTarget = 0;
+unsigned long baudStateSince = 0; // millis() when the new rate was applied
+uint32_t baudSwitches = 0;
+uint32_t baudReverts = 0;
+uint32_t uartIdleAt = 0; // micros() when what the UART holds will have gone out
+
+// Serial as txQueue.pump() sees it: room for UART_TX_BACKLOG_US of output
+struct UartWriter
+{
+    int availableForWrite()
+    {
+        uint32_t now = micros();
+        uint32_t backlog = (int32_t)(uartIdleAt - now) > 0 ? uartIdleAt - now : 0;
+        if (backlog >= UART_TX_BACKLOG_US)
+        {
+            return 0;
+        }
+        int allowance = (int)((uint64_t)(UART_TX_BACKLOG_US - backlog) * baudRate / 10000000);
+        int room = Serial.availableForWrite();
+        return room < allowance ? room : allowance;
+    }
+
+    size_t write(const uint8_t *data, size_t length)
+    {
+        uint32_t now = micros();
+        uint32_t start = (int32_t)(uartIdleAt - now) > 0 ? uartIdleAt : now;
+        uartIdleAt = start + (uint32_t)((uint64_t)length * 10000000 / baudRate);
+        return Serial.write(data, length);
+    }
+
+    void flush() { Serial.flush(); }
+};
+UartWriter uartWriter;
+
+// Largest JSON message (status) is about 700 bytes, and up to 910 once
+// every counter has reached 10 digits
+const size_t JSON_MESSAGE_SIZE = 1024;
+static_assert(JSON_MESSAGE_SIZE <= FRAME_MAX_PAYLOAD, "JSON messages must fit in one FRAME_JSON frame");
+const size_t LINE_MESSAGE_SIZE = 160; // sendLinef() text
+
 // Version info
-const String FIRMWARE_VERSION = "5.1";
-const String BUILD_DATE = __DATE__;
-const String BUILD_TIME = __TIME__;
+const char *const FIRMWARE_VERSION = "5.1";
+const char *const BUILD_DATE = __DATE__;
+const char *const BUILD_TIME = __TIME__;
 
-// Preferences object
+// Preferences object; everything goes through the write-behind cache
 Preferences preferences;
-
-// Connection state tracking
-bool wasConnected = false;
+SettingsCache settings(preferences);
+
+// Binary protocol state (see BinaryProtocol.h)
+bool binaryMode = false;
+FrameDecoder frameDecoder;
+uint8_t txSequence = 0;
+unsigned long lastBinaryFrame = 0;
+const unsigned long BINARY_IDLE_TIMEOUT = 10000; // back to text without frames for 10s
+
+// Outcome of the command being run, for its ACK/NACK: handlers call
+// rejectCommand() when they refuse a valid value, and setAppliedValue()
+// when they apply something other than the argument
+DispatchResult commandResult = DispatchResult::Ok;
+int32_t commandApplied = 0;
+
+// List commands whose values make up one request (HELLO, HB_FIELD) collect
+// them here; finishCommand() then runs the request once
+const size_t COMMAND_FIELDS = 4;
+int32_t commandFields[COMMAND_FIELDS];
+size_t commandFieldCount = 0;
+void (*commandFinisher)() = nullptr;
+
+// Session state: opened by HELLO, answered once with WELCOME. Without a
+// session every output class is sent and nothing expires.
+const uint8_t PROTOCOL_VERSION = 1;
+const uint8_t SESSION_MODE_TEXT = 0;
+const uint8_t SESSION_MODE_BINARY = 1;
+const uint8_t SESSION_MODE_UNCHANGED = 0xFF;
+const uint8_t SUBSCRIBE_EVENTS = 1 << 0;
+const uint8_t SUBSCRIBE_HEARTBEAT = 1 << 1;
+const uint8_t SUBSCRIBE_LOG = 1 << 2;
+const uint8_t SUBSCRIBE_ALL = SUBSCRIBE_EVENTS | SUBSCRIBE_HEARTBEAT | SUBSCRIBE_LOG;
+const int32_t SESSION_DEFAULT_KEEPALIVE = 10000;
+const int32_t SESSION_MIN_KEEPALIVE = 1000;
+const int32_t SESSION_MAX_KEEPALIVE = 3600000;
+
+// WELCOME capability bits
+const uint32_t CAP_BINARY_FRAMES = 1u << 0;
+const uint32_t CAP_REQUEST_IDS = 1u << 1;
+const uint32_t CAP_WAVEFORM = 1u << 2;
+const uint32_t CAP_STREAM = 1u << 3;
+const uint32_t CAP_POWER_LOOP = 1u << 4;
+const uint32_t CAP_CALIBRATION = 1u << 5;
+const uint32_t CAP_ADC_CONTINUOUS = 1u << 6; // DMA sampler running, otherwise one-shot reads
+const uint32_t CAP_PROFILER = 1u << 7;
+const uint32_t CAP_TASK_STATS = 1u << 8; // PROFILE reports per-task CPU time
+const uint32_t CAP_TELEMETRY_STREAM = 1u << 9;
+const uint32_t CAP_HISTORY_PSRAM = 1u << 10; // full-length history, otherwise the short one
+const uint32_t CAP_SCHEDULE = 1u << 11;       // TIME_SYNC and scheduled commands
+const uint32_t CAP_BAUD = 1u << 12;           // SET_BAUD up to 2Mbaud
+
+bool sessionOpen = false;
+uint8_t sessionProtocol = 0;
+uint8_t sessionSubscriptions = SUBSCRIBE_ALL;
+uint32_t sessionKeepalive = 0; // ms without input before the session expires, 0 = never
+uint32_t sessionCount = 0;
+uint8_t requestedMode = SESSION_MODE_UNCHANGED;
 unsigned long lastSerialActivity = 0;
-const unsigned long CONNECTION_TIMEOUT = 3000; // 3 seconds
+
+// ==================== COMMAND TABLE ====================
+// Single source for dispatch and HELP output; commands are listed in help order
+const char *const GROUP_LASER = "Laser Control:";
+const char *const GROUP_READING = "Reading:";
+const char *const GROUP_SYSTEM = "System:";
+const char *const GROUP_HEARTBEAT = "Heartbeat Control:";
+const char *const GROUP_WAVEFORM = "Waveform:";
+const char *const GROUP_CALIBRATION = "Calibration:";
+const char *const GROUP_STREAMING = "Streaming:";
+const char *const GROUP_POWER = "Power Control:";
+const char *const GROUP_PROTOCOL = "Protocol:";
+
+constexpr CommandSpec COMMANDS[] = {
+    command(0x01, "LASER_ON", [](int32_t) { setLaserState(true); }, GROUP_LASER, "Turn on laser"),
+    command(0x02, "LASER_OFF", [](int32_t) { setLaserState(false); }, GROUP_LASER, "Turn off laser"),
+    command(0x03, "LASER_TOGGLE", [](int32_t) { setLaserState(!laserState); }, GROUP_LASER, "Toggle laser state"),
+    commandWithInt(0x04, "SET_LASER_PWM", "value", 0, 100, [](int32_t value) { setLaserBrightness(value); },
+                   GROUP_LASER, "Set laser brightness (0-100%) - SAVED"),
+    commandWithInt(0x05, "SET_LASER_BRIGHTNESS", "value", 0, 100, [](int32_t value) { setLaserBrightness(value); },
+                   GROUP_LASER, "Set laser brightness (0-100%) - SAVED"),
+    commandWithInt(0x07, "SET_LASER_PERMILLE", "value", 0, 1000,
+                   [](int32_t value) { setLaserSetpoint(((uint32_t)value * LASER_SETPOINT_MAX + 500) / 1000); },
+                   GROUP_LASER, "Set laser power in 0.1% steps (0-1000) - SAVED"),
+    commandWithInt(0x08, "SET_LASER_DUTY", "counts", 0, (1 << PWM_MAX_RESOLUTION) - 1, [](int32_t value) { setLaserDuty(value); },
+                   GROUP_LASER, "Set raw PWM duty (0 to 2^bits-1) - SAVED"),
+    commandWithInt(0x09, "SET_PWM_FREQ", "hz", 1, 40000000, [](int32_t value) { setPwmFrequency(value); },
+                   GROUP_LASER, "Set PWM frequency (freq * 2^bits <= 80MHz) - SAVED"),
+    commandWithInt(0x0A, "SET_PWM_RESOLUTION", "bits", 1, PWM_MAX_RESOLUTION, [](int32_t value) { setPwmResolution(value); },
+                   GROUP_LASER, "Set PWM resolution (1-14 bits) - SAVED"),
+    command(0x06, "LASER_STATUS", [](int32_t) { printLaserStatus(); }, GROUP_LASER, "Show laser status"),
+
+    commandWithInt(0x0B, "CAL_RUN", "profile", 1, CAL_PROFILES, [](int32_t value) { startCalibration(value); },
+                   GROUP_CALIBRATION, "Sweep duty against A0 and save as profile (laser on)"),
+    commandWithInt(0x0C, "CAL_PROFILE", "profile", 0, CAL_PROFILES,
+                   [](int32_t value) { if (selectCalibrationProfile(value)) { refreshCalibratedOutput(); } else { rejectCommand(); sendLine(TxClass::Response, "Profile not calibrated"); } },
+                   GROUP_CALIBRATION, "Select calibration profile (0 = linear, saved)"),
+    commandWithInt(0x0D, "CAL_READ", "profile", 1, CAL_PROFILES, [](int32_t value) { sendCalibration(value); },
+                   GROUP_CALIBRATION, "Calibration curve (JSON)"),
+    commandWithInt(0x0E, "CAL_WRITE", "profile", 1, CAL_PROFILES, [](int32_t value) { beginCalibrationUpload(value); },
+                   GROUP_CALIBRATION, "Start uploading a curve (17 readings via CAL_DATA)"),
+    commandWithIntList(0x0F, "CAL_DATA", "reading", 0, PowerController::ADC_MAX, [](int32_t value) { addCalibrationPoint(value); },
+                       GROUP_CALIBRATION, "A0 readings at setpoints 0, 4096, ... 65535"),
+
+    command(0x10, "ANALOG_READ", [](int32_t) { printAnalogReading(); }, GROUP_READING, "Read analog value from A0"),
+    command(0x11, "ADC_START", [](int32_t) { if (!adcSampler.start(DEFAULT_ANALOG_PIN)) { rejectCommand(); sendLine(TxClass::Response, "ADC sampler not started"); } },
+            GROUP_READING, "Start continuous A0 sampling"),
+    command(0x12, "ADC_STOP", [](int32_t) { stopAdcSampler(); }, GROUP_READING, "Stop sampling, back to one-shot reads (ends the power loop)"),
+    commandWithInt(0x13, "ADC_RATE", "hz", AdcSampler::MIN_SAMPLE_RATE, AdcSampler::MAX_SAMPLE_RATE, [](int32_t value) { setAdcSampleRate(value); },
+                   GROUP_READING, "Conversion rate (1000-80000)"),
+    commandWithInt(0x14, "ADC_OVERSAMPLE", "count", 1, AdcSampler::MAX_OVERSAMPLE, [](int32_t value) { setAdcOversample(value); },
+                   GROUP_READING, "Conversions averaged per reading (1-256)"),
+    command(0x15, "ADC_STATUS", [](int32_t) { sendAdcStatus(); }, GROUP_READING, "Sampler rate, counters and sample loss (JSON)"),
+
+    command(0x20, "STATUS", [](int32_t) { sendStatusUpdate(); }, GROUP_SYSTEM, "Get device status (JSON)"),
+    command(0x21, "SYSTEM_INFO", [](int32_t) { sendSystemInfo(); }, GROUP_SYSTEM, "Show detailed system info"),
+    command(0x22, "VERSION", [](int32_t) { printVersion(); }, GROUP_SYSTEM, "Show firmware version"),
+    command(0x23, "GET_INITIAL_STATE", [](int32_t) { sendInitialDeviceState(); }, GROUP_SYSTEM, "Get current device state (JSON)"),
+    command(0x24, "DIAGNOSTICS", [](int32_t) { runDiagnostics(); }, GROUP_SYSTEM, "Run system diagnostics"),
+    command(0x25, "MEMORY_TEST", [](int32_t) { memoryTest(); }, GROUP_SYSTEM, "Test memory allocation"),
+    command(0x26, "RESTART", [](int32_t) { restartDevice(); }, GROUP_SYSTEM, "Restart the ESP32-S3"),
+    command(0x27, "REBOOT", [](int32_t) { restartDevice(); }, nullptr, nullptr),
+    command(0x28, "HELP", [](int32_t) { printHelp(); }, GROUP_SYSTEM, "Show this command list"),
+    command(0x29, "ALLOC_STATS", [](int32_t) { sendAllocationStats(); }, GROUP_SYSTEM, "Heap allocation counters (JSON)"),
+    command(0x2A, "LATENCY_STATS", [](int32_t) { sendLatencyStats(); }, GROUP_SYSTEM, "Command latency histograms (JSON), then reset"),
+    command(0x2B, "PROFILE", [](int32_t) { sendProfile(); }, GROUP_SYSTEM, "Loop stage timings and CPU load (JSON), then reset"),
+    commandWithInt(0x2C, "PROFILE_STREAM", "ms", 0, 60000,
+                   [](int32_t value) { setProfileStreamInterval(value); },
+                   GROUP_SYSTEM, "Profile frame interval in binary mode (0 = off, min 100)"),
+
+    command(0x30, "HEARTBEAT_ON", [](int32_t) { heartbeatEnabled = true; }, GROUP_HEARTBEAT, "Enable periodic heartbeat"),
+    command(0x31, "HEARTBEAT_OFF", [](int32_t) { heartbeatEnabled = false; }, GROUP_HEARTBEAT, "Disable heartbeat"),
+    commandWithInt(0x32, "HEARTBEAT_INTERVAL", "ms", 1000, 60000, [](int32_t value) { heartbeatInterval = value; },
+                   GROUP_HEARTBEAT, "Set heartbeat (keyframe) interval (1000-60000)"),
+    commandWithInt(0x33, "HB_FIELDS", "mask", 0, (1 << TELEMETRY_FIELDS) - 1,
+                   [](int32_t value) { telemetry.subscribe(value); },
+                   GROUP_HEARTBEAT, "Fields to report, one bit per HB_CONFIG id"),
+    commandWithIntList(0x34, "HB_FIELD", "field", 0, 3600000,
+                       [](int32_t value) { collectField(value, configureTelemetryField); },
+                       GROUP_HEARTBEAT, "Change reporting for one field: id,min_ms,max_ms,deadband"),
+    command(0x35, "HB_CONFIG", [](int32_t) { sendTelemetryConfig(); }, GROUP_HEARTBEAT, "Field ids, subscriptions and intervals (JSON)"),
+    commandWithInt(0x36, "TELEMETRY_STREAM", "hz", 0, TELEMETRY_MAX_RATE, [](int32_t value) { setTelemetryStreamRate(value); },
+                   GROUP_HEARTBEAT, "Binary telemetry records per second in binary mode (0 = off)"),
+    command(0x37, "TELEMETRY_LAYOUT", [](int32_t) { sendTelemetryLayout(); }, GROUP_HEARTBEAT, "Telemetry record layout and loss counters (JSON)"),
+    commandWithInt(0x38, "HISTORY_DUMP", "tier", 0, HISTORY_TIERS - 1, [](int32_t value) { startHistoryDump(value); },
+                   GROUP_HEARTBEAT, "Send a history tier as frames (0 = 10ms, 1 = 1s, 2 = 1min; binary mode)"),
+    command(0x39, "HISTORY_STATUS", [](int32_t) { sendHistoryStatus(); }, GROUP_HEARTBEAT, "History tiers, sizes and channels (JSON)"),
+
+    commandWithInt(0x40, "WAVE_SHAPE", "n", 0, 4, [](int32_t value) { setWaveShape(value); },
+                   GROUP_WAVEFORM, "0=sine 1=square 2=triangle 3=sawtooth 4=uploaded points"),
+    commandWithInt(0x41, "WAVE_FREQ", "millihz", 1, 20000000, [](int32_t value) { setWaveFrequency(value); },
+                   GROUP_WAVEFORM, "Waveform frequency in mHz (up to half the sample rate)"),
+    commandWithInt(0x42, "WAVE_AMPLITUDE", "permille", 0, 1000,
+                   [](int32_t value) { waveAmplitude = value; updateWaveform(); },
+                   GROUP_WAVEFORM, "Peak deviation from the offset (0-1000)"),
+    commandWithInt(0x43, "WAVE_OFFSET", "permille", 0, 1000,
+                   [](int32_t value) { waveOffset = value; updateWaveform(); },
+                   GROUP_WAVEFORM, "Centre power level (0-1000)"),
+    commandWithInt(0x44, "WAVE_CYCLES", "count", 0, 100000000, [](int32_t value) { waveform.setCycles(value); },
+                   GROUP_WAVEFORM, "Stop after this many cycles (0 = continuous)"),
+    commandWithInt(0x45, "WAVE_RATE", "hz", 100, WaveformEngine::MAX_SAMPLE_RATE, [](int32_t value) { setWaveSampleRate(value); },
+                   GROUP_WAVEFORM, "Timer update rate (100-40000)"),
+    command(0x46, "WAVE_POINTS_CLEAR", [](int32_t) { wavePointCount = 0; }, GROUP_WAVEFORM, "Clear uploaded points"),
+    commandWithIntList(0x47, "WAVE_POINTS", "permille", 0, 1000,
+                       [](int32_t value) { if (wavePointCount < WAVE_TABLE_SIZE) wavePoints[wavePointCount++] = value; },
+                       GROUP_WAVEFORM, "Append points (max 256), apply with WAVE_SHAPE:4"),
+    command(0x48, "WAVE_START", [](int32_t) { startWaveform(); }, GROUP_WAVEFORM, "Start playback (turns laser on)"),
+    command(0x49, "WAVE_STOP", [](int32_t) { stopWaveform(); }, GROUP_WAVEFORM, "Stop playback, back to steady brightness"),
+    command(0x4A, "WAVE_STATUS", [](int32_t) { sendWaveformStatus(); }, GROUP_WAVEFORM, "Waveform settings and timer jitter (JSON)"),
+
+    commandWithInt(0x50, "STREAM_RATE", "hz", 10, SampleStream::MAX_SAMPLE_RATE, [](int32_t value) { setStreamSampleRate(value); },
+                   GROUP_STREAMING, "Playout rate (10-20000)"),
+    commandWithInt(0x51, "STREAM_PREFILL", "samples", 0, SampleStream::CAPACITY, [](int32_t value) { sampleStream.setPrefill(value); },
+                   GROUP_STREAMING, "Samples buffered before playout starts (0-1023)"),
+    command(0x52, "STREAM_START", [](int32_t) { startStream(); }, GROUP_STREAMING, "Enter streaming mode (turns laser on, not saved)"),
+    commandWithIntList(0x53, "STREAM_DATA", "permille", 0, 1000, [](int32_t value) { pushStreamSample(value); },
+                       GROUP_STREAMING, "Queue samples for playout"),
+    command(0x54, "STREAM_STOP", [](int32_t) { if (outputMode == OutputMode::Stream) { outputMode = OutputMode::Steady; postLaserOutput(); } },
+            GROUP_STREAMING, "Leave streaming mode, back to steady brightness"),
+    command(0x55, "STREAM_STATUS", [](int32_t) { sendStreamStatus(TxClass::Response); }, GROUP_STREAMING, "Buffer fill, underruns and overruns (JSON)"),
+
+    commandWithInt(0x58, "POWER_TARGET", "adc", 0, PowerController::ADC_MAX, [](int32_t value) { setPowerTarget(value); },
+                   GROUP_POWER, "A0 reading to hold (0-4095, saved)"),
+    commandWithInt(0x59, "POWER_KP", "q8", 0, PowerController::GAIN_MAX, [](int32_t value) { setPowerGain(&powerKp, "pc_kp", value); },
+                   GROUP_POWER, "Proportional gain, 256 = 1.0 (saved)"),
+    commandWithInt(0x5A, "POWER_KI", "q8", 0, PowerController::GAIN_MAX, [](int32_t value) { setPowerGain(&powerKi, "pc_ki", value); },
+                   GROUP_POWER, "Integral gain per ms, 256 = 1.0 (saved)"),
+    commandWithInt(0x5B, "POWER_KD", "q8", 0, PowerController::GAIN_MAX, [](int32_t value) { setPowerGain(&powerKd, "pc_kd", value); },
+                   GROUP_POWER, "Derivative gain per ms, 256 = 1.0 (saved)"),
+    command(0x5C, "POWER_START", [](int32_t) { startPowerControl(); }, GROUP_POWER, "Regulate A0 at the target (turns laser on, needs ADC_START)"),
+    command(0x5D, "POWER_STOP", [](int32_t) { stopPowerControl(); }, GROUP_POWER, "Back to steady brightness"),
+    command(0x5E, "POWER_STATUS", [](int32_t) { sendPowerStatus(); }, GROUP_POWER, "Target, error, gains and settling (JSON)"),
+
+    command(0x70, "BINARY_MODE", [](int32_t) { enterBinaryMode(); }, GROUP_PROTOCOL, "Switch to COBS/CRC framed binary protocol"),
+    command(0x71, "TEXT_MODE", [](int32_t) { exitBinaryMode(); }, GROUP_PROTOCOL, "Switch back to the text protocol"),
+    command(0x72, "PING", [](int32_t) { sendLine(TxClass::Response, "PONG"); }, GROUP_PROTOCOL, "Check the link (keeps binary mode alive)"),
+    commandWithIntList(0x73, "HELLO", "field", 0, SESSION_MAX_KEEPALIVE, [](int32_t value) { collectField(value, openSession); },
+                       GROUP_PROTOCOL, "Open a session: version[,mode,subscriptions,keepalive_ms]"),
+    command(0x74, "BYE", [](int32_t) { closeSession("closed"); }, GROUP_PROTOCOL, "End the session, back to sending everything"),
+    command(0x75, "TIME_SYNC", [](int32_t) { sendTimeSync(); }, GROUP_PROTOCOL, "Device receive and transmit times (us) for clock sync"),
+    // Opcode of the binary SCHEDULE frame; text uses the @<time_us> prefix
+    command(OPCODE_SCHEDULE, "SCHEDULE", [](int32_t) { rejectCommand(); }, nullptr, nullptr),
+    command(0x77, "SCHEDULE_STATUS", [](int32_t) { sendScheduleStatus(); }, GROUP_PROTOCOL, "Scheduled commands and timing error (JSON)"),
+    command(0x78, "SCHEDULE_CLEAR", [](int32_t) { clearSchedule("cleared", false); }, GROUP_PROTOCOL, "Drop scheduled commands that have not run yet"),
+    commandWithInt(0x79, "SET_BAUD", "rate", 115200, 2000000, [](int32_t value) { requestBaudRate(value); },
+                   GROUP_PROTOCOL, "Switch the serial rate (115200-2000000), then confirm at the new rate"),
+    commandWithInt(0x7A, "BAUD_CONFIRM", "rate", 115200, 2000000, [](int32_t value) { confirmBaudRate(value); },
+                   GROUP_PROTOCOL, "Keep the new serial rate (sent at that rate)"),
+};
+
+constexpr CommandRegistry<sizeof(COMMANDS) / sizeof(COMMANDS[0])> commandRegistry(COMMANDS);
 
 // ==================== SETUP FUNCTION ====================
 void setup()
 {
-    Serial.begin(115200);
+    // Driver-side TX ring so the TX-empty interrupt drains what pump() hands over
+    Serial.setTxBufferSize(UART_TX_BUFFER_SIZE);
+    Serial.setRxBufferSize(UART_RX_BUFFER_SIZE);
+    Serial.begin(BAUD_DEFAULT);
+    applyBaudRate(BAUD_DEFAULT);
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    Serial.onReceive([]() { xTaskNotifyGive(loopTaskHandle); });
 
     unsigned long startTime = millis();
     while (!Serial && (millis() - startTime < 3000))
@@ -68,434 +772,2883 @@ void setup()
     }
 
     bootTime = millis();
+    cyclesPerMicro = ESP.getCpuFreqMHz();
+    resetProfileWindow();
+    telemetry.begin(TELEMETRY_DEFAULTS, TELEMETRY_FIELDS, TELEMETRY_DEFAULT_FIELDS);
+    allocateHistory();
 
     // Initialize preferences
     preferences.begin("laser-ctrl", false); // false = read/write mode
 
-    // Load saved brightness value
+    // Load saved PWM configuration and brightness value
+    loadPwmConfigFromPreferences();
+    loadCalibrationFromPreferences();
     loadBrightnessFromPreferences();
+    loadPowerControlFromPreferences();
 
     // Initialize laser pin with PWM
     pinMode(LASER_PIN, OUTPUT);
 
     // Configure PWM for laser control
-    ledcSetup(PWM_CHANNEL, PWM_FREQ, PWM_RESOLUTION);
+    ledcSetup(PWM_CHANNEL, pwmFrequency, pwmResolution);
     ledcAttachPin(LASER_PIN, PWM_CHANNEL);
 
     // Initialize laser to OFF state but with saved brightness
     setLaserState(false);
 
+    xTaskCreatePinnedToCore(laserTask, "laser", LASER_TASK_STACK_SIZE, nullptr,
+                            LASER_TASK_PRIORITY, &laserTaskHandle, LASER_TASK_CORE);
+
     pinMode(DEFAULT_ANALOG_PIN, INPUT);
+    if (!adcSampler.start(DEFAULT_ANALOG_PIN))
+    {
+        sendLine(TxClass::Event, "ADC sampler failed to start, using one-shot reads");
+    }
 
     delay(1000);
 
-    Serial.println("ESP32-S3 Laser Controller v" + FIRMWARE_VERSION + " Ready");
-    Serial.println("Loaded brightness: " + String(laserBrightness) + "%");
+    sendLinef(TxClass::Event, "ESP32-S3 Laser Controller v%s Ready", FIRMWARE_VERSION);
+    sendLinef(TxClass::Event, "Loaded brightness: %d%%", laserBrightness);
 
     // Send initial device state after a short delay
     delay(500);
     sendInitialDeviceState();
+
+    setupAllocations = allocationStats().allocations;
 }
 
 // ==================== MAIN LOOP ====================
 void loop()
 {
-    bool currentlyConnected = false;
+    uint32_t loopStart = micros();
+    if (loopStarted)
+    {
+        profileScopes[PROFILE_PERIOD].record(loopStart - lastLoopStart);
+    }
+    lastLoopStart = loopStart;
+    loopStarted = true;
+    uint32_t mark = loopStart;
+
+    if (laserOutputPending)
+    {
+        postLaserOutput();
+    }
 
-    if (Serial.available())
+    if (outputMode == OutputMode::Waveform && waveform.finished())
     {
-        String command = Serial.readStringUntil('\n');
-        command.trim();
+        outputMode = OutputMode::Steady;
+        sendLinef(TxClass::Event, "Waveform finished after %lu cycles", (unsigned long)waveform.completedCycles());
+        postLaserOutput();
+    }
 
-        currentlyConnected = true;
-        lastSerialActivity = millis();
+    serviceCalibration();
+
+    if (outputMode == OutputMode::PowerLoop)
+    {
+        portENTER_CRITICAL(&powerLock);
+        uint32_t settling = powerController.telemetry().settlingTicks;
+        portEXIT_CRITICAL(&powerLock);
+        if (settling != reportedSettling)
+        {
+            reportedSettling = settling;
+            if (settling != 0)
+            {
+                sendLinef(TxClass::Event, "Power settled in %lums", (unsigned long)settling);
+            }
+        }
+    }
+
+    if (outputMode == OutputMode::Stream)
+    {
+        if (sampleStream.starved())
+        {
+            outputMode = OutputMode::Steady;
+            sendLine(TxClass::Event, "Stream starved - back to steady brightness");
+            postLaserOutput();
+        }
+        if (millis() - lastStreamReport >= STREAM_REPORT_INTERVAL)
+        {
+            sendStreamStatus(TxClass::Event);
+            lastStreamReport = millis();
+        }
+    }
 
-        if (command.length() > 0)
+    mark = profileMark(PROFILE_OUTPUT, mark);
+
+    // Non-blocking: take only what has already arrived, then dispatch
+    // every complete line or frame (several may have come in together)
+    uint32_t pollCycles = ESP.getCycleCount();
+    uint64_t pollTime = (uint64_t)esp_timer_get_time();
+    size_t received = binaryMode ? pollBinaryFrames() : serialLines.poll(Serial);
+    if (received > 0)
+    {
+        lastSerialActivity = millis();
+        if (!rxLinePending)
         {
-            handleCommand(command);
+            rxStartCycles = pollCycles;
+            rxStartTime = pollTime;
         }
     }
 
-    // Check if we have recent serial activity (indicates connection)
-    if (millis() - lastSerialActivity < CONNECTION_TIMEOUT)
+    // Inside a session its keepalive decides instead
+    if (binaryMode && !sessionOpen && millis() - lastBinaryFrame > BINARY_IDLE_TIMEOUT)
+    {
+        binaryMode = false;
+        restoreDefaultBaudRate();
+        sendLine(TxClass::Event, "Binary mode idle - back to text protocol");
+    }
+    mark = profileMark(PROFILE_SERIAL, mark);
+
+    char *line;
+    size_t lineLength;
+    bool handledLine = false;
+    commandRxTime = rxStartTime;
+    while (serialLines.nextLine(line, lineLength))
+    {
+        handleCommand(line, lineLength, rxStartCycles, ESP.getCycleCount());
+        handledLine = true;
+    }
+    // A partial line left behind arrived with the latest poll
+    rxLinePending = serialLines.pending() > 0;
+    if (rxLinePending && handledLine)
+    {
+        rxStartCycles = pollCycles;
+        rxStartTime = pollTime;
+    }
+
+    recordAppliedTraces();
+    serviceSchedule();
+    mark = profileMark(PROFILE_COMMANDS, mark);
+
+    if (sessionOpen && sessionKeepalive != 0 && millis() - lastSerialActivity > sessionKeepalive)
+    {
+        binaryMode = false; // the host is gone; the next one starts in text
+        restoreDefaultBaudRate();
+        closeSession("expired");
+    }
+    mark = profileMark(PROFILE_SESSION, mark);
+
+    if (heartbeatEnabled)
+    {
+        publishTelemetry();
+    }
+
+    // Frames only: a binary frame would garble the text protocol
+    if (profileStreamInterval != 0 && binaryMode && millis() - lastProfileFrame >= profileStreamInterval)
     {
-        currentlyConnected = true;
+        sendProfileFrame();
+        lastProfileFrame = millis();
     }
+    sendTelemetryRecords();
+    recordHistory();
+    serviceHistoryDump();
+    servicePagedReply();
+    mark = profileMark(PROFILE_TELEMETRY, mark);
 
-    // Detect new connection (transition from not connected to connected)
-    if (currentlyConnected && !wasConnected)
+    if (settings.poll(millis()))
     {
-        Serial.println("Connection detected - sending device state");
-        delay(100); // Small delay to ensure UI is ready
-        sendInitialDeviceState();
+        sendLinef(TxClass::Log, "Settings saved in %luus", (unsigned long)settings.stats().lastCommitUs);
     }
+    mark = profileMark(PROFILE_SETTINGS, mark);
 
-    wasConnected = currentlyConnected;
+    // While SET_BAUD switches over, only its reply goes out, then nothing
+    if (baudState != BaudState::Flushing)
+    {
+        txQueue.pump(uartWriter, baudState == BaudState::Draining ? TxClass::Response : TxClass::Log);
+    }
+    serviceBaudRate();
+    mark = profileMark(PROFILE_TRANSMIT, mark);
 
-    if (heartbeatEnabled && (millis() - lastHeartbeat > heartbeatInterval))
+    profileScopes[PROFILE_LOOP].record(mark - loopStart);
+    if (mark - loopStart > historyLoopMaxUs)
     {
-        sendHeartbeat();
-        lastHeartbeat = millis();
+        historyLoopMaxUs = mark - loopStart;
     }
 
-    delay(10);
+    // Input is handled as soon as the RX interrupt hands it over
+    ulTaskNotifyTake(pdTRUE, LOOP_IDLE);
 }
 
 // ==================== NEW FUNCTION: SEND INITIAL DEVICE STATE ====================
 void sendInitialDeviceState()
 {
     // Send current device state as JSON for easy parsing
-    Serial.println("{\"type\":\"initial_state\",\"laser_state\":" +
-                   String(laserState ? "true" : "false") + ",\"laser_brightness\":" +
-                   String(laserBrightness) + ",\"version\":\"" +
-                   FIRMWARE_VERSION + "\",\"uptime_ms\":" +
-                   String(millis() - bootTime) + ",\"free_heap_bytes\":" +
-                   String(ESP.getFreeHeap()) + "}");
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "initial_state")
+        .boolField("laser_state", laserState)
+        .intField("laser_brightness", laserBrightness)
+        .stringField("version", FIRMWARE_VERSION)
+        .uintField("uptime_ms", millis() - bootTime)
+        .uintField("free_heap_bytes", ESP.getFreeHeap())
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Event, json);
 
     // Also send a human-readable message
-    Serial.println("Device initialized - Laser: " + String(laserState ? "ON" : "OFF") +
-                   ", Brightness: " + String(laserBrightness) + "%");
+    sendLinef(TxClass::Event, "Device initialized - Laser: %s, Brightness: %d%%",
+              laserState ? "ON" : "OFF", laserBrightness);
 }
 
 // ==================== COMMAND HANDLER ====================
-void handleCommand(String command)
+// "#<id> NAME[:arg]" is answered with an ACK or NACK line carrying the id,
+// so a host can keep several commands in flight. Without an id, unknown
+// commands and invalid values are ignored. "@<time_us> " after the id
+// queues the command for that device time instead of running it now.
+void handleCommand(const char *command, size_t length, uint32_t rxCycles, uint32_t readyCycles)
 {
-    // Laser control commands
-    if (command == "LASER_ON")
+    int32_t requestId = takeRequestId(command, length);
+    uint64_t scheduleAt = 0;
+    bool scheduled = takeScheduleTime(command, length, scheduleAt);
+    const CommandSpec *spec = commandRegistry.match(command, length);
+    if (spec == nullptr)
+    {
+        sendCommandReply(requestId, DispatchResult::UnknownCommand);
+        return;
+    }
+    if (scheduled)
     {
-        setLaserState(true);
+        beginCommand();
+        sendCommandReply(requestId, scheduleTextCommand(*spec, command, length, scheduleAt, requestId));
+        return;
     }
-    else if (command == "LASER_OFF")
+
+    beginCommand();
+    uint32_t start = traceBegin(spec->opcode, rxCycles, readyCycles);
+    DispatchResult result = finishCommand(commandRegistry.execute(*spec, command, length, &commandApplied));
+    traceEnd(start);
+    sendCommandReply(requestId, result);
+    applyRequestedMode();
+}
+
+// Strips a leading "#<id> " and returns the id, or -1 without one
+int32_t takeRequestId(const char *&command, size_t &length)
+{
+    if (length == 0 || command[0] != '#')
     {
-        setLaserState(false);
+        return -1;
     }
-    else if (command == "LASER_TOGGLE")
+    const char *space = static_cast<const char *>(memchr(command, ' ', length));
+    int32_t id;
+    if (space == nullptr || !parseInt32(command + 1, space - command - 1, id) || id < 0)
     {
-        setLaserState(!laserState);
+        return -1;
     }
+    length -= space + 1 - command;
+    command = space + 1;
+    return id;
+}
 
-    // Laser brightness control
-    else if (command.startsWith("SET_LASER_PWM:"))
+// Strips a leading "@<time_us> "; a malformed time leaves `at` at 0
+bool takeScheduleTime(const char *&command, size_t &length, uint64_t &at)
+{
+    if (length == 0 || command[0] != '@')
     {
-        int brightness = command.substring(14).toInt();
-        if (brightness >= 0 && brightness <= 100)
-        {
-            setLaserBrightness(brightness);
-        }
+        return false;
+    }
+    const char *space = static_cast<const char *>(memchr(command, ' ', length));
+    if (space == nullptr)
+    {
+        return false;
     }
-    else if (command.startsWith("SET_LASER_BRIGHTNESS:"))
+    at = 0;
+    for (const char *c = command + 1; c < space; c++)
     {
-        int brightness = command.substring(21).toInt();
-        if (brightness >= 0 && brightness <= 100)
+        if (*c < '0' || *c > '9' || at > (UINT64_MAX - 9) / 10)
         {
-            setLaserBrightness(brightness);
+            at = 0;
+            break;
         }
+        at = at * 10 + (*c - '0');
     }
+    length -= space + 1 - command;
+    command = space + 1;
+    return true;
+}
 
-    // System status commands
-    else if (command == "STATUS")
+// ACK|NACK <id> <result> <applied value> <device micros>
+void sendCommandReply(int32_t requestId, DispatchResult result)
+{
+    if (requestId < 0)
     {
-        sendStatusUpdate();
+        return;
     }
-    else if (command == "SYSTEM_INFO")
+    bool ok = result == DispatchResult::Ok;
+    sendLinef(TxClass::Response, "%s %ld %u %ld %lu", ok ? "ACK" : "NACK", (long)requestId,
+              (unsigned)result, ok ? (long)commandApplied : 0L, (unsigned long)micros());
+}
+
+void rejectCommand()
+{
+    commandResult = DispatchResult::Rejected;
+}
+
+void setAppliedValue(int32_t value)
+{
+    commandApplied = value;
+}
+
+void beginCommand()
+{
+    commandResult = DispatchResult::Ok;
+    commandApplied = 0;
+    commandFieldCount = 0;
+    commandFinisher = nullptr;
+}
+
+// Runs what a list command collected, then folds in any rejection
+DispatchResult finishCommand(DispatchResult result)
+{
+    if (result == DispatchResult::Ok && commandFinisher != nullptr)
     {
-        sendSystemInfo();
+        commandFinisher();
     }
-    else if (command == "VERSION")
+    return result == DispatchResult::Ok ? commandResult : result;
+}
+
+void collectField(int32_t value, void (*finisher)())
+{
+    commandFinisher = finisher;
+    if (commandFieldCount == COMMAND_FIELDS)
     {
-        Serial.println("Firmware Version: " + FIRMWARE_VERSION);
-        Serial.println("Build Date: " + String(BUILD_DATE) + " " + String(BUILD_TIME));
-        Serial.println("Hardware: ESP32-S3 + CH340K");
-        Serial.println("Laser Pin: GPIO " + String(LASER_PIN));
+        rejectCommand();
+        return;
     }
+    commandFields[commandFieldCount++] = value;
+}
+
+void printVersion()
+{
+    sendLinef(TxClass::Response, "Firmware Version: %s", FIRMWARE_VERSION);
+    sendLinef(TxClass::Response, "Build Date: %s %s", BUILD_DATE, BUILD_TIME);
+    sendLine(TxClass::Response, "Hardware: ESP32-S3 + CH340K");
+    sendLinef(TxClass::Response, "Laser Pin: GPIO %d", LASER_PIN);
+}
+
+void printAnalogReading()
+{
+    int analogValue = readAnalogA0();
+    int32_t centivolts = getCentivoltsFromAnalog(analogValue);
+    sendLinef(TxClass::Response, "Analog A0: %d (%ld.%02ldV)", analogValue, (long)(centivolts / 100), (long)(centivolts % 100));
+}
+
+void printLaserStatus()
+{
+    sendLinef(TxClass::Response, "Laser State: %s", laserState ? "ON" : "OFF");
+    sendLinef(TxClass::Response, "Laser Brightness: %d%%", laserBrightness);
+    sendLinef(TxClass::Response, "PWM Value: %lu/%lu", (unsigned long)laserDuty, (unsigned long)pwmMaxDuty);
+    sendLinef(TxClass::Response, "PWM Config: %luHz, %u-bit", (unsigned long)pwmFrequency, pwmResolution);
+}
+
+void restartDevice()
+{
+    setLaserState(false); // Safety: turn off laser before restart
+    settings.flush();
+    txQueue.drain(Serial);
+    delay(1000);
+    ESP.restart();
+}
 
-    // Analog reading
-    else if (command == "ANALOG_READ")
+// ==================== LATENCY TRACING ====================
+// Stamps for one command: rx (poll that read its first byte), ready (line
+// or frame complete), start/end of its handler, and the laser task tick
+// that applied any output it posted.
+uint32_t traceBegin(uint8_t opcode, uint32_t rxCycles, uint32_t readyCycles)
+{
+    uint8_t slot = latency.slotFor(opcode);
+    uint32_t start = ESP.getCycleCount();
+    latency.record(slot, LatencyStage::Receive, readyCycles - rxCycles);
+    latency.record(slot, LatencyStage::Queue, start - readyCycles);
+    traceSlot = slot;
+    traceRxCycles = rxCycles;
+    return start;
+}
+
+void traceEnd(uint32_t startCycles)
+{
+    latency.record(traceSlot, LatencyStage::Handler, ESP.getCycleCount() - startCycles);
+    traceSlot = NO_TRACE;
+}
+
+void recordAppliedTraces()
+{
+    LatencyApply applied;
+    while (latencyApplyQueue.pop(applied))
     {
-        int analogValue = analogRead(DEFAULT_ANALOG_PIN);
-        float voltage = getVoltageFromAnalog(analogValue);
-        Serial.println("Analog A0: " + String(analogValue) + " (" + String(voltage, 2) + "V)");
+        // Skip traces that straddle a LATENCY_STATS reset
+        if (applied.slot >= latency.slotsUsed())
+        {
+            continue;
+        }
+        uint32_t applyCycles = applied.applyMicros * cyclesPerMicro;
+        latency.record(applied.slot, LatencyStage::Apply, applyCycles);
+        latency.record(applied.slot, LatencyStage::EndToEnd, applied.traceCycles + applyCycles);
     }
+}
 
-    // Laser status query
-    else if (command == "LASER_STATUS")
+// One line per command and stage that has samples; histogram entry b
+// counts latencies below 2^(b + bucket_shift) cycles (and at or above the
+// previous entry's bound). Trailing empty buckets are left out. The
+// window is handed to latencyReport and paged out from there, so recording
+// starts over at once and nothing is cleared before it has been sent.
+void sendLatencyStats()
+{
+    if (startPagedReply(sendLatencyLine))
     {
-        Serial.println("Laser State: " + String(laserState ? "ON" : "OFF"));
-        Serial.println("Laser Brightness: " + String(laserBrightness) + "%");
-        Serial.println("PWM Value: " + String(laserPwmValue) + "/255");
+        latencyReport = latency;
+        latency.reset();
     }
+}
 
-    // Request initial state (useful for manual refresh)
-    else if (command == "GET_INITIAL_STATE")
+// Line 0 is the header; line 1 + slot * LATENCY_STAGES + stage is one histogram
+PageLine sendLatencyLine(size_t line)
+{
+    static const char *const STAGE_NAMES[LATENCY_STAGES] = {"receive", "queue", "handler", "apply", "end_to_end"};
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    if (line == 0)
     {
-        sendInitialDeviceState();
+        json.beginObject()
+            .stringField("type", "latency_info")
+            .uintField("cpu_mhz", cyclesPerMicro)
+            .uintField("bucket_shift", LATENCY_MIN_SHIFT)
+            .uintField("buckets", LATENCY_BUCKETS)
+            .uintField("commands", latencyReport.slotsUsed())
+            .endObject()
+            .endLine();
+        return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
     }
 
-    // Heartbeat control
-    else if (command == "HEARTBEAT_ON")
+    size_t slot = (line - 1) / LATENCY_STAGES;
+    size_t stage = (line - 1) % LATENCY_STAGES;
+    if (slot >= latencyReport.slotsUsed())
     {
-        heartbeatEnabled = true;
+        return PageLine::End;
     }
-    else if (command == "HEARTBEAT_OFF")
+    LatencyStage id = (LatencyStage)stage;
+    const uint16_t *counts = latencyReport.counts(slot, id);
+    size_t used = LATENCY_BUCKETS;
+    while (used > 0 && counts[used - 1] == 0)
     {
-        heartbeatEnabled = false;
+        used--;
     }
-    else if (command.startsWith("HEARTBEAT_INTERVAL:"))
+    if (used == 0)
     {
-        int interval = command.substring(19).toInt();
-        if (interval >= 1000 && interval <= 60000)
-        {
-            heartbeatInterval = interval;
-        }
+        return PageLine::Next;
     }
 
-    // Diagnostic commands
-    else if (command == "DIAGNOSTICS")
+    const CommandSpec *spec = commandRegistry.findOpcode(latencyReport.opcode(slot));
+    json.beginObject()
+        .stringField("type", "latency")
+        .stringField("command", spec ? spec->name : "other")
+        .stringField("stage", STAGE_NAMES[stage])
+        .uintField("samples", latencyReport.samples(slot, id))
+        .uintField("max_cycles", latencyReport.maxCycles(slot, id))
+        .uintArrayField("log2", counts, used)
+        .endObject()
+        .endLine();
+    return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
+}
+
+// ==================== PROFILER ====================
+// Closes the scope that started at startMicros; returns the time it ended
+// so consecutive stages can chain.
+uint32_t profileMark(uint8_t scope, uint32_t startMicros)
+{
+    uint32_t now = micros();
+    profileScopes[scope].record(now - startMicros);
+    return now;
+}
+
+void resetProfileWindow()
+{
+    for (size_t i = 0; i < PROFILE_SCOPES; i++)
     {
-        runDiagnostics();
+        profileScopes[i].reset();
     }
-    else if (command == "MEMORY_TEST")
+    profileWindowStart = micros();
+}
+
+uint16_t loopBusyPermille(const ProfileScope &loop, uint32_t windowUs)
+{
+    if (windowUs == 0)
     {
-        memoryTest();
+        return 0;
     }
+    uint64_t busy = loop.total() * 1000 / windowUs;
+    return busy > 1000 ? 1000 : (uint16_t)busy;
+}
 
-    // System commands
-    else if (command == "RESTART" || command == "REBOOT")
+// FreeRTOS run-time stats are only compiled in when the SDK configuration
+// enables them (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS); without them
+// only the loop() figures are reported.
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+const size_t PROFILE_MAX_TASKS = 24;
+TaskStatus_t profileTasks[PROFILE_MAX_TASKS];
+UBaseType_t profileTaskCount = 0;
+uint32_t profileTotalRunTime = 0;
+uint32_t lastIdleRunTime[2] = {0, 0};
+uint32_t lastTotalRunTime = 0;
+
+// Refreshes profileTasks and returns each core's load since the previous
+// call, in permille, from how much of the window its idle task ran
+bool readCoreLoad(uint16_t load[2])
+{
+    profileTaskCount = uxTaskGetSystemState(profileTasks, PROFILE_MAX_TASKS, &profileTotalRunTime);
+    if (profileTaskCount == 0)
     {
-        setLaserState(false); // Safety: turn off laser before restart
-        delay(1000);
-        ESP.restart();
+        return false;
     }
-    else if (command == "HELP")
+
+    uint32_t elapsed = profileTotalRunTime - lastTotalRunTime;
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS && core < 2; core++)
     {
-        printHelp();
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        for (UBaseType_t i = 0; i < profileTaskCount; i++)
+        {
+            if (profileTasks[i].xHandle != idle)
+            {
+                continue;
+            }
+            uint32_t idleTime = profileTasks[i].ulRunTimeCounter - lastIdleRunTime[core];
+            lastIdleRunTime[core] = profileTasks[i].ulRunTimeCounter;
+            load[core] = elapsed == 0 || idleTime >= elapsed
+                             ? 0
+                             : (uint16_t)(1000 - (uint64_t)idleTime * 1000 / elapsed);
+        }
     }
+    lastTotalRunTime = profileTotalRunTime;
+    return true;
+}
+#else
+bool readCoreLoad(uint16_t load[2])
+{
+    (void)load;
+    return false;
 }
+#endif
 
-// ==================== LASER CONTROL FUNCTIONS ====================
-void setLaserState(bool state)
+// The window is copied to profileReport and paged out from there, so the
+// next one starts straight away
+void sendProfile()
 {
-    laserState = state;
+    if (!startPagedReply(sendProfileLine))
+    {
+        return;
+    }
+    profileReportUs = micros() - profileWindowStart;
+    profileReportHasLoad = readCoreLoad(profileReportLoad);
+    for (size_t i = 0; i < PROFILE_SCOPES; i++)
+    {
+        profileReport[i] = profileScopes[i];
+    }
+    resetProfileWindow();
+}
 
-    if (state)
+// Line 0 is the header, then one line per scope and, with run-time stats,
+// one per task
+PageLine sendProfileLine(size_t line)
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    if (line == 0)
+    {
+        const ProfileScope &period = profileReport[PROFILE_PERIOD];
+        json.beginObject()
+            .stringField("type", "profile")
+            .uintField("window_ms", profileReportUs / 1000)
+            .uintField("loop_busy_permille", loopBusyPermille(profileReport[PROFILE_LOOP], profileReportUs))
+            .uintField("loop_jitter_us", period.percentile(990) - period.percentile(500));
+        if (profileReportHasLoad)
+        {
+            json.uintArrayField("core_load_permille", profileReportLoad, 2);
+        }
+        json.endObject().endLine();
+    }
+    else if (line <= PROFILE_SCOPES)
+    {
+        ProfileSummary summary = profileReport[line - 1].summary();
+        json.beginObject()
+            .stringField("type", "profile_scope")
+            .stringField("name", PROFILE_NAMES[line - 1])
+            .uintField("count", summary.count)
+            .uintField("min_us", summary.minUs)
+            .uintField("mean_us", summary.meanUs)
+            .uintField("p50_us", summary.p50Us)
+            .uintField("p90_us", summary.p90Us)
+            .uintField("p99_us", summary.p99Us)
+            .uintField("max_us", summary.maxUs)
+            .endObject()
+            .endLine();
+    }
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    // Per task: share of one core since boot
+    else if (profileReportHasLoad && line - PROFILE_SCOPES - 1 < profileTaskCount)
     {
-        ledcWrite(PWM_CHANNEL, laserPwmValue);
+        const TaskStatus_t &task = profileTasks[line - PROFILE_SCOPES - 1];
+        uint32_t cpu = profileTotalRunTime == 0 ? 0 : (uint32_t)((uint64_t)task.ulRunTimeCounter * 1000 / profileTotalRunTime);
+        json.beginObject()
+            .stringField("type", "profile_task")
+            .stringField("name", task.pcTaskName);
+#if configTASKLIST_INCLUDE_COREID
+        json.intField("core", task.xCoreID == tskNO_AFFINITY ? -1 : (int32_t)task.xCoreID);
+#endif
+        json.uintField("cpu_permille", cpu)
+            .uintField("stack_free_bytes", task.usStackHighWaterMark)
+            .endObject()
+            .endLine();
     }
+#endif
     else
     {
-        ledcWrite(PWM_CHANNEL, 0);
+        return PageLine::End;
     }
+    return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
 }
 
-void setLaserBrightness(int brightness)
+void setProfileStreamInterval(int32_t ms)
 {
-    brightness = constrain(brightness, 0, 100);
-    laserBrightness = brightness;
+    if (ms != 0 && (uint32_t)ms < PROFILE_STREAM_MIN_INTERVAL)
+    {
+        ms = PROFILE_STREAM_MIN_INTERVAL;
+    }
+    profileStreamInterval = ms;
+    lastProfileFrame = millis();
+    setAppliedValue(ms);
+}
 
-    laserPwmValue = map(brightness, 0, 100, 0, 255);
+// FRAME_PROFILE, layout in BinaryProtocol.h
+void sendProfileFrame()
+{
+    uint32_t windowUs = micros() - profileWindowStart;
+    uint16_t coreLoad[2] = {PROFILE_LOAD_UNKNOWN, PROFILE_LOAD_UNKNOWN};
+    readCoreLoad(coreLoad);
+
+    uint8_t payload[PROFILE_FRAME_HEADER_SIZE + PROFILE_SCOPES * PROFILE_FRAME_SCOPE_SIZE];
+    writeInt32LE(payload, (int32_t)(windowUs / 1000));
+    writeUint16LE(payload + 4, loopBusyPermille(profileScopes[PROFILE_LOOP], windowUs));
+    writeUint16LE(payload + 6, coreLoad[0]);
+    writeUint16LE(payload + 8, coreLoad[1]);
+    payload[10] = PROFILE_SCOPES;
+    uint8_t *entry = payload + PROFILE_FRAME_HEADER_SIZE;
+    for (size_t i = 0; i < PROFILE_SCOPES; i++)
+    {
+        ProfileSummary summary = profileScopes[i].summary();
+        writeInt32LE(entry, (int32_t)summary.count);
+        writeInt32LE(entry + 4, (int32_t)summary.meanUs);
+        writeInt32LE(entry + 8, (int32_t)summary.p99Us);
+        writeInt32LE(entry + 12, (int32_t)summary.maxUs);
+        entry += PROFILE_FRAME_SCOPE_SIZE;
+    }
+    sendFrame(TxClass::Heartbeat, FRAME_PROFILE, payload, sizeof(payload));
 
-    // Save to preferences whenever brightness changes
-    saveBrightnessToPreferences();
+    resetProfileWindow();
+}
 
-    if (laserState)
+// ==================== BINARY PROTOCOL ====================
+// Host sends BINARY_MODE as text, waits for "BINARY_MODE OK", then talks in
+// frames. TEXT_MODE or BINARY_IDLE_TIMEOUT without a valid frame returns to
+// text, so a host that crashes mid-session cannot leave the device unusable.
+void enterBinaryMode()
+{
+    if (binaryMode)
     {
-        ledcWrite(PWM_CHANNEL, laserPwmValue);
+        return;
     }
+    sendLine(TxClass::Response, "BINARY_MODE OK");
+    frameDecoder.reset();
+    binaryMode = true;
+    lastBinaryFrame = millis();
 }
 
-// ==================== PREFERENCES FUNCTIONS ====================
-void saveBrightnessToPreferences()
+void exitBinaryMode()
 {
-    preferences.putInt("brightness", laserBrightness);
-    Serial.println("Brightness saved: " + String(laserBrightness) + "%");
+    if (!binaryMode)
+    {
+        sendLine(TxClass::Response, "TEXT_MODE OK");
+    }
+    // In binary mode the ACK frame for this request confirms the switch
+    binaryMode = false;
 }
 
-void loadBrightnessFromPreferences()
+size_t pollBinaryFrames()
 {
-    // Load brightness from preferences, default to 50 if not found
-    laserBrightness = preferences.getInt("brightness", 50);
+    uint8_t chunk[64];
+    size_t total = 0;
 
-    // Ensure the value is within valid range
-    laserBrightness = constrain(laserBrightness, 0, 100);
+    int available;
+    while (binaryMode && (available = Serial.available()) > 0)
+    {
+        uint32_t rxCycles = ESP.getCycleCount();
+        commandRxTime = (uint64_t)esp_timer_get_time();
+        size_t count = Serial.read(chunk, (size_t)available < sizeof(chunk) ? (size_t)available : sizeof(chunk));
+        total += count;
 
-    // Update PWM value based on loaded brightness
-    laserPwmValue = map(laserBrightness, 0, 100, 0, 255);
+        for (size_t i = 0; i < count; i++)
+        {
+            BinaryFrame frame;
+            if (frameDecoder.feed(chunk[i], frame))
+            {
+                handleFrame(frame, rxCycles);
+            }
+            if (!binaryMode)
+            {
+                // Anything after TEXT_MODE is already text
+                serialLines.feed(reinterpret_cast<const char *>(chunk + i + 1), count - i - 1);
+                break;
+            }
+        }
+    }
+    return total;
 }
 
-// ==================== COMMUNICATION FUNCTIONS ====================
-void sendHeartbeat()
+void handleFrame(const BinaryFrame &frame, uint32_t rxCycles)
 {
-    unsigned long uptime = millis() - bootTime;
-    int freeHeap = ESP.getFreeHeap();
+    uint32_t readyCycles = ESP.getCycleCount();
+    lastBinaryFrame = millis();
 
-    Serial.println("{\"type\":\"heartbeat\",\"uptime_ms\":" +
-                   String(uptime) + ",\"free_heap_bytes\":" +
-                   String(freeHeap) + ",\"laser_state\":" +
-                   String(laserState ? "true" : "false") + ",\"laser_brightness\":" +
-                   String(laserBrightness) + ",\"timestamp\":\"" +
-                   getFormattedTime() + "\",\"version\":\"" +
-                   FIRMWARE_VERSION + "\"}");
-}
+    if (frame.opcode == OPCODE_SCHEDULE)
+    {
+        handleScheduleFrame(frame);
+        return;
+    }
 
-void sendStatusUpdate()
-{
-    unsigned long uptime = millis() - bootTime;
-    int freeHeap = ESP.getFreeHeap();
-    int totalHeap = ESP.getHeapSize();
-    int analogValue = analogRead(DEFAULT_ANALOG_PIN);
-    float voltage = getVoltageFromAnalog(analogValue);
-
-    Serial.println("{\"type\":\"status\",\"uptime_ms\":" +
-                   String(uptime) + ",\"free_heap_bytes\":" +
-                   String(freeHeap) + ",\"total_heap_bytes\":" +
-                   String(totalHeap) + ",\"laser_state\":" +
-                   String(laserState ? "true" : "false") + ",\"laser_brightness\":" +
-                   String(laserBrightness) + ",\"laser_pwm_value\":" +
-                   String(laserPwmValue) + ",\"analog_a0\":" +
-                   String(analogValue) + ",\"voltage_a0\":" +
-                   String(voltage, 2) + ",\"cpu_freq_mhz\":" +
-                   String(ESP.getCpuFreqMHz()) + ",\"timestamp\":\"" +
-                   getFormattedTime() + "\",\"version\":\"" +
-                   FIRMWARE_VERSION + "\",\"heartbeat_enabled\":" +
-                   String(heartbeatEnabled ? "true" : "false") + "}");
+    DispatchResult result = DispatchResult::UnknownCommand;
+    beginCommand();
+    const CommandSpec *spec = commandRegistry.findOpcode(frame.opcode);
+    if (spec != nullptr)
+    {
+        uint32_t start = traceBegin(spec->opcode, rxCycles, readyCycles);
+        result = finishCommand(commandRegistry.executePayload(*spec, frame.payload, frame.length, &commandApplied));
+        traceEnd(start);
+    }
+
+    uint8_t ack[ACK_FRAME_SIZE] = {frame.opcode, frame.sequence, (uint8_t)result};
+    writeInt32LE(ack + 3, result == DispatchResult::Ok ? commandApplied : 0);
+    writeInt32LE(ack + 7, (int32_t)micros());
+    sendFrame(TxClass::Response, FRAME_ACK, ack, sizeof(ack));
+    applyRequestedMode();
 }
 
-void sendSystemInfo()
+// Returns false only when the frame could not be queued
+bool sendFrame(TxClass cls, uint8_t opcode, const uint8_t *payload, size_t length)
 {
-    Serial.println("ESP32-S3 Laser Controller System Information v" + FIRMWARE_VERSION);
-    Serial.println("Hardware: " + String(ESP.getChipModel()) + " Rev " + String(ESP.getChipRevision()));
-    Serial.println("CPU Frequency: " + String(ESP.getCpuFreqMHz()) + " MHz");
-    Serial.println("Flash Size: " + String(ESP.getFlashChipSize() / 1024 / 1024) + " MB");
-    Serial.println("Heap Size: " + String(ESP.getHeapSize()) + " bytes");
-    Serial.println("Free Heap: " + String(ESP.getFreeHeap()) + " bytes");
-    Serial.println("SDK Version: " + String(ESP.getSdkVersion()));
-    Serial.println("Build: " + String(BUILD_DATE) + " " + String(BUILD_TIME));
-    Serial.println("Boot Time: " + getFormattedUptime());
-    Serial.println("Laser Pin: GPIO " + String(LASER_PIN));
-    Serial.println("Laser State: " + String(laserState ? "ON" : "OFF"));
-    Serial.println("Laser Brightness: " + String(laserBrightness) + "% (saved in preferences)");
-    if (heartbeatEnabled)
+    if (!subscribed(cls))
     {
-        Serial.println("Heartbeat Interval: " + String(heartbeatInterval / 1000) + " seconds");
+        return true;
     }
+    uint8_t frame[FRAME_MAX_ENCODED];
+    size_t frameLength = encodeFrame(opcode, txSequence++, payload, length, frame, sizeof(frame));
+    return frameLength > 0 && txQueue.push(cls, reinterpret_cast<const char *>(frame), frameLength);
 }
 
-// ==================== UTILITY FUNCTIONS ====================
-String getFormattedTime()
+// ==================== SESSION ====================
+// HELLO:version[,mode,subscriptions,keepalive_ms] opens a session and is
+// answered with one WELCOME message (capabilities and a state snapshot).
+// mode 0 = text, 1 = binary; subscriptions pick the unsolicited output
+// (SUBSCRIBE_*); the session expires after keepalive_ms without input.
+void openSession()
 {
-    unsigned long totalSeconds = (millis() - bootTime) / 1000;
-    unsigned long hours = totalSeconds / 3600;
-    unsigned long minutes = (totalSeconds % 3600) / 60;
-    unsigned long seconds = totalSeconds % 60;
+    int32_t version = commandFields[0];
+    int32_t mode = commandFieldCount > 1 ? commandFields[1] : (binaryMode ? SESSION_MODE_BINARY : SESSION_MODE_TEXT);
+    int32_t subscriptions = commandFieldCount > 2 ? commandFields[2] : SUBSCRIBE_ALL;
+    int32_t keepalive = commandFieldCount > 3 ? commandFields[3] : SESSION_DEFAULT_KEEPALIVE;
+    if (commandResult != DispatchResult::Ok || version < 1 || mode > SESSION_MODE_BINARY ||
+        subscriptions > SUBSCRIBE_ALL || (keepalive != 0 && keepalive < SESSION_MIN_KEEPALIVE))
+    {
+        rejectCommand();
+        return;
+    }
 
-    return String(hours) + ":" +
-           (minutes < 10 ? "0" : "") + String(minutes) + ":" +
-           (seconds < 10 ? "0" : "") + String(seconds);
+    sessionOpen = true;
+    sessionProtocol = version < PROTOCOL_VERSION ? version : PROTOCOL_VERSION;
+    sessionSubscriptions = subscriptions;
+    sessionKeepalive = keepalive;
+    sessionCount++;
+    setAppliedValue(sessionProtocol);
+    requestedMode = mode;
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "welcome")
+        .uintField("protocol", sessionProtocol)
+        .uintField("session", sessionCount)
+        .uintField("capabilities", deviceCapabilities())
+        .uintField("mode", mode)
+        .uintField("baud", baudRate)
+        .uintField("subscriptions", sessionSubscriptions)
+        .uintField("keepalive_ms", sessionKeepalive)
+        .stringField("version", FIRMWARE_VERSION)
+        .uintField("uptime_ms", millis() - bootTime)
+        .uint64Field("clock_us", (uint64_t)esp_timer_get_time())
+        .boolField("laser_state", laserState)
+        .intField("laser_brightness", laserBrightness)
+        .uintField("laser_setpoint", laserSetpoint)
+        .uintField("laser_pwm_value", laserDuty)
+        .uintField("pwm_frequency_hz", pwmFrequency)
+        .uintField("pwm_resolution_bits", pwmResolution)
+        .uintField("output_mode", (uint8_t)outputMode)
+        .uintField("calibration_profile", calibrationProfile)
+        .boolField("heartbeat_enabled", heartbeatEnabled)
+        .intField("heartbeat_interval_ms", heartbeatInterval)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
 }
 
-String getFormattedUptime()
+void closeSession(const char *reason)
 {
-    unsigned long totalSeconds = (millis() - bootTime) / 1000;
-    unsigned long days = totalSeconds / 86400;
-    unsigned long hours = (totalSeconds % 86400) / 3600;
-    unsigned long minutes = (totalSeconds % 3600) / 60;
-    unsigned long seconds = totalSeconds % 60;
-
-    String uptime = "";
-    if (days > 0)
-        uptime += String(days) + "d ";
-    if (hours > 0 || days > 0)
-        uptime += String(hours) + "h ";
-    if (minutes > 0 || hours > 0 || days > 0)
-        uptime += String(minutes) + "m ";
-    uptime += String(seconds) + "s";
-
-    return uptime;
+    if (!sessionOpen)
+    {
+        return;
+    }
+    sessionOpen = false;
+    sessionSubscriptions = SUBSCRIBE_ALL;
+    sendLinef(TxClass::Event, "Session %lu %s", (unsigned long)sessionCount, reason);
 }
 
-float getVoltageFromAnalog(int analogValue)
+// A HELLO's mode switch waits until its WELCOME and reply have gone out
+// in the mode the HELLO came in
+void applyRequestedMode()
 {
-    return (analogValue * 3.3) / 4095.0;
+    if (requestedMode == SESSION_MODE_BINARY && !binaryMode)
+    {
+        frameDecoder.reset();
+        binaryMode = true;
+        lastBinaryFrame = millis();
+    }
+    else if (requestedMode == SESSION_MODE_TEXT)
+    {
+        binaryMode = false;
+    }
+    requestedMode = SESSION_MODE_UNCHANGED;
 }
 
-void printSystemStatus()
+// Responses always go out; the rest only if the session subscribed to it
+bool subscribed(TxClass cls)
 {
-    Serial.println("Board: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + "MHz");
-    Serial.println("Memory: " + String(ESP.getFreeHeap()) + "/" + String(ESP.getHeapSize()) + " bytes free");
-    Serial.println("Laser Pin: GPIO " + String(LASER_PIN));
+    switch (cls)
+    {
+    case TxClass::Event:
+        return sessionSubscriptions & SUBSCRIBE_EVENTS;
+    case TxClass::Heartbeat:
+        return sessionSubscriptions & SUBSCRIBE_HEARTBEAT;
+    case TxClass::Log:
+        return sessionSubscriptions & SUBSCRIBE_LOG;
+    default:
+        return true;
+    }
 }
 
-// ==================== DIAGNOSTIC FUNCTIONS ====================
-void runDiagnostics()
+uint32_t deviceCapabilities()
 {
-    Serial.println("Running Laser Controller Diagnostics");
-
-    bool originalLaserState = laserState;
-    int originalBrightness = laserBrightness;
-
-    setLaserBrightness(10);
-    setLaserState(true);
-    delay(500);
-    setLaserState(false);
-
-    setLaserBrightness(originalBrightness);
-    setLaserState(originalLaserState);
-
-    int analogValue = analogRead(DEFAULT_ANALOG_PIN);
-    Serial.println("A0 reading: " + String(analogValue) + " (" + String(getVoltageFromAnalog(analogValue), 2) + "V)");
-
-    memoryTest();
+    uint32_t capabilities = CAP_BINARY_FRAMES | CAP_REQUEST_IDS | CAP_WAVEFORM | CAP_STREAM |
+                            CAP_POWER_LOOP | CAP_CALIBRATION | CAP_PROFILER | CAP_TELEMETRY_STREAM |
+                            CAP_SCHEDULE | CAP_BAUD;
+    if (adcSampler.running())
+    {
+        capabilities |= CAP_ADC_CONTINUOUS;
+    }
+    if (historyInPsram)
+    {
+        capabilities |= CAP_HISTORY_PSRAM;
+    }
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    capabilities |= CAP_TASK_STATS;
+#endif
+    return capabilities;
+}
 
-    Serial.println("Diagnostics completed");
+// ==================== BAUD RATE ====================
+// SET_BAUD:rate is answered at the current rate. Once that reply has left
+// the UART the device switches, and keeps the new rate only if
+// BAUD_CONFIRM:rate arrives at it within BAUD_CONFIRM_TIMEOUT; otherwise
+// it goes back. A host that disappears (session expiry, binary idle
+// timeout) also takes the device back to BAUD_DEFAULT, where the next host
+// starts.
+const BaudSetting *findBaudSetting(uint32_t rate)
+{
+    for (const BaudSetting &setting : BAUD_SETTINGS)
+    {
+        if (setting.rate == rate)
+        {
+            return &setting;
+        }
+    }
+    return nullptr;
 }
 
-void memoryTest()
+void requestBaudRate(int32_t rate)
 {
-    Serial.println("Heap: " + String(ESP.getFreeHeap()) + "/" + String(ESP.getHeapSize()) + " bytes");
-    Serial.println("PSRAM: " + String(ESP.getFreePsram()) + "/" + String(ESP.getPsramSize()) + " bytes");
+    if (findBaudSetting(rate) == nullptr || baudState != BaudState::Idle)
+    {
+        rejectCommand();
+        return;
+    }
+    if ((uint32_t)rate == baudRate)
+    {
+        sendLinef(TxClass::Response, "BAUD %lu OK", (unsigned long)baudRate);
+        return;
+    }
+    baudTarget = rate;
+    baudState = BaudState::Draining;
+    sendLinef(TxClass::Response, "SET_BAUD %lu OK - confirm within %lums", (unsigned long)baudTarget,
+              (unsigned long)BAUD_CONFIRM_TIMEOUT);
+}
 
-    int *testArray = (int *)malloc(1000 * sizeof(int));
-    if (testArray != nullptr)
+// Repeats are answered the same, so a host can send it until it gets a reply
+void confirmBaudRate(int32_t rate)
+{
+    if ((uint32_t)rate != baudRate || (baudState != BaudState::Confirming && baudState != BaudState::Idle))
     {
-        Serial.println("Memory allocation test passed");
-        free(testArray);
+        rejectCommand();
+        return;
     }
-    else
+    if (baudState == BaudState::Confirming)
     {
-        Serial.println("Memory allocation test failed");
+        baudState = BaudState::Idle;
+        baudSwitches++;
     }
+    sendLinef(TxClass::Response, "BAUD %lu OK", (unsigned long)baudRate);
 }
 
-// ==================== HELP FUNCTION ====================
-void printHelp()
+void serviceBaudRate()
 {
-    Serial.println("ESP32-S3 Laser Controller v" + FIRMWARE_VERSION + " Commands");
-    Serial.println("Laser Control:");
-    Serial.println("  LASER_ON                    - Turn on laser");
-    Serial.println("  LASER_OFF                   - Turn off laser");
-    Serial.println("  LASER_TOGGLE                - Toggle laser state");
-    Serial.println("  SET_LASER_PWM:value         - Set laser brightness (0-100%) - SAVED");
-    Serial.println("  SET_LASER_BRIGHTNESS:value  - Set laser brightness (0-100%) - SAVED");
-    Serial.println("  LASER_STATUS                - Show laser status");
-    Serial.println("Reading:");
-    Serial.println("  ANALOG_READ         - Read analog value from A0");
-    Serial.println("System:");
-    Serial.println("  STATUS              - Get device status (JSON)");
-    Serial.println("  SYSTEM_INFO         - Show detailed system info");
-    Serial.println("  VERSION             - Show firmware version");
-    Serial.println("  GET_INITIAL_STATE   - Get current device state (JSON)");
-    Serial.println("  DIAGNOSTICS         - Run system diagnostics");
-    Serial.println("  MEMORY_TEST         - Test memory allocation");
-    Serial.println("  RESTART             - Restart the ESP32-S3");
-    Serial.println("Heartbeat Control:");
-    Serial.println("  HEARTBEAT_ON        - Enable periodic heartbeat");
-    Serial.println("  HEARTBEAT_OFF       - Disable heartbeat");
-    Serial.println("  HEARTBEAT_INTERVAL:ms - Set heartbeat interval (1000-60000)");
-    Serial.println("Examples:");
-    Serial.println("  SET_LASER_PWM:75          - Set laser to 75% brightness");
-    Serial.println("  HEARTBEAT_INTERVAL:5000   - 5 second heartbeat");
-    Serial.println("Laser Pin: GPIO " + String(LASER_PIN));
-    Serial.println("Safety: Laser automatically turns off on restart");
-    Serial.println("Note: Brightness values are automatically saved and restored on power cycle");
-    Serial.println("      Device state is automatically sent on connection detection");
-}
\ No newline at end of file
+    switch (baudState)
+    {
+    case BaudState::Draining:
+        if (txQueue.drained(TxClass::Response))
+        {
+            baudState = BaudState::Flushing;
+        }
+        break;
+
+    case BaudState::Flushing:
+        // flush() then only has the last bytes to wait for
+        if ((int32_t)(micros() - uartIdleAt) >= 0)
+        {
+            Serial.flush();
+            baudPrevious = baudRate;
+            applyBaudRate(baudTarget);
+            baudState = BaudState::Confirming;
+            baudStateSince = millis();
+        }
+        break;
+
+    case BaudState::Confirming:
+        if (millis() - baudStateSince > BAUD_CONFIRM_TIMEOUT)
+        {
+            applyBaudRate(baudPrevious);
+            baudState = BaudState::Idle;
+            baudReverts++;
+            sendLinef(TxClass::Event, "Baud rate %lu not confirmed - back to %lu", (unsigned long)baudTarget,
+                      (unsigned long)baudRate);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void applyBaudRate(uint32_t rate)
+{
+    const BaudSetting *setting = findBaudSetting(rate);
+    Serial.updateBaudRate(rate);
+    Serial.setRxFIFOFull(setting->rxFifoFull);
+    Serial.setRxTimeout(setting->rxTimeout);
+    baudRate = rate;
+}
+
+void restoreDefaultBaudRate()
+{
+    if (baudRate == BAUD_DEFAULT && baudState == BaudState::Idle)
+    {
+        return;
+    }
+    Serial.flush();
+    applyBaudRate(BAUD_DEFAULT);
+    baudState = BaudState::Idle;
+    baudReverts++;
+}
+
+// ==================== TIME SYNC AND SCHEDULING ====================
+// NTP-style exchange: the host notes when it sent TIME_SYNC (t1) and when
+// the reply came back (t4). With the device's receive (t2) and transmit
+// (t3) times, offset = ((t2 - t1) + (t3 - t4)) / 2 and the round trip is
+// (t4 - t1) - (t3 - t2); the exchanges with the shortest round trip give
+// the best offsets, and their trend over time gives the drift.
+void sendTimeSync()
+{
+    uint64_t transmit = (uint64_t)esp_timer_get_time();
+    if (binaryMode)
+    {
+        uint8_t payload[TIME_FRAME_SIZE];
+        writeUint64LE(payload, commandRxTime);
+        writeUint64LE(payload + 8, transmit);
+        sendFrame(TxClass::Response, FRAME_TIME, payload, sizeof(payload));
+        return;
+    }
+    sendLinef(TxClass::Response, "TIME %llu %llu", (unsigned long long)commandRxTime, (unsigned long long)transmit);
+}
+
+DispatchResult scheduleTextCommand(const CommandSpec &spec, const char *command, size_t length, uint64_t at, int32_t id)
+{
+    const char *colon = static_cast<const char *>(memchr(command, ':', length));
+    int32_t value = 0;
+    if (colon != nullptr && !parseInt32(colon + 1, length - (colon + 1 - command), value))
+    {
+        return DispatchResult::BadArgument;
+    }
+    return scheduleCommand(at, spec, colon != nullptr, value, id);
+}
+
+// payload: time (u64), opcode (u8), then the command's argument if any
+void handleScheduleFrame(const BinaryFrame &frame)
+{
+    beginCommand();
+    DispatchResult result = DispatchResult::BadArgument;
+    if (frame.length == SCHEDULE_HEADER_SIZE || frame.length == SCHEDULE_HEADER_SIZE + 4)
+    {
+        const CommandSpec *spec = commandRegistry.findOpcode(frame.payload[8]);
+        bool hasArgument = frame.length > SCHEDULE_HEADER_SIZE;
+        result = spec == nullptr ? DispatchResult::UnknownCommand
+                                 : scheduleCommand(readUint64LE(frame.payload), *spec, hasArgument,
+                                                   hasArgument ? readInt32LE(frame.payload + SCHEDULE_HEADER_SIZE) : 0,
+                                                   frame.sequence);
+    }
+
+    uint8_t ack[ACK_FRAME_SIZE] = {frame.opcode, frame.sequence, (uint8_t)result};
+    writeInt32LE(ack + 3, result == DispatchResult::Ok ? commandApplied : 0);
+    writeInt32LE(ack + 7, (int32_t)micros());
+    sendFrame(TxClass::Response, FRAME_ACK, ack, sizeof(ack));
+}
+
+// Checks everything that can be checked now; the ACK's applied value is
+// the number of commands waiting
+DispatchResult scheduleCommand(uint64_t at, const CommandSpec &spec, bool hasArgument, int32_t value, int32_t id)
+{
+    bool schedulable = false;
+    for (uint8_t opcode : SCHEDULABLE_OPCODES)
+    {
+        schedulable = schedulable || opcode == spec.opcode;
+    }
+    if (!schedulable)
+    {
+        sendLinef(TxClass::Response, "%s cannot be scheduled", spec.name);
+        return DispatchResult::Rejected;
+    }
+    if (hasArgument != (spec.argType == ArgType::Int) ||
+        (hasArgument && (value < spec.minValue || value > spec.maxValue)))
+    {
+        return DispatchResult::BadArgument;
+    }
+
+    uint64_t now = (uint64_t)esp_timer_get_time();
+    if (at == 0 || at > now + SCHEDULE_MAX_AHEAD_US)
+    {
+        return DispatchResult::BadArgument;
+    }
+    if (at <= now)
+    {
+        sendLine(TxClass::Response, "Scheduled time has passed");
+        return DispatchResult::Rejected;
+    }
+    if (scheduleCount == SCHEDULE_CAPACITY)
+    {
+        sendLine(TxClass::Response, "Schedule full");
+        return DispatchResult::Rejected;
+    }
+
+    // Same-time commands keep their arrival order
+    size_t slot = scheduleCount;
+    while (slot > 0 && schedule[slot - 1].at > at)
+    {
+        schedule[slot] = schedule[slot - 1];
+        slot--;
+    }
+    ScheduledCommand &entry = schedule[slot];
+    entry.at = at;
+    entry.spec = &spec;
+    entry.argumentLength = hasArgument ? 4 : 0;
+    writeInt32LE(entry.argument, value);
+    entry.id = id;
+    scheduleCount++;
+    setAppliedValue(scheduleCount);
+    return DispatchResult::Ok;
+}
+
+// Sent as a response, whatever the session subscribes to
+void sendScheduleResult(const ScheduledCommand &entry, DispatchResult result, uint64_t achieved, bool exact,
+                        const char *reason)
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject().stringField("type", "scheduled");
+    if (entry.id >= 0)
+    {
+        json.intField("id", entry.id);
+    }
+    json.stringField("command", entry.spec->name)
+        .uintField("result", (uint8_t)result)
+        .uint64Field("requested_us", entry.at);
+    if (reason != nullptr)
+    {
+        json.stringField("reason", reason);
+    }
+    else if (result == DispatchResult::Ok)
+    {
+        int64_t error = (int64_t)(achieved - entry.at);
+        int32_t clamped = error > INT32_MAX ? INT32_MAX : (error < INT32_MIN ? INT32_MIN : (int32_t)error);
+        json.uint64Field("achieved_us", achieved).intField("error_us", clamped).boolField("exact", exact);
+
+        scheduleErrorMin = scheduleApplied == 0 || clamped < scheduleErrorMin ? clamped : scheduleErrorMin;
+        scheduleErrorMax = scheduleApplied == 0 || clamped > scheduleErrorMax ? clamped : scheduleErrorMax;
+        scheduleErrorAbsSum += clamped < 0 ? -(int64_t)clamped : clamped;
+        scheduleApplied++;
+        scheduleExact += exact ? 1 : 0;
+    }
+    json.endObject().endLine();
+    sendJson(TxClass::Response, json);
+}
+
+void runScheduledCommand(const ScheduledCommand &entry)
+{
+    beginCommand();
+    commandApplyAt = entry.at;
+    scheduledOutputPosted = false;
+    DispatchResult result = finishCommand(
+        commandRegistry.executePayload(*entry.spec, entry.argument, entry.argumentLength, &commandApplied));
+    commandApplyAt = 0;
+
+    if (result == DispatchResult::Ok && scheduledOutputPosted)
+    {
+        scheduleInFlight[scheduleInFlightCount++] = entry;
+    }
+    else if (result == DispatchResult::Ok)
+    {
+        // e.g. WAVE_STOP while steady: the output already is what was asked
+        sendScheduleResult(entry, result, 0, false, "nothing to apply");
+    }
+    else
+    {
+        sendScheduleResult(entry, result, 0, false, nullptr);
+    }
+}
+
+// Runs what is due within the lead time and reports what the laser task
+// has applied
+void serviceSchedule()
+{
+    uint64_t now = (uint64_t)esp_timer_get_time();
+    while (scheduleCount > 0 && schedule[0].at <= now + SCHEDULE_LEAD_US &&
+           scheduleInFlightCount < SCHEDULE_CAPACITY)
+    {
+        ScheduledCommand entry = schedule[0];
+        scheduleCount--;
+        memmove(schedule, schedule + 1, scheduleCount * sizeof(ScheduledCommand));
+        runScheduledCommand(entry);
+    }
+
+    ScheduleReport report;
+    while (scheduleReportQueue.pop(report))
+    {
+        // Everything run for that instant took effect with it
+        size_t kept = 0;
+        for (size_t i = 0; i < scheduleInFlightCount; i++)
+        {
+            if (scheduleInFlight[i].at == report.requested)
+            {
+                sendScheduleResult(scheduleInFlight[i], DispatchResult::Ok, report.achieved, report.exact, nullptr);
+            }
+            else
+            {
+                scheduleInFlight[kept++] = scheduleInFlight[i];
+            }
+        }
+        scheduleInFlightCount = kept;
+    }
+
+    // A lost report leaves its commands in flight. Each is applied within a
+    // tick of its time, so once it is a lead time past, report it without
+    // the achieved time; losses are settled when nothing due is left.
+    uint32_t lost = scheduleReportsLost;
+    if (lost != scheduleReportsSettled)
+    {
+        size_t kept = 0;
+        bool due = false;
+        for (size_t i = 0; i < scheduleInFlightCount; i++)
+        {
+            if (scheduleInFlight[i].at + SCHEDULE_LEAD_US <= now)
+            {
+                sendScheduleResult(scheduleInFlight[i], DispatchResult::Ok, 0, false, "report lost");
+                continue;
+            }
+            due = due || scheduleInFlight[i].at <= now;
+            scheduleInFlight[kept++] = scheduleInFlight[i];
+        }
+        scheduleInFlightCount = kept;
+        if (!due)
+        {
+            scheduleReportsSettled = lost;
+        }
+    }
+}
+
+// Commands already run (the last SCHEDULE_LEAD_US before their time) can
+// only be dropped with `inFlight` by a caller that then posts the output
+// that replaces theirs
+void clearSchedule(const char *reason, bool inFlight)
+{
+    for (size_t i = 0; i < scheduleCount; i++)
+    {
+        sendScheduleResult(schedule[i], DispatchResult::Rejected, 0, false, reason);
+    }
+    scheduleCancelled += scheduleCount;
+    scheduleCount = 0;
+    if (inFlight)
+    {
+        for (size_t i = 0; i < scheduleInFlightCount; i++)
+        {
+            sendScheduleResult(scheduleInFlight[i], DispatchResult::Rejected, 0, false, reason);
+        }
+        scheduleCancelled += scheduleInFlightCount;
+        scheduleInFlightCount = 0;
+    }
+}
+
+// Outputs posted now wait for the latest scheduled one not yet applied
+uint64_t scheduleHoldUntil()
+{
+    return scheduleInFlightCount > 0 ? scheduleInFlight[scheduleInFlightCount - 1].at : 0;
+}
+
+void sendScheduleStatus()
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "schedule")
+        .uint64Field("clock_us", (uint64_t)esp_timer_get_time())
+        .uintField("waiting", scheduleCount)
+        .uintField("in_flight", scheduleInFlightCount)
+        .uintField("capacity", SCHEDULE_CAPACITY)
+        .uintField("lead_us", (uint32_t)SCHEDULE_LEAD_US)
+        .uintField("applied", scheduleApplied)
+        .uintField("exact", scheduleExact)
+        .uintField("cancelled", scheduleCancelled)
+        .uintField("reports_lost", scheduleReportsLost)
+        .intField("error_min_us", scheduleErrorMin)
+        .intField("error_max_us", scheduleErrorMax)
+        .uintField("error_mean_abs_us", scheduleApplied ? (uint32_t)(scheduleErrorAbsSum / scheduleApplied) : 0)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// ==================== LASER CONTROL FUNCTIONS ====================
+// These run on the communication side and only update the requested state;
+// laserTask applies it to the hardware on its next tick.
+void setLaserState(bool state)
+{
+    laserState = state;
+    setAppliedValue(state);
+    if (!state)
+    {
+        outputMode = OutputMode::Steady; // Safety: LASER_OFF also ends playback/streaming
+        stopCalibration("laser turned off");
+        if (commandApplyAt == 0)
+        {
+            clearSchedule("laser turned off", true); // and is never held behind a scheduled change
+        }
+    }
+    postLaserOutput();
+}
+
+void setLaserBrightness(int brightness)
+{
+    brightness = constrain(brightness, 0, 100);
+    setLaserSetpoint(((uint32_t)brightness * LASER_SETPOINT_MAX + 50) / 100);
+}
+
+void setLaserSetpoint(uint32_t setpoint)
+{
+    laserSetpoint = setpoint > LASER_SETPOINT_MAX ? LASER_SETPOINT_MAX : setpoint;
+    laserBrightness = (laserSetpoint * 100 + LASER_SETPOINT_MAX / 2) / LASER_SETPOINT_MAX;
+    laserDuty = setpointToDuty(laserSetpoint);
+
+    // Cached; NVS is written once the value settles
+    saveBrightnessToPreferences();
+
+    postLaserOutput();
+}
+
+// Requested power to duty through the active calibration profile
+uint32_t setpointToDuty(uint32_t setpoint)
+{
+    return setpointToRawDuty(calibration.linearize(setpoint));
+}
+
+// Multiply-and-shift with a factor precomputed per resolution
+uint32_t setpointToRawDuty(uint32_t setpoint)
+{
+    return (setpoint * pwmDutyScale + 0x8000) >> 16;
+}
+
+// Rejects combinations the LEDC timer cannot produce; on success the new
+// timer settings are saved and applied by laserTask on its next tick
+bool configurePwm(uint32_t frequency, uint8_t resolution)
+{
+    if (resolution < 1 || resolution > PWM_MAX_RESOLUTION || frequency == 0 ||
+        (uint64_t)frequency << resolution > LEDC_SOURCE_CLOCK_HZ)
+    {
+        return false;
+    }
+
+    pwmFrequency = frequency;
+    pwmResolution = resolution;
+    pwmMaxDuty = (1u << resolution) - 1;
+    pwmDutyScale = (pwmMaxDuty * 65536u + LASER_SETPOINT_MAX / 2) / LASER_SETPOINT_MAX;
+    laserDuty = setpointToDuty(laserSetpoint);
+    return true;
+}
+
+void setPwmFrequency(int32_t frequency)
+{
+    outputMode = OutputMode::Steady; // table and sample duties depend on the timer settings
+    stopCalibration("PWM settings changed");
+    if (!configurePwm(frequency, pwmResolution))
+    {
+        rejectCommand();
+        sendLinef(TxClass::Response, "PWM frequency not reachable at %u-bit", pwmResolution);
+        return;
+    }
+    savePwmConfigToPreferences();
+    postLaserOutput();
+}
+
+void setPwmResolution(int32_t resolution)
+{
+    outputMode = OutputMode::Steady;
+    stopCalibration("PWM settings changed");
+    if (!configurePwm(pwmFrequency, resolution))
+    {
+        rejectCommand();
+        sendLinef(TxClass::Response, "PWM resolution not reachable at %luHz", (unsigned long)pwmFrequency);
+        return;
+    }
+    savePwmConfigToPreferences();
+    postLaserOutput();
+}
+
+void setLaserDuty(int32_t duty)
+{
+    if ((uint32_t)duty > pwmMaxDuty)
+    {
+        rejectCommand();
+        sendLinef(TxClass::Response, "Duty out of range (0-%lu)", (unsigned long)pwmMaxDuty);
+        return;
+    }
+    setLaserSetpoint(((uint32_t)duty * LASER_SETPOINT_MAX + pwmMaxDuty / 2) / pwmMaxDuty);
+}
+
+// Each post carries the complete output, so if the queue is full it is
+// enough to retry the latest state from loop()
+void postLaserOutput()
+{
+    LaserOutput output = {laserState, laserDuty, pwmFrequency, pwmResolution,
+                          outputMode, outputModeRun, traceSlot, 0, 0, 0};
+    if (traceSlot != NO_TRACE)
+    {
+        output.traceCycles = ESP.getCycleCount() - traceRxCycles;
+        output.tracePostedMicros = micros();
+    }
+    output.applyAt = commandApplyAt != 0 ? commandApplyAt : scheduleHoldUntil();
+    if (output.applyAt != 0)
+    {
+        output.traceSlot = NO_TRACE; // held outputs would skew the apply latency
+        scheduledOutputPosted = true;
+    }
+    if (calibrating)
+    {
+        // The sweep owns the output; modes started meanwhile begin afterwards
+        output.on = true;
+        output.duty = sweepDuty;
+        output.mode = OutputMode::Steady;
+    }
+    laserOutputPending = !laserOutputQueue.push(output);
+}
+
+// ==================== LASER TASK ====================
+// Counted when loop() has fallen 16 reports behind; serviceSchedule() then
+// reports the affected commands once they are well past their time
+void reportScheduledOutput(const ScheduleReport &report)
+{
+    if (!scheduleReportQueue.push(report))
+    {
+        scheduleReportsLost++;
+    }
+}
+
+void laserTask(void *parameter)
+{
+    (void)parameter;
+    LaserOutput current = {false, 0, pwmFrequency, pwmResolution, OutputMode::Steady, outputModeRun, NO_TRACE, 0, 0, 0};
+    LaserOutput held = current; // scheduled output waiting for its time
+    bool holding = false;
+    LatencyApply trace = {NO_TRACE, 0, 0};
+    uint32_t tracePosted = 0;
+    uint32_t appliedDuty = UINT32_MAX;
+    uint32_t appliedFrequency = pwmFrequency;
+    uint8_t appliedResolution = pwmResolution;
+    uint8_t startedRun = outputModeRun;
+    uint16_t telemetryTicks = 0;
+    uint16_t telemetrySequence = 0;
+    TickType_t lastWake = xTaskGetTickCount();
+
+    for (;;)
+    {
+        // Only the newest queued output matters, except that one for a
+        // later time is held and everything queued behind it waits
+        uint64_t now = (uint64_t)esp_timer_get_time();
+        LaserOutput output;
+        while (laserOutputQueue.peek(output))
+        {
+            if (holding && output.applyAt > held.applyAt)
+            {
+                break;
+            }
+            laserOutputQueue.pop(output);
+            if (holding && output.applyAt == held.applyAt)
+            {
+                // Posted after it for the same instant: it replaces it
+                if (outputScheduler.armed() && !outputScheduler.fired())
+                {
+                    outputScheduler.cancel();
+                }
+                held = output;
+                continue;
+            }
+            if (holding)
+            {
+                // An immediate output (LASER_OFF) drops the schedule
+                outputScheduler.cancel();
+                holding = false;
+            }
+            if (output.applyAt > now)
+            {
+                held = output;
+                holding = true;
+                continue;
+            }
+            if (output.applyAt != 0)
+            {
+                reportScheduledOutput({output.applyAt, now, false}); // its time has passed
+            }
+            current = output;
+            if (output.traceSlot != NO_TRACE)
+            {
+                trace = {output.traceSlot, output.traceCycles, 0};
+                tracePosted = output.tracePostedMicros;
+            }
+        }
+
+        if (holding)
+        {
+            // The alarm can only write a duty on the running timer settings
+            bool exact = held.mode == OutputMode::Steady && current.mode == OutputMode::Steady &&
+                         held.frequency == appliedFrequency && held.resolution == appliedResolution &&
+                         !waveform.running() && !sampleStream.running();
+            if (outputScheduler.fired())
+            {
+                appliedDuty = outputScheduler.firedDuty();
+                reportScheduledOutput({held.applyAt, outputScheduler.firedAt(), true});
+                outputScheduler.cancel();
+                current = held;
+                holding = false;
+            }
+            else if (!outputScheduler.armed() && exact && held.applyAt <= now + SCHEDULE_ARM_US)
+            {
+                outputScheduler.arm(PWM_CHANNEL, held.on ? held.duty : 0, held.applyAt);
+            }
+            else if (held.applyAt + (outputScheduler.armed() ? SCHEDULE_ARM_US : 0) <= now)
+            {
+                // Not a plain duty change, or the alarm never came
+                outputScheduler.cancel();
+                reportScheduledOutput({held.applyAt, now, false});
+                current = held;
+                holding = false;
+            }
+        }
+
+        // A timer ISR leaves the output at whatever sample it wrote last
+        if (waveform.running() && (current.mode != OutputMode::Waveform || waveform.finished()))
+        {
+            waveform.stop();
+            appliedDuty = UINT32_MAX;
+        }
+        if (sampleStream.running() && (current.mode != OutputMode::Stream || sampleStream.starved()))
+        {
+            sampleStream.stop();
+            appliedDuty = UINT32_MAX;
+        }
+
+        if (current.frequency != appliedFrequency || current.resolution != appliedResolution)
+        {
+            ledcChangeFrequency(PWM_CHANNEL, current.frequency, current.resolution);
+            appliedFrequency = current.frequency;
+            appliedResolution = current.resolution;
+            appliedDuty = UINT32_MAX; // duty counts changed meaning
+        }
+
+        if (current.mode != OutputMode::Steady && current.modeRun != startedRun)
+        {
+            startedRun = current.modeRun;
+            if (current.mode == OutputMode::Waveform)
+            {
+                waveform.start(PWM_CHANNEL);
+            }
+            else if (current.mode == OutputMode::Stream)
+            {
+                sampleStream.start(PWM_CHANNEL);
+            }
+            else
+            {
+                // Take over from the steady duty without a bump
+                uint32_t maxDuty = (1u << appliedResolution) - 1;
+                portENTER_CRITICAL(&powerLock);
+                powerController.reset((current.duty * PowerController::OUTPUT_MAX + maxDuty / 2) / maxDuty);
+                portEXIT_CRITICAL(&powerLock);
+            }
+        }
+
+        if (!waveform.running() && !sampleStream.running())
+        {
+            uint32_t duty = current.on ? current.duty : 0;
+            if (current.on && current.mode == OutputMode::PowerLoop)
+            {
+                int32_t measurement = adcSampler.latest(); // POWER_START needs the sampler running
+                portENTER_CRITICAL(&powerLock);
+                uint32_t setpoint = powerController.update(measurement);
+                portEXIT_CRITICAL(&powerLock);
+                uint32_t maxDuty = (1u << appliedResolution) - 1;
+                duty = (setpoint * maxDuty + PowerController::OUTPUT_MAX / 2) / PowerController::OUTPUT_MAX;
+            }
+            if (duty != appliedDuty)
+            {
+                ledcWrite(PWM_CHANNEL, duty);
+                appliedDuty = duty;
+            }
+        }
+
+        uint16_t divider = telemetryDivider;
+        if (divider != 0 && ++telemetryTicks >= divider)
+        {
+            telemetryTicks = 0;
+            uint32_t duty = waveform.running()       ? waveform.lastDuty()
+                            : sampleStream.running() ? sampleStream.lastDuty()
+                                                     : appliedDuty;
+            uint8_t flags = (current.on || calibrating ? TELEMETRY_FLAG_LASER_ON : 0) |
+                            (calibrating ? TELEMETRY_FLAG_CALIBRATING : 0) |
+                            (adcSampler.running() ? TELEMETRY_FLAG_A0_FILTERED : 0);
+            TelemetryRecord record = {telemetrySequence++, (uint32_t)micros(), (uint16_t)duty,
+                                      adcSampler.running() ? adcSampler.latest() : lastOneShotA0, flags,
+                                      (uint8_t)current.mode};
+            if (!telemetryQueue.push(record))
+            {
+                telemetryOverruns++;
+            }
+        }
+
+        if (trace.slot != NO_TRACE)
+        {
+            trace.applyMicros = micros() - tracePosted;
+            latencyApplyQueue.push(trace);
+            trace.slot = NO_TRACE;
+        }
+
+        vTaskDelayUntil(&lastWake, LASER_TASK_PERIOD);
+    }
+}
+
+// ==================== WAVEFORM FUNCTIONS ====================
+// Rebuilds the table from the current parameters. While playing, the new
+// table takes over at the next cycle boundary.
+void updateWaveform()
+{
+    static uint16_t table[WAVE_TABLE_SIZE];
+    generateWave(waveShape, waveAmplitude, waveOffset, wavePoints, wavePointCount, table);
+    for (size_t i = 0; i < WAVE_TABLE_SIZE; i++)
+    {
+        table[i] = (uint16_t)setpointToDuty(table[i]);
+    }
+    waveform.loadTable(table, waveFrequency);
+}
+
+// Playback implies the laser is on; it returns to the steady setpoint when
+// the cycle count runs out or on WAVE_STOP
+void startWaveform()
+{
+    updateWaveform();
+    waveform.rearm();
+    laserState = true;
+    outputMode = OutputMode::Waveform;
+    outputModeRun++;
+    postLaserOutput();
+}
+
+void stopWaveform()
+{
+    if (outputMode == OutputMode::Waveform)
+    {
+        outputMode = OutputMode::Steady;
+        postLaserOutput();
+    }
+}
+
+void setWaveShape(int32_t shape)
+{
+    if ((WaveShape)shape == WaveShape::Arbitrary && wavePointCount == 0)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "No waveform points uploaded");
+        return;
+    }
+    waveShape = (WaveShape)shape;
+    updateWaveform();
+}
+
+void setWaveFrequency(int32_t milliHz)
+{
+    if ((uint64_t)milliHz * 2 > (uint64_t)waveform.getSampleRate() * 1000)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Waveform frequency above half the sample rate");
+        return;
+    }
+    waveFrequency = milliHz;
+    updateWaveform();
+}
+
+void setWaveSampleRate(int32_t hz)
+{
+    if (outputMode == OutputMode::Waveform)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Stop the waveform before changing the sample rate");
+        return;
+    }
+    if ((uint64_t)waveFrequency * 2 > (uint64_t)hz * 1000)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Sample rate below twice the waveform frequency");
+        return;
+    }
+    waveform.setSampleRate(hz);
+    updateWaveform();
+}
+
+void sendWaveformStatus()
+{
+    WaveTiming timing = waveform.timing();
+    uint32_t cpuMhz = ESP.getCpuFreqMHz();
+    uint32_t intervals = timing.samples > 1 ? timing.samples - 1 : 0;
+    uint32_t minCycles = intervals ? timing.minCycles : 0;
+    uint32_t meanCycles = intervals ? (uint32_t)(timing.totalCycles / intervals) : 0;
+    uint32_t jitterCycles = 0;
+    if (intervals)
+    {
+        uint32_t late = timing.maxCycles - timing.expectedCycles;
+        uint32_t early = timing.expectedCycles - timing.minCycles;
+        jitterCycles = timing.maxCycles > timing.expectedCycles ? late : 0;
+        if (timing.minCycles < timing.expectedCycles && early > jitterCycles)
+        {
+            jitterCycles = early;
+        }
+    }
+
+    // Intervals are reported in hundredths of a microsecond
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "waveform")
+        .boolField("running", outputMode == OutputMode::Waveform)
+        .uintField("shape", (uint32_t)waveShape)
+        .uintField("frequency_mhz", waveFrequency)
+        .uintField("amplitude_permille", waveAmplitude)
+        .uintField("offset_permille", waveOffset)
+        .uintField("points", wavePointCount)
+        .uintField("sample_rate_hz", waveform.getSampleRate())
+        .uintField("cycles_done", waveform.completedCycles())
+        .uintField("cycles_target", waveform.getTargetCycles())
+        .uintField("samples", timing.samples)
+        .fixedField("interval_expected_us", timing.expectedCycles * 100 / cpuMhz, 2)
+        .fixedField("interval_min_us", minCycles * 100 / cpuMhz, 2)
+        .fixedField("interval_max_us", timing.maxCycles * 100 / cpuMhz, 2)
+        .fixedField("interval_mean_us", meanCycles * 100 / cpuMhz, 2)
+        .fixedField("jitter_max_us", jitterCycles * 100 / cpuMhz, 2)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// ==================== STREAMING FUNCTIONS ====================
+// STREAM_START, then STREAM_DATA blocks; playout begins once the prefill
+// level is reached. Pace sends from the periodic fill reports.
+void startStream()
+{
+    if (outputMode == OutputMode::Stream)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Already streaming");
+        return;
+    }
+    // After STREAM_STOP the laser task stops the timer on its next tick;
+    // until then the ISR is still the queue's consumer
+    if (sampleStream.running())
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Stream stopping");
+        return;
+    }
+
+    sampleStream.clear();
+    laserState = true;
+    outputMode = OutputMode::Stream;
+    outputModeRun++;
+    lastStreamReport = millis();
+    postLaserOutput();
+}
+
+void pushStreamSample(int32_t permille)
+{
+    if (outputMode != OutputMode::Stream)
+    {
+        rejectCommand();
+        return;
+    }
+    sampleStream.push((uint16_t)setpointToDuty(((uint32_t)permille * LASER_SETPOINT_MAX + 500) / 1000));
+}
+
+void setStreamSampleRate(int32_t hz)
+{
+    if (outputMode == OutputMode::Stream)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Stop the stream before changing the sample rate");
+        return;
+    }
+    sampleStream.setSampleRate(hz);
+}
+
+void sendStreamStatus(TxClass cls)
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "stream")
+        .boolField("running", outputMode == OutputMode::Stream)
+        .uintField("fill", sampleStream.fill())
+        .uintField("capacity", SampleStream::CAPACITY)
+        .uintField("prefill", sampleStream.getPrefill())
+        .uintField("sample_rate_hz", sampleStream.getSampleRate())
+        .uintField("played", sampleStream.playedSamples())
+        .uintField("underruns", sampleStream.underrunCount())
+        .uintField("overruns", sampleStream.overrunCount())
+        .endObject()
+        .endLine();
+    sendJson(cls, json);
+}
+
+// ==================== POWER CONTROL FUNCTIONS ====================
+// POWER_START hands the output to the PID in the laser task; it starts from
+// the current brightness and holds A0 at POWER_TARGET until stopped.
+// The PID needs a fresh reading every millisecond, so it only runs while the
+// DMA sampler is running.
+void startPowerControl()
+{
+    if (!adcSampler.running())
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Power loop needs ADC_START");
+        return;
+    }
+    laserState = true;
+    outputMode = OutputMode::PowerLoop;
+    outputModeRun++;
+    reportedSettling = 0;
+    postLaserOutput();
+}
+
+void stopPowerControl()
+{
+    if (outputMode == OutputMode::PowerLoop)
+    {
+        outputMode = OutputMode::Steady;
+        postLaserOutput();
+    }
+}
+
+void setPowerTarget(int32_t counts)
+{
+    portENTER_CRITICAL(&powerLock);
+    powerController.setTarget(counts);
+    portEXIT_CRITICAL(&powerLock);
+    reportedSettling = 0;
+    settings.putUInt("pc_target", counts);
+}
+
+void setPowerGain(int32_t *gain, const char *key, int32_t value)
+{
+    *gain = value;
+    portENTER_CRITICAL(&powerLock);
+    powerController.setGains(powerKp, powerKi, powerKd);
+    portEXIT_CRITICAL(&powerLock);
+    settings.putInt(key, value);
+}
+
+void loadPowerControlFromPreferences()
+{
+    powerKp = constrain(settings.getInt("pc_kp", powerKp), 0, PowerController::GAIN_MAX);
+    powerKi = constrain(settings.getInt("pc_ki", powerKi), 0, PowerController::GAIN_MAX);
+    powerKd = constrain(settings.getInt("pc_kd", powerKd), 0, PowerController::GAIN_MAX);
+    powerController.setGains(powerKp, powerKi, powerKd);
+    powerController.setTarget(settings.getUInt("pc_target", PowerController::ADC_MAX / 2));
+}
+
+void sendPowerStatus()
+{
+    portENTER_CRITICAL(&powerLock);
+    PowerTelemetry telemetry = powerController.telemetry();
+    int32_t target = powerController.getTarget();
+    portEXIT_CRITICAL(&powerLock);
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "power")
+        .boolField("running", outputMode == OutputMode::PowerLoop)
+        .intField("target", target)
+        .intField("measurement", telemetry.lastMeasurement)
+        .intField("error", telemetry.lastError)
+        .uintField("output_setpoint", telemetry.lastOutput)
+        .intField("kp_q8", powerKp)
+        .intField("ki_q8", powerKi)
+        .intField("kd_q8", powerKd)
+        .boolField("settled", telemetry.settlingTicks != 0)
+        .uintField("settling_ms", telemetry.settlingTicks) // one tick per ms
+        .fixedField("mean_error", telemetry.meanErrorCenti, 2)
+        .uintField("peak_error", telemetry.peakError)
+        .uintField("saturated_ms", telemetry.saturatedTicks)
+        .uintField("control_ms", telemetry.ticks)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// ==================== CALIBRATION FUNCTIONS ====================
+// Everything that turns a setpoint into duty goes through setpointToDuty(),
+// so a profile change only has to refresh the values derived from it.
+void refreshCalibratedOutput()
+{
+    laserDuty = setpointToDuty(laserSetpoint);
+    updateWaveform();
+    postLaserOutput();
+}
+
+void loadCalibrationFromPreferences()
+{
+    uint8_t profile = settings.getUChar("cal_prof", 0);
+    if (profile > CAL_PROFILES || !selectCalibrationProfile(profile))
+    {
+        calibration.clear();
+        calibrationProfile = 0;
+    }
+}
+
+bool selectCalibrationProfile(uint8_t profile)
+{
+    if (profile == 0)
+    {
+        calibration.clear();
+    }
+    else
+    {
+        uint16_t curve[CAL_POINTS];
+        if (settings.getBytes(CAL_KEYS[profile - 1], curve, sizeof(curve)) != sizeof(curve) ||
+            !calibration.load(curve))
+        {
+            return false;
+        }
+    }
+
+    calibrationProfile = profile;
+    settings.putUChar("cal_prof", profile);
+    return true;
+}
+
+// Stores a curve and activates it if it belongs to the selected profile
+bool saveCalibrationCurve(uint8_t profile, const uint16_t curve[CAL_POINTS])
+{
+    Calibration check;
+    if (!check.load(curve) || !settings.putBytes(CAL_KEYS[profile - 1], curve, CAL_POINTS * sizeof(uint16_t)))
+    {
+        return false;
+    }
+    if (profile == calibrationProfile)
+    {
+        calibration = check;
+        refreshCalibratedOutput();
+    }
+    return true;
+}
+
+// Sweeps raw duty with the laser on, then fits, saves and selects the
+// profile. Runs from loop() a step at a time; LASER_OFF aborts it.
+void startCalibration(uint8_t profile)
+{
+    if (calibrating)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Calibration already running");
+        return;
+    }
+
+    calibrating = true;
+    sweepProfile = profile;
+    sweepStep = 0;
+    sweepSum = 0;
+    sweepReads = 0;
+    sweepDuty = 0;
+    sweepStepStart = millis();
+    postLaserOutput();
+    sendLinef(TxClass::Event, "Calibrating profile %u...", profile);
+}
+
+void stopCalibration(const char *reason)
+{
+    if (!calibrating)
+    {
+        return;
+    }
+    calibrating = false;
+    postLaserOutput();
+    sendLinef(TxClass::Event, "Calibration aborted: %s", reason);
+}
+
+void serviceCalibration()
+{
+    if (!calibrating || millis() - sweepStepStart < CAL_SETTLE_MS)
+    {
+        return;
+    }
+
+    sweepSum += readAnalogA0();
+    if (++sweepReads < CAL_READS_PER_STEP)
+    {
+        return;
+    }
+    sweepReadings[sweepStep++] = (uint16_t)((sweepSum + CAL_READS_PER_STEP / 2) / CAL_READS_PER_STEP);
+    sweepSum = 0;
+    sweepReads = 0;
+
+    if (sweepStep < CAL_SWEEP_STEPS)
+    {
+        uint32_t setpoint = (uint32_t)(sweepStep * LASER_SETPOINT_MAX / (CAL_SWEEP_STEPS - 1));
+        sweepDuty = setpointToRawDuty(setpoint);
+        sweepStepStart = millis();
+        postLaserOutput();
+        return;
+    }
+
+    calibrating = false;
+    uint16_t curve[CAL_POINTS];
+    Calibration::fitMonotonic(sweepReadings, CAL_SWEEP_STEPS, curve);
+    if (!saveCalibrationCurve(sweepProfile, curve))
+    {
+        postLaserOutput();
+        sendLine(TxClass::Event, "Calibration failed: A0 barely changed over the sweep");
+        return;
+    }
+    // Saving already refreshed the output if the profile was selected
+    if (sweepProfile != calibrationProfile)
+    {
+        selectCalibrationProfile(sweepProfile);
+        refreshCalibratedOutput();
+    }
+    sendCalibration(sweepProfile);
+}
+
+void beginCalibrationUpload(uint8_t profile)
+{
+    uploadProfile = profile;
+    uploadCount = 0;
+}
+
+void addCalibrationPoint(int32_t reading)
+{
+    if (uploadProfile == 0)
+    {
+        rejectCommand(); // no CAL_WRITE first
+        return;
+    }
+    uploadCurve[uploadCount++] = (uint16_t)reading;
+    if (uploadCount < CAL_POINTS)
+    {
+        return;
+    }
+
+    uint8_t profile = uploadProfile;
+    uploadProfile = 0;
+    if (saveCalibrationCurve(profile, uploadCurve))
+    {
+        sendLinef(TxClass::Response, "Calibration profile %u saved", profile);
+    }
+    else
+    {
+        rejectCommand();
+        sendLinef(TxClass::Response, "Calibration rejected: readings must not decrease and must rise by at least %u", CAL_MIN_SPAN);
+    }
+}
+
+void sendCalibration(uint8_t profile)
+{
+    uint16_t curve[CAL_POINTS];
+    bool valid = settings.getBytes(CAL_KEYS[profile - 1], curve, sizeof(curve)) == sizeof(curve);
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "calibration")
+        .uintField("profile", profile)
+        .boolField("active", profile == calibrationProfile)
+        .boolField("valid", valid)
+        .uintField("setpoint_step", 4096)
+        .uintArrayField("readings", curve, valid ? CAL_POINTS : 0)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// ==================== PREFERENCES FUNCTIONS ====================
+void saveBrightnessToPreferences()
+{
+    settings.putUInt("setpoint", laserSetpoint);
+}
+
+void loadBrightnessFromPreferences()
+{
+    // Older firmware stored whole percent under "brightness"; default to 50%
+    uint32_t setpoint;
+    if (preferences.isKey("setpoint"))
+    {
+        setpoint = settings.getUInt("setpoint", LASER_SETPOINT_MAX / 2);
+    }
+    else
+    {
+        int brightness = constrain(preferences.getInt("brightness", 50), 0, 100);
+        setpoint = ((uint32_t)brightness * LASER_SETPOINT_MAX + 50) / 100;
+        if (preferences.isKey("brightness"))
+        {
+            settings.putUInt("setpoint", setpoint);
+            settings.remove("brightness");
+        }
+    }
+
+    // Ensure the value is within valid range
+    laserSetpoint = setpoint > LASER_SETPOINT_MAX ? LASER_SETPOINT_MAX : setpoint;
+    laserBrightness = (laserSetpoint * 100 + LASER_SETPOINT_MAX / 2) / LASER_SETPOINT_MAX;
+
+    // Update PWM value based on loaded brightness
+    laserDuty = setpointToDuty(laserSetpoint);
+}
+
+void savePwmConfigToPreferences()
+{
+    settings.putUInt("pwm_freq", pwmFrequency);
+    settings.putUChar("pwm_res", pwmResolution);
+}
+
+void loadPwmConfigFromPreferences()
+{
+    uint32_t frequency = settings.getUInt("pwm_freq", PWM_FREQ);
+    uint8_t resolution = settings.getUChar("pwm_res", PWM_RESOLUTION);
+
+    // Fall back to the defaults if the stored pair is not usable
+    if (!configurePwm(frequency, resolution))
+    {
+        configurePwm(PWM_FREQ, PWM_RESOLUTION);
+    }
+}
+
+// ==================== COMMUNICATION FUNCTIONS ====================
+// Keyframe when the heartbeat interval is up, otherwise whatever changed
+void publishTelemetry()
+{
+    int32_t values[TELEMETRY_FIELDS];
+    sampleTelemetry(values);
+
+    unsigned long now = millis();
+    if (now - lastHeartbeat > (unsigned long)heartbeatInterval)
+    {
+        profileScopes[PROFILE_HEARTBEAT_LATE].record((now - lastHeartbeat - heartbeatInterval) * 1000);
+        sendTelemetry(TxClass::Heartbeat, "heartbeat", telemetry.collectKeyframe(values, now), values);
+        lastHeartbeat = now;
+        return;
+    }
+
+    // Events, not heartbeats: heartbeats coalesce and would lose changes
+    uint32_t changed = telemetry.collectChanges(values, now);
+    if (changed != 0)
+    {
+        sendTelemetry(TxClass::Event, "telemetry", changed, values);
+    }
+}
+
+void sampleTelemetry(int32_t values[])
+{
+    values[TELEMETRY_LASER_STATE] = laserState;
+    values[TELEMETRY_LASER_BRIGHTNESS] = laserBrightness;
+    values[TELEMETRY_LASER_DUTY] = laserDuty;
+    values[TELEMETRY_OUTPUT_MODE] = (int32_t)outputMode;
+    values[TELEMETRY_CALIBRATION_PROFILE] = calibrationProfile;
+    // A one-shot read costs tens of microseconds; only take it when asked for
+    values[TELEMETRY_ANALOG_A0] = telemetry.subscribed() & (1u << TELEMETRY_ANALOG_A0) ? readAnalogA0() : 0;
+    values[TELEMETRY_FREE_HEAP] = ESP.getFreeHeap();
+    values[TELEMETRY_TX_DROPPED] = txQueue.totals().droppedMessages;
+}
+
+void sendTelemetry(TxClass cls, const char *type, uint32_t fields, const int32_t values[])
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", type)
+        .uintField("uptime_ms", millis() - bootTime);
+    for (size_t i = 0; i < TELEMETRY_FIELDS; i++)
+    {
+        if ((fields & (1u << i)) == 0)
+        {
+            continue;
+        }
+        if (i == TELEMETRY_LASER_STATE)
+        {
+            json.boolField(TELEMETRY_NAMES[i], values[i] != 0);
+        }
+        else
+        {
+            json.intField(TELEMETRY_NAMES[i], values[i]);
+        }
+    }
+    json.endObject().endLine();
+    sendJson(cls, json);
+}
+
+// HB_FIELD:field,min_ms,max_ms,deadband
+void configureTelemetryField()
+{
+    TelemetryFieldConfig config = {(uint32_t)commandFields[1], (uint32_t)commandFields[2], (uint32_t)commandFields[3]};
+    if (commandFieldCount != COMMAND_FIELDS || !telemetry.configure(commandFields[0], config))
+    {
+        rejectCommand();
+    }
+}
+
+void sendTelemetryConfig()
+{
+    startPagedReply(sendTelemetryConfigLine);
+}
+
+// One line per field id
+PageLine sendTelemetryConfigLine(size_t line)
+{
+    if (line >= TELEMETRY_FIELDS)
+    {
+        return PageLine::End;
+    }
+    const TelemetryFieldConfig &config = telemetry.config(line);
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "hb_field")
+        .uintField("id", line)
+        .stringField("name", TELEMETRY_NAMES[line])
+        .boolField("subscribed", telemetry.subscribed() & (1u << line))
+        .uintField("min_ms", config.minIntervalMs)
+        .uintField("max_ms", config.maxIntervalMs)
+        .uintField("deadband", config.deadband)
+        .endObject()
+        .endLine();
+    return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
+}
+
+// Rounded to a whole number of laser task ticks; the ACK carries the rate
+// actually used
+void setTelemetryStreamRate(int32_t hz)
+{
+    uint16_t divider = hz == 0 ? 0 : (uint16_t)((TELEMETRY_MAX_RATE + hz / 2) / hz);
+    telemetryDivider = divider;
+    setAppliedValue(divider == 0 ? 0 : TELEMETRY_MAX_RATE / divider);
+}
+
+// FRAME_TELEMETRY, layout in TelemetryRecord.h. Frames only, like
+// PROFILE_STREAM: records taken outside binary mode are dropped.
+void sendTelemetryRecords()
+{
+    uint8_t payload[TELEMETRY_FRAME_HEADER_SIZE + TELEMETRY_FRAME_RECORDS * TELEMETRY_RECORD_SIZE];
+    size_t count = 0;
+    TelemetryRecord record;
+    while (telemetryQueue.pop(record))
+    {
+        if (!binaryMode)
+        {
+            continue;
+        }
+        packTelemetryRecord(record, payload + TELEMETRY_FRAME_HEADER_SIZE + count * TELEMETRY_RECORD_SIZE);
+        count++;
+        if (count == TELEMETRY_FRAME_RECORDS || telemetryQueue.empty())
+        {
+            payload[0] = TELEMETRY_LAYOUT_VERSION;
+            payload[1] = TELEMETRY_RECORD_SIZE;
+            payload[2] = (uint8_t)count;
+            sendFrame(TxClass::Stream, FRAME_TELEMETRY, payload, TELEMETRY_FRAME_HEADER_SIZE + count * TELEMETRY_RECORD_SIZE);
+            count = 0;
+        }
+    }
+}
+
+void sendTelemetryLayout()
+{
+    startPagedReply(sendTelemetryLayoutLine);
+}
+
+// Line 0 is the header, then one line per record field
+PageLine sendTelemetryLayoutLine(size_t line)
+{
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    if (line == 0)
+    {
+        uint16_t divider = telemetryDivider;
+        json.beginObject()
+            .stringField("type", "telemetry_layout")
+            .uintField("version", TELEMETRY_LAYOUT_VERSION)
+            .uintField("frame_opcode", FRAME_TELEMETRY)
+            .uintField("header_size", TELEMETRY_FRAME_HEADER_SIZE)
+            .uintField("record_size", TELEMETRY_RECORD_SIZE)
+            .uintField("rate_hz", divider == 0 ? 0 : TELEMETRY_MAX_RATE / divider)
+            .uintField("records_overrun", telemetryOverruns)
+            .uintField("frames_dropped", txQueue.stats(TxClass::Stream).droppedMessages)
+            .endObject()
+            .endLine();
+    }
+    else if (line <= TELEMETRY_LAYOUT_FIELDS)
+    {
+        const TelemetryFieldInfo &field = TELEMETRY_LAYOUT[line - 1];
+        json.beginObject()
+            .stringField("type", "telemetry_field")
+            .stringField("name", field.name)
+            .uintField("offset", field.offset)
+            .uintField("size", field.size)
+            .endObject()
+            .endLine();
+    }
+    else
+    {
+        return PageLine::End;
+    }
+    return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
+}
+
+// Taken once at boot, so it counts towards setup_allocations only
+void allocateHistory()
+{
+    HistorySample *raw = nullptr;
+    HistoryRollup *seconds = nullptr;
+    HistoryRollup *minutes = nullptr;
+    const size_t *rows = HISTORY_INTERNAL_ROWS;
+#ifdef ESP_PLATFORM
+    if (ESP.getPsramSize() > 0)
+    {
+        raw = (HistorySample *)ps_malloc(HISTORY_PSRAM_ROWS[HISTORY_RAW] * sizeof(HistorySample));
+        seconds = (HistoryRollup *)ps_malloc(HISTORY_PSRAM_ROWS[HISTORY_SECONDS] * sizeof(HistoryRollup));
+        minutes = (HistoryRollup *)ps_malloc(HISTORY_PSRAM_ROWS[HISTORY_MINUTES] * sizeof(HistoryRollup));
+        historyInPsram = raw != nullptr && seconds != nullptr && minutes != nullptr;
+        if (historyInPsram)
+        {
+            rows = HISTORY_PSRAM_ROWS;
+        }
+        else
+        {
+            free(raw);
+            free(seconds);
+            free(minutes);
+        }
+    }
+#endif
+    if (!historyInPsram)
+    {
+        raw = (HistorySample *)malloc(rows[HISTORY_RAW] * sizeof(HistorySample));
+        seconds = (HistoryRollup *)malloc(rows[HISTORY_SECONDS] * sizeof(HistoryRollup));
+        minutes = (HistoryRollup *)malloc(rows[HISTORY_MINUTES] * sizeof(HistoryRollup));
+    }
+    history.begin(raw, rows[HISTORY_RAW], seconds, rows[HISTORY_SECONDS], minutes, rows[HISTORY_MINUTES]);
+}
+
+void recordHistory()
+{
+    unsigned long now = millis();
+    if (now - lastHistorySample < HISTORY_RAW_INTERVAL)
+    {
+        return;
+    }
+    lastHistorySample = now;
+
+    int32_t values[HISTORY_CHANNELS] = {laserBrightness, laserState ? 1000 : 0, readAnalogA0(),
+                                        (int32_t)ESP.getFreeHeap(), (int32_t)historyLoopMaxUs};
+    history.record(now, values);
+    historyLoopMaxUs = 0;
+}
+
+// Frames only; rows written meanwhile are left for the next dump
+void startHistoryDump(uint8_t tier)
+{
+    if (!binaryMode)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "HISTORY_DUMP needs binary mode");
+        return;
+    }
+    historyDumpTier = tier;
+    historyDumpNext = history.oldest(tier);
+    historyDumpEnd = history.written(tier);
+    setAppliedValue(historyDumpEnd - historyDumpNext);
+}
+
+// Sends as many rows as the response ring takes while keeping a frame's
+// worth free for replies to other commands. Rows overwritten before their
+// turn are skipped, which shows as a jump in the frame index.
+void serviceHistoryDump()
+{
+    if (historyDumpTier < 0)
+    {
+        return;
+    }
+    if (!binaryMode)
+    {
+        historyDumpTier = -1;
+        return;
+    }
+
+    uint8_t tier = (uint8_t)historyDumpTier;
+    size_t rowSize = TelemetryHistory::rowSize(tier);
+    size_t rowsPerFrame = (FRAME_MAX_PAYLOAD - HISTORY_FRAME_HEADER_SIZE) / rowSize;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    while (txQueue.freeBytes(TxClass::Response) >= 2 * (FRAME_MAX_ENCODED + 2))
+    {
+        if (historyDumpNext < history.oldest(tier))
+        {
+            historyDumpNext = history.oldest(tier);
+        }
+        size_t count = 0;
+        while (count < rowsPerFrame && historyDumpNext + count < historyDumpEnd &&
+               history.packRow(tier, historyDumpNext + count, payload + HISTORY_FRAME_HEADER_SIZE + count * rowSize))
+        {
+            count++;
+        }
+
+        payload[0] = tier;
+        payload[1] = HISTORY_ROW_VERSION;
+        payload[2] = (uint8_t)rowSize;
+        payload[3] = (uint8_t)count;
+        writeInt32LE(payload + 4, (int32_t)historyDumpNext);
+        sendFrame(TxClass::Response, FRAME_HISTORY, payload, HISTORY_FRAME_HEADER_SIZE + count * rowSize);
+        historyDumpNext += count;
+        if (count == 0)
+        {
+            historyDumpTier = -1; // that was the end marker
+            return;
+        }
+    }
+}
+
+void sendHistoryStatus()
+{
+    startPagedReply(sendHistoryStatusLine);
+}
+
+// Line 0 is the header, then one line per tier
+PageLine sendHistoryStatusLine(size_t line)
+{
+    static const uint32_t TIER_INTERVALS[HISTORY_TIERS] = {HISTORY_RAW_INTERVAL, TelemetryHistory::SECOND_MS,
+                                                           TelemetryHistory::MINUTE_MS};
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    if (line == 0)
+    {
+        json.beginObject()
+            .stringField("type", "history")
+            .stringField("channels", HISTORY_CHANNEL_NAMES)
+            .boolField("psram", historyInPsram)
+            .uintField("row_version", HISTORY_ROW_VERSION)
+            .endObject()
+            .endLine();
+    }
+    else if (line <= HISTORY_TIERS)
+    {
+        uint8_t tier = (uint8_t)(line - 1);
+        json.beginObject()
+            .stringField("type", "history_tier")
+            .uintField("tier", tier)
+            .uintField("interval_ms", TIER_INTERVALS[tier])
+            .uintField("capacity", history.capacity(tier))
+            .uintField("rows", history.written(tier) - history.oldest(tier))
+            .uintField("written", history.written(tier))
+            .uintField("row_size", TelemetryHistory::rowSize(tier))
+            .endObject()
+            .endLine();
+    }
+    else
+    {
+        return PageLine::End;
+    }
+    return sendJson(TxClass::Response, json) ? PageLine::Next : PageLine::Retry;
+}
+
+void sendStatusUpdate()
+{
+    int analogValue = readAnalogA0();
+    TxStats tx = txQueue.totals();
+    const SettingsStats &nvs = settings.stats();
+
+    char timestamp[32];
+    getFormattedTime(timestamp, sizeof(timestamp));
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "status")
+        .uintField("uptime_ms", millis() - bootTime)
+        .uintField("free_heap_bytes", ESP.getFreeHeap())
+        .uintField("total_heap_bytes", ESP.getHeapSize())
+        .uintField("runtime_allocations", allocationStats().allocations - setupAllocations)
+        .boolField("laser_state", laserState)
+        .intField("laser_brightness", laserBrightness)
+        .intField("laser_pwm_value", laserDuty)
+        .uintField("laser_setpoint", laserSetpoint)
+        .uintField("pwm_max_duty", pwmMaxDuty)
+        .uintField("pwm_frequency_hz", pwmFrequency)
+        .uintField("pwm_resolution_bits", pwmResolution)
+        .uintField("calibration_profile", calibrationProfile)
+        .intField("analog_a0", analogValue)
+        .fixedField("voltage_a0", getCentivoltsFromAnalog(analogValue), 2)
+        .uintField("cpu_freq_mhz", ESP.getCpuFreqMHz())
+        .stringField("timestamp", timestamp)
+        .stringField("version", FIRMWARE_VERSION)
+        .boolField("heartbeat_enabled", heartbeatEnabled)
+        .uintField("baud", baudRate)
+        .uintField("baud_switches", baudSwitches)
+        .uintField("baud_reverts", baudReverts)
+        .uintField("tx_queued_bytes", tx.queuedBytes)
+        .uintField("tx_pending_bytes", txQueue.pendingBytes())
+        .uintField("tx_dropped_bytes", tx.droppedBytes)
+        .uintField("tx_dropped_messages", tx.droppedMessages)
+        .uintField("tx_coalesced_messages", tx.coalescedMessages)
+        .uintField("nvs_pending_keys", settings.pendingKeys())
+        .uintField("nvs_commits", nvs.commits)
+        .uintField("nvs_writes", nvs.writes)
+        .uintField("nvs_erases", nvs.erases)
+        .uintField("nvs_commit_us_last", nvs.lastCommitUs)
+        .uintField("nvs_commit_us_max", nvs.maxCommitUs)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// Steady state should not allocate: runtime_allocations is expected to stay 0
+void sendAllocationStats()
+{
+    AllocStats stats = allocationStats();
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "alloc")
+        .boolField("counting", allocationCounting())
+        .uintField("allocations", stats.allocations)
+        .uintField("frees", stats.frees)
+        .uintField("failures", stats.failures)
+        .uintField("setup_allocations", setupAllocations)
+        .uintField("runtime_allocations", stats.allocations - setupAllocations)
+        .uintField("free_heap_bytes", ESP.getFreeHeap())
+        .uintField("largest_free_block", ESP.getMaxAllocHeap())
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// Output is queued and written out by txQueue.pump() in loop(). Like
+// sendLine(), returns false when the class's ring had no room for it.
+bool sendJson(TxClass cls, const JsonWriter &json)
+{
+    if (!subscribed(cls))
+    {
+        return true;
+    }
+    // Truncated output is not valid JSON and has lost its "\r\n"; there is
+    // nothing to retry either
+    if (json.overflowed())
+    {
+        sendLine(TxClass::Log, "JSON message overflowed its buffer, not sent");
+        return true;
+    }
+    if (binaryMode)
+    {
+        // Frames carry their own delimiter, so drop the "\r\n"
+        size_t length = json.length();
+        if (length >= 2 && json.data()[length - 1] == '\n')
+        {
+            length -= 2;
+        }
+        return sendFrame(cls, FRAME_JSON, reinterpret_cast<const uint8_t *>(json.data()), length);
+    }
+    return txQueue.push(cls, json.data(), json.length());
+}
+
+bool sendLine(TxClass cls, const char *text)
+{
+    if (!subscribed(cls))
+    {
+        return true;
+    }
+    if (binaryMode)
+    {
+        return sendFrame(cls, FRAME_TEXT, reinterpret_cast<const uint8_t *>(text), strlen(text));
+    }
+    return txQueue.pushLine(cls, text, strlen(text));
+}
+
+// ==================== PAGED REPLIES ====================
+// Listings that can outgrow the response ring (HELP, ...) are written a
+// line at a time from loop() instead of all at once. Like HISTORY_DUMP,
+// lines go out only while a full reply to another command would still
+// fit beside them, and a line the ring turns away is written again on a
+// later pass rather than dropped. Replies to commands that arrive in the
+// meantime can come out between its lines.
+const size_t PAGE_RESERVE = 2 * ((JSON_MESSAGE_SIZE > FRAME_MAX_ENCODED ? JSON_MESSAGE_SIZE : FRAME_MAX_ENCODED) + 2);
+
+// One listing at a time; a second one is refused until the first is out.
+// Its first lines go out later in the same loop() pass.
+bool startPagedReply(PageLine (*writer)(size_t line))
+{
+    if (pageWriter != nullptr)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Previous listing still being sent");
+        return false;
+    }
+    pageWriter = writer;
+    pageLine = 0;
+    return true;
+}
+
+void servicePagedReply()
+{
+    while (pageWriter != nullptr && txQueue.freeBytes(TxClass::Response) >= PAGE_RESERVE)
+    {
+        PageLine result = pageWriter(pageLine);
+        if (result == PageLine::Retry)
+        {
+            return;
+        }
+        if (result == PageLine::End)
+        {
+            pageWriter = nullptr;
+            return;
+        }
+        pageLine++;
+    }
+}
+
+// printf-style; text beyond LINE_MESSAGE_SIZE is truncated
+void sendLinef(TxClass cls, const char *format, ...)
+{
+    char text[LINE_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    sendLine(cls, text);
+}
+
+void sendSystemInfo()
+{
+    sendLinef(TxClass::Response, "ESP32-S3 Laser Controller System Information v%s", FIRMWARE_VERSION);
+    sendLinef(TxClass::Response, "Hardware: %s Rev %d", ESP.getChipModel(), (int)ESP.getChipRevision());
+    sendLinef(TxClass::Response, "CPU Frequency: %lu MHz", (unsigned long)ESP.getCpuFreqMHz());
+    sendLinef(TxClass::Response, "Flash Size: %lu MB", (unsigned long)(ESP.getFlashChipSize() / 1024 / 1024));
+    sendLinef(TxClass::Response, "Heap Size: %lu bytes", (unsigned long)ESP.getHeapSize());
+    sendLinef(TxClass::Response, "Free Heap: %lu bytes", (unsigned long)ESP.getFreeHeap());
+    sendLinef(TxClass::Response, "SDK Version: %s", ESP.getSdkVersion());
+    sendLinef(TxClass::Response, "Build: %s %s", BUILD_DATE, BUILD_TIME);
+    char uptime[32];
+    getFormattedUptime(uptime, sizeof(uptime));
+    sendLinef(TxClass::Response, "Boot Time: %s", uptime);
+    sendLinef(TxClass::Response, "Laser Pin: GPIO %d", LASER_PIN);
+    sendLinef(TxClass::Response, "Laser State: %s", laserState ? "ON" : "OFF");
+    sendLinef(TxClass::Response, "Laser Brightness: %d%% (saved in preferences)", laserBrightness);
+    if (heartbeatEnabled)
+    {
+        sendLinef(TxClass::Response, "Heartbeat Interval: %d seconds", heartbeatInterval / 1000);
+    }
+}
+
+// ==================== UTILITY FUNCTIONS ====================
+void getFormattedTime(char *buffer, size_t size)
+{
+    unsigned long totalSeconds = (millis() - bootTime) / 1000;
+    unsigned long hours = totalSeconds / 3600;
+    unsigned long minutes = (totalSeconds % 3600) / 60;
+    unsigned long seconds = totalSeconds % 60;
+
+    snprintf(buffer, size, "%lu:%02lu:%02lu", hours, minutes, seconds);
+}
+
+void getFormattedUptime(char *buffer, size_t size)
+{
+    unsigned long totalSeconds = (millis() - bootTime) / 1000;
+    unsigned long days = totalSeconds / 86400;
+    unsigned long hours = (totalSeconds % 86400) / 3600;
+    unsigned long minutes = (totalSeconds % 3600) / 60;
+    unsigned long seconds = totalSeconds % 60;
+
+    if (days > 0)
+        snprintf(buffer, size, "%lud %luh %lum %lus", days, hours, minutes, seconds);
+    else if (hours > 0)
+        snprintf(buffer, size, "%luh %lum %lus", hours, minutes, seconds);
+    else if (minutes > 0)
+        snprintf(buffer, size, "%lum %lus", minutes, seconds);
+    else
+        snprintf(buffer, size, "%lus", seconds);
+}
+
+// Filtered value from the DMA sampler; one-shot conversion only while it is stopped
+// Not for the laser task: it reads adcSampler.latest() or lastOneShotA0
+int readAnalogA0()
+{
+    if (adcSampler.running())
+    {
+        return adcSampler.latest();
+    }
+    lastOneShotA0 = analogRead(DEFAULT_ANALOG_PIN);
+    return lastOneShotA0;
+}
+
+// The power loop cannot run on one-shot reads
+void stopAdcSampler()
+{
+    stopPowerControl();
+    adcSampler.stop();
+}
+
+// Rate and oversampling apply on (re)start
+void setAdcSampleRate(int32_t hz)
+{
+    bool wasRunning = adcSampler.running();
+    adcSampler.stop();
+    adcSampler.setSampleRate(hz);
+    if (wasRunning && !adcSampler.start(DEFAULT_ANALOG_PIN))
+    {
+        stopPowerControl();
+        rejectCommand();
+        sendLine(TxClass::Response, "ADC sampler failed to restart");
+    }
+}
+
+void setAdcOversample(int32_t count)
+{
+    bool wasRunning = adcSampler.running();
+    adcSampler.stop();
+    adcSampler.setOversample(count);
+    if (wasRunning && !adcSampler.start(DEFAULT_ANALOG_PIN))
+    {
+        stopPowerControl();
+        rejectCommand();
+        sendLine(TxClass::Response, "ADC sampler failed to restart");
+    }
+}
+
+void sendAdcStatus()
+{
+    AdcStats stats = adcSampler.stats();
+
+    char message[JSON_MESSAGE_SIZE];
+    JsonWriter json(message, sizeof(message));
+    json.beginObject()
+        .stringField("type", "adc")
+        .boolField("running", adcSampler.running())
+        .uintField("sample_rate_hz", adcSampler.getSampleRate())
+        .uintField("oversample", adcSampler.getOversample())
+        .uintField("output_rate_hz", adcSampler.getSampleRate() / adcSampler.getOversample())
+        .intField("latest", readAnalogA0())
+        .uintField("conversions", stats.conversions)
+        .uintField("decimated", stats.decimated)
+        .uintField("loss_events", stats.lossEvents)
+        .uintField("foreign_samples", stats.foreign)
+        .endObject()
+        .endLine();
+    sendJson(TxClass::Response, json);
+}
+
+// A0 reading in hundredths of a volt (0-3.3V over 0-4095), rounded
+int32_t getCentivoltsFromAnalog(int analogValue)
+{
+    return (analogValue * 330 + 2047) / 4095;
+}
+
+void printSystemStatus()
+{
+    sendLinef(TxClass::Response, "Board: %s @ %luMHz", ESP.getChipModel(), (unsigned long)ESP.getCpuFreqMHz());
+    sendLinef(TxClass::Response, "Memory: %lu/%lu bytes free", (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getHeapSize());
+    sendLinef(TxClass::Response, "Laser Pin: GPIO %d", LASER_PIN);
+}
+
+// ==================== DIAGNOSTIC FUNCTIONS ====================
+// The test pulse goes through setLaserState(false), which would also end
+// a waveform, stream, power loop or calibration and cancel the schedule
+void runDiagnostics()
+{
+    if (outputMode != OutputMode::Steady || calibrating || scheduleCount > 0 || scheduleInFlightCount > 0)
+    {
+        rejectCommand();
+        sendLine(TxClass::Response, "Diagnostics need steady output with nothing scheduled");
+        return;
+    }
+    sendLine(TxClass::Response, "Running Laser Controller Diagnostics");
+
+    bool originalLaserState = laserState;
+    uint32_t originalSetpoint = laserSetpoint;
+
+    setLaserBrightness(10);
+    setLaserState(true);
+    delay(500);
+    setLaserState(false);
+
+    setLaserSetpoint(originalSetpoint);
+    setLaserState(originalLaserState);
+
+    int analogValue = readAnalogA0();
+    int32_t centivolts = getCentivoltsFromAnalog(analogValue);
+    sendLinef(TxClass::Response, "A0 reading: %d (%ld.%02ldV)", analogValue, (long)(centivolts / 100), (long)(centivolts % 100));
+
+    memoryTest();
+
+    sendLine(TxClass::Response, "Diagnostics completed");
+}
+
+void memoryTest()
+{
+    sendLinef(TxClass::Response, "Heap: %lu/%lu bytes", (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getHeapSize());
+    sendLinef(TxClass::Response, "PSRAM: %lu/%lu bytes", (unsigned long)ESP.getFreePsram(), (unsigned long)ESP.getPsramSize());
+
+    // Checks the heap can still serve a 4KB block without allocating one
+    uint32_t largestBlock = ESP.getMaxAllocHeap();
+    sendLinef(TxClass::Response, "Largest free block: %lu bytes", (unsigned long)largestBlock);
+    if (largestBlock >= 1000 * sizeof(int))
+    {
+        sendLine(TxClass::Response, "Memory allocation test passed");
+    }
+    else
+    {
+        sendLine(TxClass::Response, "Memory allocation test failed");
+    }
+}
+
+// ==================== HELP FUNCTION ====================
+// Title, a group header and entry per command, then HELP_FOOTER
+const char *const HELP_FOOTER[] = {
+    "Examples:",
+    "  SET_LASER_PWM:75          - Set laser to 75% brightness",
+    "  HEARTBEAT_INTERVAL:5000   - 5 second heartbeat",
+    nullptr, // laser pin
+    "Safety: Laser automatically turns off on restart",
+    "Note: Brightness values are automatically saved and restored on power cycle",
+    "      HELLO:1 opens a session and returns the device state once"};
+const size_t HELP_FOOTER_LINES = sizeof(HELP_FOOTER) / sizeof(HELP_FOOTER[0]);
+
+void printHelp()
+{
+    startPagedReply(sendHelpLine);
+}
+
+// Line 0 is the title; lines 2i+1 and 2i+2 are command i's group header
+// (when its group starts there) and its entry; the footer follows
+PageLine sendHelpLine(size_t line)
+{
+    char text[LINE_MESSAGE_SIZE];
+    size_t commandLines = 2 * commandRegistry.size();
+    if (line == 0)
+    {
+        snprintf(text, sizeof(text), "ESP32-S3 Laser Controller v%s Commands", FIRMWARE_VERSION);
+    }
+    else if (line <= commandLines)
+    {
+        size_t index = (line - 1) / 2;
+        const CommandSpec &spec = commandRegistry[index];
+        if (spec.group == nullptr)
+        {
+            return PageLine::Next; // hidden alias
+        }
+        if ((line - 1) % 2 == 0)
+        {
+            // The group of the last listed command before this one
+            const char *previousGroup = nullptr;
+            for (size_t i = index; i > 0 && previousGroup == nullptr; i--)
+            {
+                previousGroup = commandRegistry[i - 1].group;
+            }
+            if (spec.group == previousGroup)
+            {
+                return PageLine::Next;
+            }
+            snprintf(text, sizeof(text), "%s", spec.group);
+        }
+        else
+        {
+            char usage[48];
+            if (spec.argType == ArgType::None)
+            {
+                snprintf(usage, sizeof(usage), "%s", spec.name);
+            }
+            else if (spec.argType == ArgType::IntList)
+            {
+                snprintf(usage, sizeof(usage), "%s:%s,...", spec.name, spec.argName);
+            }
+            else
+            {
+                snprintf(usage, sizeof(usage), "%s:%s", spec.name, spec.argName);
+            }
+            snprintf(text, sizeof(text), "  %-28s- %s", usage, spec.help);
+        }
+    }
+    else if (line - commandLines - 1 < HELP_FOOTER_LINES)
+    {
+        const char *footer = HELP_FOOTER[line - commandLines - 1];
+        if (footer == nullptr)
+        {
+            snprintf(text, sizeof(text), "Laser Pin: GPIO %d", LASER_PIN);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "%s", footer);
+        }
+    }
+    else
+    {
+        return PageLine::End;
+    }
+    return sendLine(TxClass::Response, text) ? PageLine::Next : PageLine::Retry;
+}
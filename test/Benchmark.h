@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "bench_baseline.h"
+
+// ==================== BENCHMARKS ====================
+// Timing helpers for test_bench. A figure is the best of BENCH_RUNS runs,
+// in nanoseconds per operation, and is printed next to its entry in
+// bench_baseline.h. More than BENCH_TOLERANCE times the baseline fails the
+// test, so a regression shows up on a plain Linux box without tuning.
+//
+// After a deliberate change, copy the printed entries into the baseline.
+#ifndef BENCH_TOLERANCE
+#define BENCH_TOLERANCE 3.0
+#endif
+
+const int BENCH_RUNS = 5;
+
+template <typename Body>
+double benchNanosPerOp(size_t iterations, Body body)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            body(i);
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double perOp = elapsed / iterations;
+        if (run == 0 || perOp < best)
+        {
+            best = perOp;
+        }
+    }
+    return best;
+}
+
+// Prints `nanos` against the baseline and fails past the tolerance.
+// `detail` is an optional derived figure (commands/s, bytes/us, ...).
+inline void benchCheck(const char *name, double nanos, const char *detail = "")
+{
+    const BenchBaseline *baseline = nullptr;
+    for (const BenchBaseline &entry : BENCH_BASELINES)
+    {
+        if (strcmp(entry.name, name) == 0)
+        {
+            baseline = &entry;
+        }
+    }
+
+    char message[192];
+    if (baseline == nullptr)
+    {
+        snprintf(message, sizeof(message), "{\"%s\", %.1f}, // no baseline yet %s", name, nanos, detail);
+        TEST_FAIL_MESSAGE(message);
+        return;
+    }
+    snprintf(message, sizeof(message), "{\"%s\", %.1f}, // x%.2f of baseline %s", name, nanos,
+             nanos / baseline->nanos, detail);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE_MESSAGE(nanos <= baseline->nanos * BENCH_TOLERANCE, message);
+}
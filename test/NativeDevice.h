@@ -0,0 +1,121 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NativeHal.h"
+
+void setup();
+void loop();
+
+// ==================== NATIVE DEVICE ====================
+// The whole firmware in the test process, for suites that go through
+// setup() and loop() like the board does. Serial is one end of a socket
+// pair and the test holds the other, so it types commands and reads the
+// replies as a host would; loop() only runs when the test calls run().
+//
+// The laser task, timers and UART threads keep running once booted, so a
+// suite boots once and ends with finish() rather than returning from main().
+class NativeDevice
+{
+public:
+    // `speed` scales the virtual clock (setup() alone waits 1.5s of it)
+    void boot(double speed)
+    {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        host = fds[1];
+        fcntl(host, F_SETFL, fcntl(host, F_GETFL) | O_NONBLOCK);
+        nativeSetSerialFd(fds[0]);
+        nativeSetClock(speed, 0);
+        setup();
+        run(100);
+        output.clear();
+    }
+
+    void send(const char *text)
+    {
+        send(text, strlen(text));
+    }
+
+    void send(const void *data, size_t length)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (length > 0)
+        {
+            ssize_t count = ::write(host, bytes, length);
+            if (count > 0)
+            {
+                bytes += count;
+                length -= (size_t)count;
+            }
+        }
+    }
+
+    // Runs loop() for `ms` of device time
+    void run(uint32_t ms)
+    {
+        unsigned long start = millis();
+        while (millis() - start < ms)
+        {
+            pass();
+        }
+    }
+
+    // Runs loop() until `text` has come out or `ms` of device time passed
+    bool waitFor(const char *text, uint32_t ms)
+    {
+        unsigned long start = millis();
+        while (output.find(text) == std::string::npos)
+        {
+            if (millis() - start >= ms)
+            {
+                return false;
+            }
+            pass();
+        }
+        return true;
+    }
+
+    // One loop() pass, then picks up what it sent
+    void pass()
+    {
+        loop();
+        collect();
+    }
+
+    // Everything received since the last take()
+    std::string take()
+    {
+        std::string taken;
+        taken.swap(output);
+        return taken;
+    }
+
+    // Ends the process without static destructors pulling state from
+    // under the threads that are still running
+    [[noreturn]] void finish(int status)
+    {
+        fflush(nullptr);
+        _exit(status);
+    }
+
+    std::string output;
+
+private:
+    int host = -1;
+
+    void collect()
+    {
+        char chunk[512];
+        ssize_t count;
+        while ((count = ::read(host, chunk, sizeof(chunk))) > 0)
+        {
+            output.append(chunk, (size_t)count);
+        }
+    }
+};
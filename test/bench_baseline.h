@@ -0,0 +1,22 @@
+#pragma once
+
+// ==================== BENCHMARK BASELINE ====================
+// Nanoseconds per operation for test_bench, as printed by the suite:
+//   pio test -e native -f test_bench
+// Measured on a 64-bit Linux build host; see Benchmark.h for how they are
+// compared.
+struct BenchBaseline
+{
+    const char *name;
+    double nanos;
+};
+
+const BenchBaseline BENCH_BASELINES[] = {
+    {"line_assembly", 33.0},
+    {"command_lookup_linear", 340.0},
+    {"command_lookup_hash", 55.0},
+    {"command_dispatch", 1400.0},
+    {"status_message", 7400.0},
+    {"json_status_object", 4600.0},
+    {"frame_round_trip", 21500.0},
+};
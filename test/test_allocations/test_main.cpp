@@ -0,0 +1,162 @@
+#include <unity.h>
+
+#include <set>
+#include <string>
+
+#include "../NativeDevice.h"
+#include "AllocCounter.h"
+#include "BinaryProtocol.h"
+
+// ==================== ZERO-ALLOCATION SUITE ====================
+// Drives every command through the booted firmware and checks that no loop()
+// pass after boot touches the heap. The HELP listing is the list of
+// commands, so a new one fails here until it is added below.
+
+NativeDevice device;
+
+// Device time each command gets to run (and finish any paged reply) in
+const uint32_t COMMAND_MS = 300;
+
+// Text commands in an order that keeps each one valid
+const char *const TEXT_COMMANDS[] = {
+    "LASER_ON", "LASER_OFF", "LASER_TOGGLE", "SET_LASER_PWM:40", "SET_LASER_BRIGHTNESS:60",
+    "SET_LASER_PERMILLE:250", "SET_LASER_DUTY:100", "SET_PWM_FREQ:2000", "SET_PWM_RESOLUTION:10",
+    "LASER_STATUS",
+    "CAL_WRITE:2", "CAL_DATA:0,256,512,768,1024,1280,1536,1792,2048,2304,2560,2816,3072,3328,3584,3840,4095",
+    "CAL_READ:2", "CAL_PROFILE:2", "CAL_PROFILE:0", "CAL_RUN:1",
+    "ANALOG_READ", "ADC_START", "ADC_RATE:20000", "ADC_OVERSAMPLE:4", "ADC_STATUS", "ADC_STOP",
+    "STATUS", "SYSTEM_INFO", "VERSION", "GET_INITIAL_STATE", "DIAGNOSTICS", "HELP", "ALLOC_STATS",
+    "LATENCY_STATS", "PROFILE",
+    "HEARTBEAT_ON", "HEARTBEAT_INTERVAL:1000", "HB_FIELDS:15", "HB_FIELD:0,100,1000,1", "HB_CONFIG",
+    "TELEMETRY_LAYOUT", "HISTORY_STATUS", "HEARTBEAT_OFF",
+    "WAVE_SHAPE:0", "WAVE_FREQ:5000", "WAVE_AMPLITUDE:400", "WAVE_OFFSET:500", "WAVE_CYCLES:0",
+    "WAVE_RATE:2000", "WAVE_POINTS_CLEAR", "WAVE_POINTS:0,500,1000", "WAVE_START", "WAVE_STATUS", "WAVE_STOP",
+    "STREAM_RATE:1000", "STREAM_PREFILL:4", "STREAM_START", "STREAM_DATA:100,200,300,400,500,600",
+    "STREAM_STATUS", "STREAM_STOP",
+    "POWER_TARGET:2000", "POWER_KP:256", "POWER_KI:16", "POWER_KD:0", "POWER_START", "POWER_STATUS",
+    "POWER_STOP",
+    "PING", "MEMORY_TEST", "HELLO:1", "TIME_SYNC", "SCHEDULE_STATUS", "SCHEDULE_CLEAR", "BYE",
+    "SET_BAUD:115200", "BAUD_CONFIRM:115200"};
+
+// Sent as frames between BINARY_MODE and TEXT_MODE
+const int32_t NO_ARGUMENT = -1;
+struct BinaryCommand
+{
+    uint8_t opcode;
+    const char *name;
+    int32_t argument;
+};
+const BinaryCommand BINARY_COMMANDS[] = {
+    {0x2C, "PROFILE_STREAM", 500}, {0x36, "TELEMETRY_STREAM", 100}, {0x38, "HISTORY_DUMP", 1},
+    {0x20, "STATUS", NO_ARGUMENT}, {0x36, "TELEMETRY_STREAM", 0},  {0x2C, "PROFILE_STREAM", 0},
+    {0x71, "TEXT_MODE", NO_ARGUMENT}};
+
+// Not driven: restarting ends the program
+const char *const SKIPPED[] = {"RESTART"};
+
+std::set<std::string> driven;
+std::string failures;
+
+void setUp() {}
+void tearDown() {}
+
+// Runs `ms` of device time and records any pass that allocated
+void runChecked(const char *label, uint32_t ms)
+{
+    unsigned long start = millis();
+    uint32_t allocations = 0;
+    while (millis() - start < ms)
+    {
+        uint32_t before = allocationStats().allocations;
+        device.pass();
+        allocations += allocationStats().allocations - before;
+    }
+    if (allocations > 0)
+    {
+        failures += " ";
+        failures += label;
+    }
+}
+
+void sendText(const char *line)
+{
+    device.send(line);
+    device.send("\n");
+    const char *colon = strchr(line, ':');
+    driven.insert(std::string(line, colon ? (size_t)(colon - line) : strlen(line)));
+    runChecked(line, COMMAND_MS);
+}
+
+void sendFrame(const BinaryCommand &command)
+{
+    static uint8_t sequence = 0;
+    uint8_t payload[4];
+    writeInt32LE(payload, command.argument);
+    uint8_t frame[32];
+    size_t length = encodeFrame(command.opcode, ++sequence, payload, command.argument == NO_ARGUMENT ? 0 : 4,
+                                frame, sizeof(frame));
+    device.send(frame, length);
+    driven.insert(command.name);
+    runChecked(command.name, COMMAND_MS);
+}
+
+void test_every_command_runs_without_allocating()
+{
+    for (const char *line : TEXT_COMMANDS)
+    {
+        sendText(line);
+    }
+
+    // A scheduled command is held and then run from loop()
+    char scheduled[64];
+    snprintf(scheduled, sizeof(scheduled), "#7 @%lld SET_LASER_PERMILLE:250", (long long)esp_timer_get_time() + 100000);
+    sendText(scheduled);
+    driven.insert("SCHEDULE");
+
+    sendText("BINARY_MODE");
+    for (const BinaryCommand &command : BINARY_COMMANDS)
+    {
+        sendFrame(command);
+    }
+    device.send("PING\n");
+    TEST_ASSERT_TRUE_MESSAGE(device.waitFor("PONG", COMMAND_MS), "back in text mode");
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("", failures.c_str(), "commands whose loop() passes allocated");
+}
+
+void test_every_listed_command_is_driven()
+{
+    device.take();
+    device.send("HELP\n");
+    TEST_ASSERT_TRUE(device.waitFor("Examples:", 2000));
+
+    // Entries are "  NAME[:arg]  - help" between the title and the footer
+    std::string help = device.take();
+    help = help.substr(0, help.find("Examples:"));
+    size_t listed = 0;
+    size_t start = 0;
+    while ((start = help.find("\n  ", start)) != std::string::npos)
+    {
+        start += 3;
+        std::string name = help.substr(start, help.find_first_of(": ", start) - start);
+        listed++;
+
+        bool skipped = false;
+        for (const char *skip : SKIPPED)
+        {
+            skipped = skipped || name == skip;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(skipped || driven.count(name) > 0, name.c_str());
+    }
+    TEST_ASSERT_GREATER_THAN(50, listed);
+}
+
+int main()
+{
+    device.boot(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_command_runs_without_allocating);
+    RUN_TEST(test_every_listed_command_is_driven);
+    device.finish(UNITY_END());
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <unity.h>
+
+#include "../NativeDevice.h"
+
+// ==================== BAUD RATE SUITE ====================
+// SET_BAUD negotiation on the booted firmware: switch and confirm, the
+// revert when no confirmation comes, rejected requests and the return to
+// 115200 when the host goes away. The native UART runs at the configured
+// rate in device time, so the rate in use shows in how long a listing
+// takes to come out.
+
+NativeDevice device;
+
+void setUp() {}
+void tearDown() {}
+
+// Device ms from sending HELP to its last line
+uint32_t helpMillis()
+{
+    device.run(50);
+    device.take();
+    unsigned long start = millis();
+    device.send("HELP\n");
+    TEST_ASSERT_TRUE(device.waitFor("returns the device state once", 2000));
+    return millis() - start;
+}
+
+long long statusValue(const char *key)
+{
+    device.run(50);
+    device.take();
+    device.send("STATUS\n");
+    TEST_ASSERT_TRUE(device.waitFor("\"type\":\"status\"", 500));
+    device.run(100); // rest of the message
+    std::string output = device.take();
+    std::string field = std::string("\"") + key + "\":";
+    size_t at = output.find(field, output.find("\"type\":\"status\""));
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, key);
+    return atoll(output.c_str() + at + field.size());
+}
+
+void test_switch_and_confirm()
+{
+    uint32_t slow = helpMillis();
+
+    device.send("SET_BAUD:921600\n");
+    TEST_ASSERT_TRUE(device.waitFor("SET_BAUD 921600 OK", 200));
+    device.run(20);
+    device.send("BAUD_CONFIRM:921600\n");
+    TEST_ASSERT_TRUE(device.waitFor("BAUD 921600 OK", 200));
+
+    // A repeat gets the same answer
+    device.take();
+    device.send("BAUD_CONFIRM:921600\n");
+    TEST_ASSERT_TRUE(device.waitFor("BAUD 921600 OK", 200));
+
+    uint32_t fast = helpMillis();
+    char message[64];
+    snprintf(message, sizeof(message), "HELP took %ums at 115200, %ums at 921600", (unsigned)slow, (unsigned)fast);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(slow / 4, fast);
+
+    TEST_ASSERT_EQUAL(921600, statusValue("baud"));
+    TEST_ASSERT_EQUAL(1, statusValue("baud_switches"));
+}
+
+void test_unconfirmed_rate_reverts()
+{
+    uint32_t before = helpMillis();
+
+    device.send("SET_BAUD:230400\n");
+    TEST_ASSERT_TRUE(device.waitFor("SET_BAUD 230400 OK", 200));
+    device.run(900);
+    TEST_ASSERT_TRUE(device.output.find("not confirmed") == std::string::npos);
+    TEST_ASSERT_TRUE(device.waitFor("Baud rate 230400 not confirmed - back to 921600", 300));
+
+    // A confirmation after the window is refused
+    device.send("#1 BAUD_CONFIRM:230400\n");
+    TEST_ASSERT_TRUE(device.waitFor("NACK 1 3", 200));
+
+    uint32_t after = helpMillis();
+    TEST_ASSERT_LESS_THAN(before * 2, after);
+    TEST_ASSERT_EQUAL(921600, statusValue("baud"));
+    TEST_ASSERT_EQUAL(1, statusValue("baud_reverts"));
+}
+
+void test_bad_requests_are_rejected()
+{
+    device.take();
+    device.send("#2 SET_BAUD:300000\n");
+    TEST_ASSERT_TRUE(device.waitFor("NACK 2 3", 200));
+
+    device.send("#3 SET_BAUD:460800\n#4 SET_BAUD:1000000\n");
+    TEST_ASSERT_TRUE(device.waitFor("NACK 4 3", 200));
+    device.run(20);
+    device.send("#5 BAUD_CONFIRM:1000000\n");
+    TEST_ASSERT_TRUE(device.waitFor("NACK 5 3", 200));
+    device.send("BAUD_CONFIRM:460800\n");
+    TEST_ASSERT_TRUE(device.waitFor("BAUD 460800 OK", 200));
+}
+
+// A session that expires takes the link back to 115200 for the next host
+void test_expired_session_restores_default()
+{
+    device.send("HELLO:1,0,7,1000\n");
+    TEST_ASSERT_TRUE(device.waitFor("\"type\":\"welcome\"", 200));
+    TEST_ASSERT_TRUE(device.waitFor("Session 1 expired", 1500));
+    TEST_ASSERT_EQUAL(115200, statusValue("baud"));
+}
+
+int main()
+{
+    device.boot(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_switch_and_confirm);
+    RUN_TEST(test_unconfirmed_rate_reverts);
+    RUN_TEST(test_bad_requests_are_rejected);
+    RUN_TEST(test_expired_session_restores_default);
+    device.finish(UNITY_END());
+}
@@ -0,0 +1,245 @@
+#include <unity.h>
+
+#include "../Benchmark.h"
+#include "../NativeDevice.h"
+#include "AllocCounter.h"
+#include "BinaryProtocol.h"
+#include "CommandRegistry.h"
+#include "JsonWriter.h"
+#include "LineAssembler.h"
+#include "TxQueue.h"
+
+// ==================== BENCHMARK SUITE ====================
+// Host figures for the firmware's hot paths, checked against
+// bench_baseline.h: command parse and dispatch, message encoding and heap
+// allocations per command.
+
+void handleCommand(const char *command, size_t length, uint32_t rxCycles, uint32_t readyCycles);
+void sendStatusUpdate();
+extern TxQueue txQueue;
+
+NativeDevice device;
+
+// Takes the queued output the way the UART would, minus the wire
+struct NullWriter
+{
+    size_t write(const uint8_t *data, size_t length)
+    {
+        (void)data;
+        return length;
+    }
+    void flush() {}
+};
+NullWriter sink;
+
+// A mix of set, query and list commands, one with a request id
+const char *const COMMAND_MIX[] = {"SET_LASER_PWM:40", "LASER_STATUS", "PING", "HB_FIELDS:7",
+                                   "#12 SET_LASER_PERMILLE:500", "VERSION"};
+const size_t COMMAND_MIX_SIZE = sizeof(COMMAND_MIX) / sizeof(COMMAND_MIX[0]);
+
+void runCommand(size_t i)
+{
+    const char *line = COMMAND_MIX[i % COMMAND_MIX_SIZE];
+    handleCommand(line, strlen(line), 0, 0);
+    txQueue.drain(sink);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// 64 command lines in 64-byte reads, the size of the UART RX FIFO
+void test_line_assembly()
+{
+    static char stream[64 * 32];
+    size_t streamLength = 0;
+    for (size_t line = 0; line < 64; line++)
+    {
+        streamLength += snprintf(stream + streamLength, sizeof(stream) - streamLength, "#%u %s\r\n", (unsigned)line,
+                                 COMMAND_MIX[line % COMMAND_MIX_SIZE]);
+    }
+
+    static LineAssembler lines;
+    size_t assembled = 0;
+    double nanos = benchNanosPerOp(20000, [&](size_t) {
+        for (size_t offset = 0; offset < streamLength;)
+        {
+            offset += lines.feed(stream + offset, streamLength - offset < 64 ? streamLength - offset : 64);
+            char *line;
+            size_t length;
+            while (lines.nextLine(line, length))
+            {
+                assembled++;
+            }
+        }
+    }) / 64;
+    TEST_ASSERT_EQUAL_size_t(0, assembled % 64);
+
+    char detail[48];
+    snprintf(detail, sizeof(detail), "(%.1f MB/s)", streamLength / 64 * 1000.0 / nanos);
+    benchCheck("line_assembly", nanos, detail);
+}
+
+// The firmware's command names in table order, for name lookup on its own
+const char *const COMMAND_NAMES[] = {
+    "LASER_ON", "LASER_OFF", "LASER_TOGGLE", "SET_LASER_PWM", "SET_LASER_BRIGHTNESS", "SET_LASER_PERMILLE",
+    "SET_LASER_DUTY", "SET_PWM_FREQ", "SET_PWM_RESOLUTION", "LASER_STATUS", "CAL_RUN", "CAL_PROFILE",
+    "CAL_READ", "CAL_WRITE", "CAL_DATA", "ANALOG_READ", "ADC_START", "ADC_STOP", "ADC_RATE", "ADC_OVERSAMPLE",
+    "ADC_STATUS", "STATUS", "SYSTEM_INFO", "VERSION", "GET_INITIAL_STATE", "DIAGNOSTICS", "MEMORY_TEST",
+    "RESTART", "REBOOT", "HELP", "ALLOC_STATS", "LATENCY_STATS", "PROFILE", "PROFILE_STREAM", "HEARTBEAT_ON",
+    "HEARTBEAT_OFF", "HEARTBEAT_INTERVAL", "HB_FIELDS", "HB_FIELD", "HB_CONFIG", "TELEMETRY_STREAM",
+    "TELEMETRY_LAYOUT", "HISTORY_DUMP", "HISTORY_STATUS", "WAVE_SHAPE", "WAVE_FREQ", "WAVE_AMPLITUDE",
+    "WAVE_OFFSET", "WAVE_CYCLES", "WAVE_RATE", "WAVE_POINTS_CLEAR", "WAVE_POINTS", "WAVE_START", "WAVE_STOP",
+    "WAVE_STATUS", "STREAM_RATE", "STREAM_PREFILL", "STREAM_START", "STREAM_DATA", "STREAM_STOP",
+    "STREAM_STATUS", "POWER_TARGET", "POWER_KP", "POWER_KI", "POWER_KD", "POWER_START", "POWER_STOP",
+    "POWER_STATUS", "BINARY_MODE", "TEXT_MODE", "PING", "HELLO", "BYE", "TIME_SYNC", "SCHEDULE",
+    "SCHEDULE_STATUS", "SCHEDULE_CLEAR", "SET_BAUD", "BAUD_CONFIRM"};
+const size_t COMMAND_COUNT = sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]);
+
+// Name lookup as it was before the perfect hash: compare against each
+// command in turn
+const char *findLinear(const char *name, size_t length)
+{
+    for (const char *candidate : COMMAND_NAMES)
+    {
+        if (strncmp(candidate, name, length) == 0 && candidate[length] == '\0')
+        {
+            return candidate;
+        }
+    }
+    return nullptr;
+}
+
+// Every name once per COMMAND_COUNT lookups, with a linear scan and with
+// CommandRegistry::find()
+void test_command_lookup()
+{
+    static CommandSpec specs[COMMAND_COUNT];
+    for (size_t i = 0; i < COMMAND_COUNT; i++)
+    {
+        specs[i] = command((uint8_t)(i + 1), COMMAND_NAMES[i], [](int32_t) {}, nullptr, nullptr);
+    }
+    static const CommandRegistry<COMMAND_COUNT> registry(specs);
+
+    size_t lengths[COMMAND_COUNT];
+    for (size_t i = 0; i < COMMAND_COUNT; i++)
+    {
+        lengths[i] = strlen(COMMAND_NAMES[i]);
+        TEST_ASSERT_EQUAL_PTR(&specs[i], registry.find(COMMAND_NAMES[i], lengths[i]));
+    }
+
+    size_t found = 0;
+    double linear = benchNanosPerOp(200000, [&](size_t i) {
+        found += findLinear(COMMAND_NAMES[i % COMMAND_COUNT], lengths[i % COMMAND_COUNT]) != nullptr;
+    });
+    double hashed = benchNanosPerOp(200000, [&](size_t i) {
+        found += registry.find(COMMAND_NAMES[i % COMMAND_COUNT], lengths[i % COMMAND_COUNT]) != nullptr;
+    });
+    TEST_ASSERT_EQUAL_size_t(4 * BENCH_RUNS * 100000, found);
+
+    char detail[64];
+    snprintf(detail, sizeof(detail), "(%.1fM lookups/s)", 1e3 / linear);
+    benchCheck("command_lookup_linear", linear, detail);
+    snprintf(detail, sizeof(detail), "(%.1fM lookups/s, %.1fx the linear scan)", 1e3 / hashed, linear / hashed);
+    benchCheck("command_lookup_hash", hashed, detail);
+}
+
+void test_command_dispatch()
+{
+    double nanos = benchNanosPerOp(60000, runCommand);
+    char detail[48];
+    snprintf(detail, sizeof(detail), "(%.0f commands/s)", 1e9 / nanos);
+    benchCheck("command_dispatch", nanos, detail);
+}
+
+void test_status_message()
+{
+    double nanos = benchNanosPerOp(20000, [](size_t) {
+        sendStatusUpdate();
+        txQueue.drain(sink);
+    });
+    benchCheck("status_message", nanos);
+}
+
+// encodeFrame() and FrameDecoder over a 256-byte payload, CRC included
+void test_frame_round_trip()
+{
+    static uint8_t payload[256];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t)(i * 7); // zeros every 256/7 bytes for COBS to split on
+    }
+    static uint8_t encoded[FRAME_MAX_ENCODED];
+    static FrameDecoder decoder;
+    size_t decoded = 0;
+
+    double nanos = benchNanosPerOp(20000, [&](size_t i) {
+        size_t length = encodeFrame(0x53, (uint8_t)i, payload, sizeof(payload), encoded, sizeof(encoded));
+        BinaryFrame frame;
+        for (size_t j = 0; j < length; j++)
+        {
+            if (decoder.feed(encoded[j], frame))
+            {
+                decoded += frame.length;
+            }
+        }
+    });
+    TEST_ASSERT_EQUAL_size_t(BENCH_RUNS * 20000 * sizeof(payload), decoded);
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.badFrameCount());
+
+    char detail[48];
+    snprintf(detail, sizeof(detail), "(%.1f MB/s of payload)", sizeof(payload) * 1000.0 / nanos);
+    benchCheck("frame_round_trip", nanos, detail);
+}
+
+// JsonWriter alone over a STATUS-sized object, as bytes/us of output
+void test_json_encoding()
+{
+    static char buffer[1024];
+    size_t bytes = 0;
+    double nanos = benchNanosPerOp(20000, [&](size_t i) {
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject().stringField("type", "status");
+        for (int32_t field = 0; field < 14; field++)
+        {
+            json.intField("laser_brightness", (int32_t)i * field - 5000)
+                .fixedField("temperature_c", (int32_t)i + field, 2);
+        }
+        json.uint64Field("clock_us", 1000000ULL * i).endObject().endLine();
+        bytes = json.length();
+    });
+    TEST_ASSERT_LESS_THAN(sizeof(buffer) - 1, bytes);
+    char detail[48];
+    snprintf(detail, sizeof(detail), "(%.0f bytes/us)", bytes * 1000.0 / nanos);
+    benchCheck("json_status_object", nanos, detail);
+}
+
+void test_allocations_per_command()
+{
+    const size_t COMMANDS = 6000;
+    uint32_t before = allocationStats().allocations;
+    for (size_t i = 0; i < COMMANDS; i++)
+    {
+        runCommand(i);
+    }
+    uint32_t allocations = allocationStats().allocations - before;
+
+    char message[64];
+    snprintf(message, sizeof(message), "%lu allocations in %u commands", (unsigned long)allocations, (unsigned)COMMANDS);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+int main()
+{
+    device.boot(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_line_assembly);
+    RUN_TEST(test_command_lookup);
+    RUN_TEST(test_command_dispatch);
+    RUN_TEST(test_status_message);
+    RUN_TEST(test_json_encoding);
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_allocations_per_command);
+    device.finish(UNITY_END());
+}
@@ -0,0 +1,98 @@
+#include <string.h>
+#include <unity.h>
+
+#include "AllocCounter.h"
+#include "JsonWriter.h"
+
+// ==================== JSON WRITER SUITE ====================
+// Encoding, escaping and truncation of JsonWriter, and that none of it
+// touches the heap.
+
+void setUp() {}
+void tearDown() {}
+
+void test_fields_and_numbers()
+{
+    char buffer[256];
+    const uint16_t curve[] = {0, 4096, 65535};
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject()
+        .stringField("type", "status")
+        .boolField("on", true)
+        .intField("min", INT32_MIN)
+        .uintField("max", UINT32_MAX)
+        .uint64Field("clock", 18446744073709551615ULL)
+        .fixedField("v", 165, 2)
+        .fixedField("neg", -5, 3)
+        .uintArrayField("curve", curve, 3)
+        .endObject()
+        .endLine();
+
+    TEST_ASSERT_FALSE(json.overflowed());
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"status\",\"on\":true,\"min\":-2147483648,\"max\":4294967295,"
+                             "\"clock\":18446744073709551615,\"v\":1.65,\"neg\":-0.005,\"curve\":[0,4096,65535]}\r\n",
+                             json.data());
+    TEST_ASSERT_EQUAL_size_t(strlen(buffer), json.length());
+}
+
+void test_strings_are_escaped()
+{
+    char buffer[128];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject().stringField("reason", "a \"b\" \\ c\r\n\t\x01").endObject();
+
+    TEST_ASSERT_EQUAL_STRING("{\"reason\":\"a \\\"b\\\" \\\\ c\\r\\n\\t\\u0001\"}", json.data());
+}
+
+// Output stops at the buffer with a NUL after the last byte, and the flag
+// tells the caller not to send it
+void test_overflow_truncates_and_flags()
+{
+    char buffer[16];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject().stringField("message", "too long to fit").endObject();
+
+    TEST_ASSERT_TRUE(json.overflowed());
+    TEST_ASSERT_EQUAL_size_t(sizeof(buffer) - 1, json.length());
+    TEST_ASSERT_EQUAL_STRING("{\"message\":\"too", json.data());
+}
+
+// The message plus its NUL
+void test_exact_fit_does_not_overflow()
+{
+    char buffer[9];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject().intField("a", 12).endObject();
+
+    TEST_ASSERT_FALSE(json.overflowed());
+    TEST_ASSERT_EQUAL_STRING("{\"a\":12}", json.data());
+}
+
+void test_encoding_does_not_allocate()
+{
+    uint32_t before = allocationStats().allocations;
+    for (int i = 0; i < 1000; i++)
+    {
+        char buffer[128];
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject()
+            .stringField("type", "heartbeat")
+            .intField("value", -i)
+            .fixedField("temp", i * 7, 2)
+            .uint64Field("clock_us", 1000000ULL * i)
+            .endObject()
+            .endLine();
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, allocationStats().allocations - before);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fields_and_numbers);
+    RUN_TEST(test_strings_are_escaped);
+    RUN_TEST(test_overflow_truncates_and_flags);
+    RUN_TEST(test_exact_fit_does_not_overflow);
+    RUN_TEST(test_encoding_does_not_allocate);
+    return UNITY_END();
+}
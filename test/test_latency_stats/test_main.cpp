@@ -0,0 +1,111 @@
+#include <unity.h>
+
+#include "LatencyStats.h"
+
+// ==================== LATENCY STATS SUITE ====================
+// Log2 bucket edges, saturation and slot assignment of LatencyStats.
+
+LatencyStats stats;
+
+void setUp()
+{
+    stats.reset();
+}
+
+void tearDown() {}
+
+// The bucket a single sample of `cycles` lands in
+size_t bucketOf(uint32_t cycles)
+{
+    stats.reset();
+    uint8_t slot = stats.slotFor(0x01);
+    stats.record(slot, LatencyStage::Handler, cycles);
+    const uint16_t *counts = stats.counts(slot, LatencyStage::Handler);
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        if (counts[b] != 0)
+        {
+            return b;
+        }
+    }
+    return LATENCY_BUCKETS;
+}
+
+void test_bucket_edges()
+{
+    TEST_ASSERT_EQUAL_size_t(0, bucketOf(0));
+    TEST_ASSERT_EQUAL_size_t(0, bucketOf(127));
+    TEST_ASSERT_EQUAL_size_t(1, bucketOf(128));
+    TEST_ASSERT_EQUAL_size_t(1, bucketOf(255));
+    TEST_ASSERT_EQUAL_size_t(2, bucketOf(256));
+    TEST_ASSERT_EQUAL_size_t(11, bucketOf(1u << 17));
+    TEST_ASSERT_EQUAL_size_t(18, bucketOf((1u << 25) - 1));
+    TEST_ASSERT_EQUAL_size_t(19, bucketOf(1u << 25));
+    TEST_ASSERT_EQUAL_size_t(19, bucketOf(UINT32_MAX));
+}
+
+void test_stages_are_separate_and_max_is_kept()
+{
+    uint8_t slot = stats.slotFor(0x20);
+    stats.record(slot, LatencyStage::Receive, 1000);
+    stats.record(slot, LatencyStage::Receive, 90000);
+    stats.record(slot, LatencyStage::Receive, 500);
+    stats.record(slot, LatencyStage::Apply, 200);
+
+    TEST_ASSERT_EQUAL_UINT32(3, stats.samples(slot, LatencyStage::Receive));
+    TEST_ASSERT_EQUAL_UINT32(90000, stats.maxCycles(slot, LatencyStage::Receive));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.samples(slot, LatencyStage::Apply));
+    TEST_ASSERT_EQUAL_UINT32(200, stats.maxCycles(slot, LatencyStage::Apply));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.samples(slot, LatencyStage::Queue));
+}
+
+void test_counts_saturate()
+{
+    uint8_t slot = stats.slotFor(0x72);
+    for (uint32_t i = 0; i < 70000; i++)
+    {
+        stats.record(slot, LatencyStage::EndToEnd, 300);
+    }
+
+    TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, stats.counts(slot, LatencyStage::EndToEnd)[2]);
+    TEST_ASSERT_EQUAL_UINT32(UINT16_MAX, stats.samples(slot, LatencyStage::EndToEnd));
+}
+
+// The first LATENCY_SLOTS - 1 opcodes get their own slot, the rest share one
+void test_slots_overflow_into_shared_slot()
+{
+    for (uint8_t opcode = 1; opcode < LATENCY_SLOTS; opcode++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(opcode - 1, stats.slotFor(opcode));
+    }
+    TEST_ASSERT_EQUAL_size_t(LATENCY_SLOTS - 1, stats.slotsUsed());
+    TEST_ASSERT_EQUAL_UINT8(4, stats.slotFor(5));
+
+    TEST_ASSERT_EQUAL_UINT8(LATENCY_SLOTS - 1, stats.slotFor(0x40));
+    TEST_ASSERT_EQUAL_UINT8(LATENCY_SLOTS - 1, stats.slotFor(0x41));
+    TEST_ASSERT_EQUAL_size_t(LATENCY_SLOTS, stats.slotsUsed());
+    TEST_ASSERT_EQUAL_UINT8(LATENCY_OTHER, stats.opcode(LATENCY_SLOTS - 1));
+    TEST_ASSERT_EQUAL_UINT8(0, stats.slotFor(1));
+}
+
+void test_reset_clears_everything()
+{
+    uint8_t slot = stats.slotFor(0x03);
+    stats.record(slot, LatencyStage::Handler, 5000);
+    stats.reset();
+
+    TEST_ASSERT_EQUAL_size_t(0, stats.slotsUsed());
+    TEST_ASSERT_EQUAL_UINT32(0, stats.samples(slot, LatencyStage::Handler));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.maxCycles(slot, LatencyStage::Handler));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_edges);
+    RUN_TEST(test_stages_are_separate_and_max_is_kept);
+    RUN_TEST(test_counts_saturate);
+    RUN_TEST(test_slots_overflow_into_shared_slot);
+    RUN_TEST(test_reset_clears_everything);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <unity.h>
+
+#include "LineAssembler.h"
+
+// ==================== LINE ASSEMBLER SUITE ====================
+// Line splitting, trimming and the MAX_LINE_LENGTH limit, which applies to
+// the command without its terminator or surrounding whitespace.
+
+void setUp() {}
+void tearDown() {}
+
+static void feedString(LineAssembler &lines, const char *text)
+{
+    TEST_ASSERT_EQUAL_size_t(strlen(text), lines.feed(text, strlen(text)));
+}
+
+// `length` copies of 'A' followed by `suffix`
+static void feedCommand(LineAssembler &lines, size_t length, const char *suffix)
+{
+    char text[LineAssembler::BUFFER_SIZE];
+    memset(text, 'A', length);
+    strcpy(text + length, suffix);
+    feedString(lines, text);
+}
+
+void test_lines_are_split_and_trimmed()
+{
+    LineAssembler lines;
+    feedString(lines, "PING\n  LASER_ON \r\n\r\n\tSTATUS\r\n");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("PING", line);
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("LASER_ON", line);
+    TEST_ASSERT_EQUAL_size_t(8, length);
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("STATUS", line);
+    TEST_ASSERT_FALSE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_UINT32(0, lines.droppedLines());
+}
+
+void test_longest_command_with_crlf_is_accepted()
+{
+    LineAssembler lines;
+    feedCommand(lines, LineAssembler::MAX_LINE_LENGTH, "\r\n");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_size_t(LineAssembler::MAX_LINE_LENGTH, length);
+    TEST_ASSERT_EQUAL_UINT32(0, lines.droppedLines());
+}
+
+void test_longest_command_with_padding_is_accepted()
+{
+    LineAssembler lines;
+    feedString(lines, "  ");
+    feedCommand(lines, LineAssembler::MAX_LINE_LENGTH, " \t \r\n");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_size_t(LineAssembler::MAX_LINE_LENGTH, length);
+    TEST_ASSERT_EQUAL_UINT32(0, lines.droppedLines());
+}
+
+void test_cr_waiting_for_its_newline_is_not_dropped()
+{
+    LineAssembler lines;
+    feedCommand(lines, LineAssembler::MAX_LINE_LENGTH, "\r");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_FALSE(lines.nextLine(line, length));
+    feedString(lines, "\n");
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_size_t(LineAssembler::MAX_LINE_LENGTH, length);
+    TEST_ASSERT_EQUAL_UINT32(0, lines.droppedLines());
+}
+
+void test_command_over_the_limit_is_dropped()
+{
+    LineAssembler lines;
+    feedCommand(lines, LineAssembler::MAX_LINE_LENGTH + 1, "\r\nPING\r\n");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("PING", line);
+    TEST_ASSERT_EQUAL_UINT32(1, lines.droppedLines());
+}
+
+void test_long_partial_line_is_discarded_up_to_the_newline()
+{
+    LineAssembler lines;
+    feedCommand(lines, LineAssembler::MAX_LINE_LENGTH + 1, "");
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_FALSE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_UINT32(1, lines.droppedLines());
+    TEST_ASSERT_EQUAL_size_t(0, lines.pending());
+
+    feedString(lines, "TAIL\nPING\n");
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("PING", line);
+    TEST_ASSERT_EQUAL_UINT32(1, lines.droppedLines());
+}
+
+void test_buffer_full_of_padding_is_discarded()
+{
+    LineAssembler lines;
+    char spaces[LineAssembler::BUFFER_SIZE];
+    memset(spaces, ' ', sizeof(spaces));
+    TEST_ASSERT_EQUAL_size_t(sizeof(spaces), lines.feed(spaces, sizeof(spaces)));
+
+    char *line;
+    size_t length;
+    TEST_ASSERT_FALSE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_size_t(0, lines.pending());
+
+    feedString(lines, "\nPING\n");
+    TEST_ASSERT_TRUE(lines.nextLine(line, length));
+    TEST_ASSERT_EQUAL_STRING("PING", line);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lines_are_split_and_trimmed);
+    RUN_TEST(test_longest_command_with_crlf_is_accepted);
+    RUN_TEST(test_longest_command_with_padding_is_accepted);
+    RUN_TEST(test_cr_waiting_for_its_newline_is_not_dropped);
+    RUN_TEST(test_command_over_the_limit_is_dropped);
+    RUN_TEST(test_long_partial_line_is_discarded_up_to_the_newline);
+    RUN_TEST(test_buffer_full_of_padding_is_discarded);
+    return UNITY_END();
+}
@@ -0,0 +1,114 @@
+#include <unity.h>
+
+#include "Profiler.h"
+
+// ==================== PROFILER SUITE ====================
+// ProfileScope's quarter-octave buckets: exact small values, percentiles
+// within 12.5%, the open-ended top bucket and saturated counts.
+
+ProfileScope scope;
+
+void setUp()
+{
+    scope.reset();
+}
+
+void tearDown() {}
+
+// Percentiles land within one bucket (1/8 of the value) of the truth
+void assertNear(uint32_t expected, uint32_t actual)
+{
+    TEST_ASSERT_UINT32_WITHIN(expected / 8 + 1, expected, actual);
+}
+
+void test_empty_scope_reports_zero()
+{
+    ProfileSummary s = scope.summary();
+
+    TEST_ASSERT_EQUAL_UINT32(0, s.count);
+    TEST_ASSERT_EQUAL_UINT32(0, s.minUs);
+    TEST_ASSERT_EQUAL_UINT32(0, s.meanUs);
+    TEST_ASSERT_EQUAL_UINT32(0, s.p99Us);
+    TEST_ASSERT_EQUAL_UINT32(0, s.maxUs);
+}
+
+void test_small_values_are_exact()
+{
+    for (uint32_t us = 0; us < 8; us++)
+    {
+        scope.reset();
+        scope.record(us);
+        scope.record(100); // keeps the clamp to min/max out of the way
+        TEST_ASSERT_EQUAL_UINT32(us, scope.percentile(500));
+    }
+}
+
+void test_uniform_percentiles()
+{
+    for (uint32_t us = 1; us <= 1000; us++)
+    {
+        scope.record(us);
+    }
+    ProfileSummary s = scope.summary();
+
+    TEST_ASSERT_EQUAL_UINT32(1000, s.count);
+    TEST_ASSERT_EQUAL_UINT32(1, s.minUs);
+    TEST_ASSERT_EQUAL_UINT32(500, s.meanUs);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.maxUs);
+    assertNear(500, s.p50Us);
+    assertNear(900, s.p90Us);
+    assertNear(990, s.p99Us);
+}
+
+// A rare slow pass shows at p99 but not p50
+void test_tail_is_visible()
+{
+    for (int i = 0; i < 990; i++)
+    {
+        scope.record(40);
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        scope.record(5000);
+    }
+
+    assertNear(40, scope.percentile(500));
+    assertNear(40, scope.percentile(990));
+    assertNear(5000, scope.percentile(991));
+    assertNear(5000, scope.percentile(1000));
+}
+
+// Past the last bucket the reported value is the observed maximum
+void test_top_bucket_reports_max()
+{
+    scope.record(10);
+    scope.record(3000000);
+
+    TEST_ASSERT_EQUAL_UINT32(3000000, scope.percentile(1000));
+    TEST_ASSERT_EQUAL_UINT32(10, scope.percentile(500));
+}
+
+void test_saturated_counts_keep_percentiles_consistent()
+{
+    for (uint32_t i = 0; i < 70000; i++)
+    {
+        scope.record(20);
+    }
+    scope.record(900);
+
+    TEST_ASSERT_EQUAL_UINT32(70001, scope.samples());
+    assertNear(20, scope.percentile(500));
+    assertNear(900, scope.percentile(1000));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_scope_reports_zero);
+    RUN_TEST(test_small_values_are_exact);
+    RUN_TEST(test_uniform_percentiles);
+    RUN_TEST(test_tail_is_visible);
+    RUN_TEST(test_top_bucket_reports_max);
+    RUN_TEST(test_saturated_counts_keep_percentiles_consistent);
+    return UNITY_END();
+}
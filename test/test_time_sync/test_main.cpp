@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <unity.h>
+
+#include "../../tools/ClockSync.h"
+#include "../NativeDevice.h"
+
+// ==================== TIME SYNC SUITE ====================
+// The host's offset and drift math from tools/ClockSync.h on made-up
+// exchanges, then scheduled commands on the booted firmware: output held
+// until its time, later commands waiting behind it, and cancellation.
+
+NativeDevice device;
+
+const uint8_t LASER_CHANNEL = 0; // PWM_CHANNEL in main.cpp
+
+void setUp() {}
+void tearDown() {}
+
+// One exchange against a device clock at `offset` + `drift` * host time,
+// with `outbound` and `inbound` us on the wire and `turnaround` on the device
+SyncSample exchangeAt(uint64_t hostSent, double offset, double drift, uint64_t outbound, uint64_t inbound,
+                      uint64_t turnaround = 40)
+{
+    auto deviceTime = [&](uint64_t host) { return (uint64_t)((double)host + offset + drift * (double)host); };
+    uint64_t deviceReceived = deviceTime(hostSent + outbound);
+    uint64_t deviceSent = deviceReceived + turnaround;
+    uint64_t hostReceived = hostSent + outbound + turnaround + inbound;
+    return syncSample(hostSent, deviceReceived, deviceSent, hostReceived);
+}
+
+void test_symmetric_exchange_gives_exact_offset()
+{
+    SyncSample sample = syncSample(1000000, 5001200, 5001300, 1000500);
+
+    TEST_ASSERT_EQUAL_INT64(4001000, sample.offset);
+    TEST_ASSERT_EQUAL_UINT64(400, sample.roundTrip);
+}
+
+// An asymmetric path is off by half the difference, the NTP error bound
+void test_asymmetric_exchange_error_is_half_the_difference()
+{
+    SyncSample sample = exchangeAt(2000000, 750000, 0, 900, 100);
+
+    TEST_ASSERT_EQUAL_INT64(750000 + (900 - 100) / 2, sample.offset);
+    TEST_ASSERT_EQUAL_UINT64(1000, sample.roundTrip);
+}
+
+// Queued exchanges (long, lopsided round trips) are left out and the line
+// through the rest recovers the offset and a 20ppm drift. The host clock
+// has been up far longer than the device's, as with a PC and a fresh board.
+void test_estimate_uses_fastest_half_and_fits_drift()
+{
+    const uint64_t HOST_START = 900000000000ULL;
+    const double OFFSET = -123456789.0;
+    const double DRIFT = 20e-6;
+    srand(1);
+    std::vector<SyncSample> samples;
+    for (uint64_t i = 0; i < 64; i++)
+    {
+        uint64_t hostSent = HOST_START + i * 100000;
+        bool queued = i % 2 == 1;
+        uint64_t outbound = 150 + rand() % 20 + (queued ? 4000 + rand() % 8000 : 0);
+        samples.push_back(exchangeAt(hostSent, OFFSET, DRIFT, outbound, 150 + rand() % 20));
+    }
+
+    ClockEstimate clock = estimateClock(samples);
+
+    TEST_ASSERT_EQUAL_size_t(32, clock.used);
+    TEST_ASSERT_LESS_THAN(400, clock.bestRoundTrip);
+    TEST_ASSERT_INT_WITHIN(1, (long long)(DRIFT * 1e6), (long long)(clock.drift * 1e6 + 0.5));
+    uint64_t later = HOST_START + 200 * 100000;
+    uint64_t expected = (uint64_t)((double)later + OFFSET + DRIFT * (double)later);
+    TEST_ASSERT_INT_WITHIN(20, (long long)expected, (long long)clock.toDevice(later));
+}
+
+void test_host_time_before_device_boot_maps_to_zero()
+{
+    std::vector<SyncSample> samples = {exchangeAt(2000000, -1000000, 0, 100, 100)};
+
+    ClockEstimate clock = estimateClock(samples);
+
+    TEST_ASSERT_EQUAL_UINT64(500000, clock.toDevice(1500000));
+    TEST_ASSERT_EQUAL_UINT64(0, clock.toDevice(400000));
+}
+
+void test_single_exchange_has_no_drift()
+{
+    std::vector<SyncSample> samples = {exchangeAt(500000, 1000, 0, 100, 100)};
+
+    ClockEstimate clock = estimateClock(samples);
+
+    TEST_ASSERT_EQUAL_size_t(1, clock.used);
+    TEST_ASSERT_TRUE(clock.drift == 0);
+    TEST_ASSERT_EQUAL_UINT64(501000 + 1000, clock.toDevice(501000));
+}
+
+// "#id @<now + delayMs> command" on the device clock; returns the time
+int64_t sendScheduled(int id, uint32_t delayMs, const char *command)
+{
+    int64_t at = esp_timer_get_time() + delayMs * 1000LL;
+    char line[96];
+    snprintf(line, sizeof(line), "#%d @%lld %s\n", id, (long long)at, command);
+    device.send(line);
+    return at;
+}
+
+void runUntil(int64_t deviceUs)
+{
+    while (esp_timer_get_time() < deviceUs)
+    {
+        device.pass();
+    }
+}
+
+// The value of "key": in the first message that mentions `marker`
+long long reportValue(const std::string &output, const char *marker, const char *key)
+{
+    size_t at = output.find(marker);
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, marker);
+    std::string field = std::string("\"") + key + "\":";
+    size_t value = output.find(field, at);
+    TEST_ASSERT_TRUE_MESSAGE(value != std::string::npos, key);
+    return atoll(output.c_str() + value + field.size());
+}
+
+void test_scheduled_output_is_held_until_its_time()
+{
+    device.send("LASER_OFF\n");
+    device.run(50);
+    TEST_ASSERT_EQUAL_UINT32(0, nativeLedcDuty(LASER_CHANNEL));
+    device.take();
+
+    sendScheduled(1, 200, "LASER_ON");
+    device.run(150);
+    TEST_ASSERT_EQUAL_UINT32(0, nativeLedcDuty(LASER_CHANNEL));
+
+    TEST_ASSERT_TRUE(device.waitFor("\"id\":1,", 300));
+    device.run(50); // rest of the report
+    TEST_ASSERT_NOT_EQUAL(0, nativeLedcDuty(LASER_CHANNEL));
+    std::string output = device.take();
+    TEST_ASSERT_EQUAL(0, reportValue(output, "\"id\":1,", "result"));
+    long long requested = reportValue(output, "\"id\":1,", "requested_us");
+    long long achieved = reportValue(output, "\"id\":1,", "achieved_us");
+    TEST_ASSERT_GREATER_OR_EQUAL(requested, achieved);
+    TEST_ASSERT_LESS_THAN(requested + 10000, achieved); // 0.1-0.25ms on an idle host
+}
+
+// An output command sent once a scheduled one has run ahead (its last
+// SCHEDULE_LEAD_US) is held until that time instead of jumping ahead of it
+void test_later_command_waits_behind_scheduled_one()
+{
+    device.send("SET_LASER_PWM:50\nLASER_ON\n");
+    device.run(50);
+    uint32_t half = nativeLedcDuty(LASER_CHANNEL);
+    TEST_ASSERT_NOT_EQUAL(0, half);
+    device.take();
+
+    int64_t at = sendScheduled(2, 200, "SET_LASER_PWM:20");
+    runUntil(at - 20000);
+    device.send("SET_LASER_PWM:80\n");
+    runUntil(at - 10000);
+    TEST_ASSERT_EQUAL_UINT32(half, nativeLedcDuty(LASER_CHANNEL));
+    TEST_ASSERT_LESS_THAN(at, esp_timer_get_time());
+
+    TEST_ASSERT_TRUE(device.waitFor("\"id\":2,", 300));
+    device.run(50);
+    TEST_ASSERT_GREATER_THAN(half, nativeLedcDuty(LASER_CHANNEL));
+}
+
+void test_laser_off_cancels_scheduled_commands()
+{
+    device.send("LASER_OFF\n");
+    device.run(50);
+    device.take();
+
+    sendScheduled(3, 300, "LASER_ON");
+    device.run(50);
+    device.send("LASER_OFF\n");
+    TEST_ASSERT_TRUE(device.waitFor("laser turned off", 100));
+    device.run(400);
+    TEST_ASSERT_EQUAL_UINT32(0, nativeLedcDuty(LASER_CHANNEL));
+    TEST_ASSERT_TRUE(device.take().find("\"id\":3,\"command\":\"LASER_ON\",\"result\":3") != std::string::npos);
+}
+
+void test_schedule_clear_drops_waiting_commands()
+{
+    sendScheduled(4, 300, "LASER_ON");
+    device.run(50);
+    device.send("SCHEDULE_CLEAR\n");
+    TEST_ASSERT_TRUE(device.waitFor("cleared", 100));
+    device.run(400);
+    TEST_ASSERT_EQUAL_UINT32(0, nativeLedcDuty(LASER_CHANNEL));
+
+    device.take();
+    device.send("SCHEDULE_STATUS\n");
+    TEST_ASSERT_TRUE(device.waitFor("\"type\":\"schedule\"", 100));
+    device.run(100);
+    std::string status = device.take();
+    TEST_ASSERT_EQUAL(2, reportValue(status, "\"type\":\"schedule\"", "cancelled"));
+    TEST_ASSERT_EQUAL(0, reportValue(status, "\"type\":\"schedule\"", "reports_lost"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_symmetric_exchange_gives_exact_offset);
+    RUN_TEST(test_asymmetric_exchange_error_is_half_the_difference);
+    RUN_TEST(test_estimate_uses_fastest_half_and_fits_drift);
+    RUN_TEST(test_single_exchange_has_no_drift);
+    RUN_TEST(test_host_time_before_device_boot_maps_to_zero);
+
+    // Real time, so scheduling errors are the host's and not scaled up
+    device.boot(1);
+    RUN_TEST(test_scheduled_output_is_held_until_its_time);
+    RUN_TEST(test_later_command_waits_behind_scheduled_one);
+    RUN_TEST(test_laser_off_cancels_scheduled_commands);
+    RUN_TEST(test_schedule_clear_drops_waiting_commands);
+    device.finish(UNITY_END());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// ==================== CLOCK SYNC ====================
+// Offset and drift between the host clock and the device's esp_timer clock
+// from TIME_SYNC exchanges, shared by time_sync.cpp and the native tests.
+// No I/O: the caller supplies the four timestamps of each exchange.
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+struct SyncSample
+{
+    uint64_t hostSent;    // t1
+    int64_t offset;       // device - host, us
+    uint64_t roundTrip;   // (t4 - t1) - (t3 - t2)
+};
+
+struct ClockEstimate
+{
+    double offset;      // device - host at hostOrigin, us
+    double drift;       // device us gained per host us
+    uint64_t hostOrigin;
+    uint64_t bestRoundTrip;
+    size_t used;
+
+    // A host time from before the device booted maps to 0
+    uint64_t toDevice(uint64_t host) const
+    {
+        double elapsed = (double)host - (double)hostOrigin;
+        double device = (double)host + offset + drift * elapsed;
+        return device > 0 ? (uint64_t)device : 0;
+    }
+};
+
+// t1/t4 are host send/receive times, t2/t3 the device's receive/transmit
+inline SyncSample syncSample(uint64_t hostSent, uint64_t deviceReceived, uint64_t deviceSent, uint64_t hostReceived)
+{
+    SyncSample sample;
+    sample.hostSent = hostSent;
+    sample.offset = ((int64_t)(deviceReceived - hostSent) + (int64_t)(deviceSent - hostReceived)) / 2;
+    sample.roundTrip = (hostReceived - hostSent) - (deviceSent - deviceReceived);
+    return sample;
+}
+
+// Least-squares line through the fastest half of `samples` (at least one)
+inline ClockEstimate estimateClock(std::vector<SyncSample> samples)
+{
+    std::sort(samples.begin(), samples.end(),
+              [](const SyncSample &a, const SyncSample &b) { return a.roundTrip < b.roundTrip; });
+    size_t used = samples.size() > 1 ? (samples.size() + 1) / 2 : samples.size();
+    samples.resize(used);
+
+    ClockEstimate result = {0, 0, samples[0].hostSent, samples[0].roundTrip, used};
+    double meanX = 0, meanY = 0;
+    for (const SyncSample &sample : samples)
+    {
+        meanX += (double)sample.hostSent - (double)result.hostOrigin;
+        meanY += (double)sample.offset;
+    }
+    meanX /= used;
+    meanY /= used;
+
+    double covariance = 0, variance = 0;
+    for (const SyncSample &sample : samples)
+    {
+        double x = (double)sample.hostSent - (double)result.hostOrigin - meanX;
+        covariance += x * ((double)sample.offset - meanY);
+        variance += x * x;
+    }
+    result.drift = variance > 0 ? covariance / variance : 0;
+    result.offset = meanY - result.drift * meanX;
+    return result;
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+// ==================== HOST LINK ====================
+// Serial helpers shared by the host tools: open the controller's port
+// raw, switch it to binary mode and send command frames. POSIX only.
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "BinaryProtocol.h"
+
+// Command opcodes from the firmware's command table
+const uint8_t OPCODE_TEXT_MODE = 0x71;
+const uint8_t OPCODE_PING = 0x72;
+const uint8_t OPCODE_SET_BAUD = 0x79;
+const uint8_t OPCODE_BAUD_CONFIRM = 0x7A;
+
+const int KEEPALIVE_MS = 2000; // well inside the device's binary idle timeout
+const uint64_t BAUD_CONFIRM_WINDOW_US = 1000000; // device's BAUD_CONFIRM_TIMEOUT
+const uint64_t BAUD_RETRY_US = 50000;
+
+inline volatile sig_atomic_t stopRequested = 0;
+
+inline void requestStop(int signal)
+{
+    (void)signal;
+    stopRequested = 1;
+}
+
+inline uint64_t nowUs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+inline uint64_t nowMs()
+{
+    return nowUs() / 1000;
+}
+
+inline bool writeAll(int fd, const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+// Returns the frame's sequence number, or -1 if it could not be sent
+inline int sendPayload(int fd, uint8_t opcode, const uint8_t *payload, size_t length)
+{
+    static uint8_t sequence = 0;
+    uint8_t frame[FRAME_MAX_ENCODED];
+    size_t size = encodeFrame(opcode, sequence, payload, length, frame, sizeof(frame));
+    if (size == 0 || !writeAll(fd, frame, size))
+    {
+        return -1;
+    }
+    return sequence++;
+}
+
+inline bool sendCommand(int fd, uint8_t opcode, const int32_t *argument)
+{
+    uint8_t payload[4];
+    if (argument != nullptr)
+    {
+        writeInt32LE(payload, *argument);
+    }
+    return sendPayload(fd, opcode, payload, argument ? 4 : 0) >= 0;
+}
+
+inline speed_t baudConstant(uint32_t rate)
+{
+    switch (rate)
+    {
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    case 460800:
+        return B460800;
+    case 921600:
+        return B921600;
+    case 1000000:
+        return B1000000;
+    case 1500000:
+        return B1500000;
+    case 2000000:
+        return B2000000;
+    default:
+        return B0;
+    }
+}
+
+// Waits for output already written to go out first
+inline bool setPortBaud(int fd, uint32_t rate)
+{
+    termios settings;
+    speed_t speed = baudConstant(rate);
+    if (speed == B0 || tcgetattr(fd, &settings) != 0)
+    {
+        return false;
+    }
+    cfsetspeed(&settings, speed);
+    return tcsetattr(fd, TCSADRAIN, &settings) == 0;
+}
+
+inline int openPort(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    termios settings;
+    if (tcgetattr(fd, &settings) == 0)
+    {
+        cfmakeraw(&settings);
+        cfsetspeed(&settings, B115200);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+// Reads frames until one with `opcode` arrives; the rest are dropped
+inline bool awaitFrame(int fd, FrameDecoder &decoder, uint8_t opcode, uint64_t timeoutUs, uint8_t *payload,
+                       size_t capacity, size_t &length, uint64_t &receivedAt)
+{
+    uint64_t deadline = nowUs() + timeoutUs;
+    while (!stopRequested && nowUs() < deadline)
+    {
+        pollfd input = {fd, POLLIN, 0};
+        int remaining = (int)((deadline - nowUs()) / 1000) + 1;
+        if (poll(&input, 1, remaining) <= 0)
+        {
+            continue;
+        }
+        uint8_t byte;
+        if (read(fd, &byte, 1) != 1)
+        {
+            return false;
+        }
+        BinaryFrame frame;
+        if (decoder.feed(byte, frame) && frame.opcode == opcode)
+        {
+            receivedAt = nowUs();
+            length = frame.length < capacity ? frame.length : capacity;
+            memcpy(payload, frame.payload, length);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Waits for the ACK to request `sequence` of `opcode`; false on timeout or NACK
+inline bool awaitAck(int fd, FrameDecoder &decoder, uint8_t opcode, int sequence, uint64_t timeoutUs)
+{
+    uint64_t deadline = nowUs() + timeoutUs;
+    uint8_t ack[ACK_FRAME_SIZE];
+    size_t length;
+    uint64_t received;
+    for (uint64_t now = nowUs(); now < deadline; now = nowUs())
+    {
+        if (!awaitFrame(fd, decoder, FRAME_ACK, deadline - now, ack, sizeof(ack), length, received))
+        {
+            return false;
+        }
+        if (length == ACK_FRAME_SIZE && ack[0] == opcode && ack[1] == (uint8_t)sequence)
+        {
+            return ack[2] == 0;
+        }
+    }
+    return false;
+}
+
+// SET_BAUD, then BAUD_CONFIRM at the new rate until the device answers. On
+// failure the port is left at `rate`; the device goes back to its old rate.
+inline bool switchBaud(int fd, FrameDecoder &decoder, uint32_t rate)
+{
+    int32_t argument = (int32_t)rate;
+    uint8_t payload[4];
+    writeInt32LE(payload, argument);
+    int sequence = sendPayload(fd, OPCODE_SET_BAUD, payload, sizeof(payload));
+    if (sequence < 0 || !awaitAck(fd, decoder, OPCODE_SET_BAUD, sequence, 500000) || !setPortBaud(fd, rate))
+    {
+        return false;
+    }
+
+    // Confirmations sent before the device has switched are lost; it
+    // answers repeats the same, so keep sending until one gets through
+    decoder.reset();
+    uint64_t deadline = nowUs() + BAUD_CONFIRM_WINDOW_US;
+    while (nowUs() < deadline && !stopRequested)
+    {
+        sequence = sendPayload(fd, OPCODE_BAUD_CONFIRM, payload, sizeof(payload));
+        if (sequence >= 0 && awaitAck(fd, decoder, OPCODE_BAUD_CONFIRM, sequence, BAUD_RETRY_US))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Text until the device confirms the switch
+inline bool enterBinaryMode(int fd)
+{
+    const char *request = "\nBINARY_MODE\n";
+    if (!writeAll(fd, reinterpret_cast<const uint8_t *>(request), strlen(request)))
+    {
+        return false;
+    }
+
+    const char *reply = "BINARY_MODE OK";
+    size_t matched = 0;
+    uint64_t deadline = nowMs() + 3000;
+    while (nowMs() < deadline && !stopRequested)
+    {
+        pollfd input = {fd, POLLIN, 0};
+        if (poll(&input, 1, 100) <= 0)
+        {
+            continue;
+        }
+        char c;
+        if (read(fd, &c, 1) != 1)
+        {
+            return false;
+        }
+        matched = c == reply[matched] ? matched + 1 : (c == reply[0] ? 1 : 0);
+        if (reply[matched] == '\0')
+        {
+            return true;
+        }
+    }
+    fprintf(stderr, "no BINARY_MODE OK from the device\n");
+    return false;
+}
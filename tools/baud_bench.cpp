@@ -0,0 +1,202 @@
+// ==================== BAUD BENCH ====================
+// Host tool for SET_BAUD. For each serial rate it negotiates the switch,
+// then measures command latency (PING round trips, one at a time) and
+// device-to-host throughput (a HISTORY_DUMP of the 10ms tier), and prints
+// one table row per rate. Ends back at 115200 in text mode.
+//
+//   g++ -O2 -Iinclude tools/baud_bench.cpp src/BinaryProtocol.cpp -o baud_bench
+//   ./baud_bench /dev/ttyUSB0                       (every rate, 200 pings each)
+//   ./baud_bench /dev/ttyUSB0 500 921600 2000000    (just these two)
+//
+// Give the device a few seconds of uptime first so the history is full.
+// POSIX only. Works against the virtual device (--pty) as well, which
+// paces its UART at the negotiated rate.
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+#include "HostLink.h"
+
+const uint8_t OPCODE_HISTORY_DUMP = 0x38;
+
+const uint32_t RATES[] = {115200, 230400, 460800, 921600, 1000000, 1500000, 2000000};
+const uint64_t PING_TIMEOUT_US = 500000;
+const uint64_t DUMP_TIMEOUT_US = 10000000;
+
+struct BenchResult
+{
+    uint64_t switchUs;
+    std::vector<uint64_t> pings; // round trips, us
+    size_t dumpBytes;            // encoded, as they came off the wire
+    size_t dumpRows;
+    uint64_t dumpUs; // end of the first frame to end of the dump
+};
+
+static bool measurePings(int fd, FrameDecoder &decoder, int count, std::vector<uint64_t> &pings)
+{
+    for (int i = 0; i < count && !stopRequested; i++)
+    {
+        uint64_t sent = nowUs();
+        int sequence = sendPayload(fd, OPCODE_PING, nullptr, 0);
+        if (sequence < 0 || !awaitAck(fd, decoder, OPCODE_PING, sequence, PING_TIMEOUT_US))
+        {
+            return false;
+        }
+        pings.push_back(nowUs() - sent);
+    }
+    std::sort(pings.begin(), pings.end());
+    return true;
+}
+
+// Counts the bytes of a dump until the empty frame that ends it
+static bool measureDump(int fd, FrameDecoder &decoder, BenchResult &result)
+{
+    int32_t tier = 0;
+    if (!sendCommand(fd, OPCODE_HISTORY_DUMP, &tier))
+    {
+        return false;
+    }
+
+    uint64_t deadline = nowUs() + DUMP_TIMEOUT_US;
+    uint64_t first = 0;
+    uint8_t chunk[256];
+    while (!stopRequested && nowUs() < deadline)
+    {
+        pollfd input = {fd, POLLIN, 0};
+        if (poll(&input, 1, 100) <= 0)
+        {
+            continue;
+        }
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0)
+        {
+            return false;
+        }
+        for (ssize_t i = 0; i < count; i++)
+        {
+            BinaryFrame frame;
+            if (!decoder.feed(chunk[i], frame) || frame.opcode != FRAME_HISTORY ||
+                frame.length < HISTORY_FRAME_HEADER_SIZE)
+            {
+                continue;
+            }
+            // Timed from the end of the first history frame, so only the
+            // bytes after it count
+            if (first == 0)
+            {
+                first = nowUs();
+            }
+            else
+            {
+                result.dumpBytes += frame.length + FRAME_HEADER_SIZE + FRAME_CRC_SIZE + 2;
+            }
+            result.dumpRows += frame.payload[3];
+            if (frame.payload[3] == 0)
+            {
+                result.dumpUs = nowUs() - first;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, int percent)
+{
+    return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void printRow(uint32_t rate, const BenchResult &result)
+{
+    double seconds = result.dumpUs / 1e6;
+    double bytesPerSecond = seconds > 0 ? result.dumpBytes / seconds : 0;
+    printf("| %7lu | %9.1f | %6llu | %6llu | %6llu | %5zu | %8.1f | %5.0f%% |\n", (unsigned long)rate,
+           result.switchUs / 1000.0, (unsigned long long)percentile(result.pings, 0),
+           (unsigned long long)percentile(result.pings, 50), (unsigned long long)percentile(result.pings, 99),
+           result.dumpRows, bytesPerSecond / 1000, bytesPerSecond * 10 / rate * 100);
+    fflush(stdout);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s PORT [PINGS [RATE...]]\n"
+            "  PINGS  round trips per rate (default 200)\n"
+            "  RATE   rates to measure (default 115200 to 2000000)\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    int pings = argc > 2 ? atoi(argv[2]) : 200;
+    std::vector<uint32_t> rates;
+    for (int i = 3; i < argc; i++)
+    {
+        rates.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+    }
+    if (rates.empty())
+    {
+        rates.assign(RATES, RATES + sizeof(RATES) / sizeof(RATES[0]));
+    }
+    if (pings < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    int fd = openPort(argv[1]);
+    if (fd < 0 || !enterBinaryMode(fd))
+    {
+        return 1;
+    }
+
+    printf("| baud    | switch ms | ping min us | median | p99    | rows  | dump kB/s | line  |\n"
+           "|---------|-----------|-------------|--------|--------|-------|-----------|-------|\n");
+    FrameDecoder decoder;
+    uint32_t current = 115200;
+    int result = 0;
+    for (uint32_t rate : rates)
+    {
+        if (stopRequested)
+        {
+            break;
+        }
+        BenchResult bench = {};
+        uint64_t start = nowUs();
+        if (rate != current && !switchBaud(fd, decoder, rate))
+        {
+            // The device goes back on its own once the confirmation window closes
+            fprintf(stderr, "%lu: switch not confirmed\n", (unsigned long)rate);
+            setPortBaud(fd, current);
+            usleep(BAUD_CONFIRM_WINDOW_US);
+            result = 1;
+            continue;
+        }
+        bench.switchUs = nowUs() - start;
+        current = rate;
+
+        if (!measurePings(fd, decoder, pings, bench.pings) || !measureDump(fd, decoder, bench))
+        {
+            fprintf(stderr, "%lu: no reply from the device\n", (unsigned long)rate);
+            result = 1;
+            continue;
+        }
+        printRow(rate, bench);
+    }
+
+    if (current != 115200 && !switchBaud(fd, decoder, 115200))
+    {
+        fprintf(stderr, "could not get back to 115200\n");
+    }
+    sendCommand(fd, OPCODE_TEXT_MODE, nullptr);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,284 @@
+// ==================== TELEMETRY DECODER ====================
+// Host tool for TELEMETRY_STREAM. Opens the controller's serial port,
+// switches it to binary mode, starts the stream and writes one CSV line
+// per record to stdout; lost records (sequence gaps) are counted and
+// reported on stderr at the end. With --history it fetches one tier of
+// the on-device history (HISTORY_DUMP) instead and exits when it is done.
+// --baud switches the link to a faster rate first (SET_BAUD) and back at
+// the end.
+//
+//   g++ -O2 -Iinclude tools/telemetry_decode.cpp src/BinaryProtocol.cpp -o telemetry_decode
+//   ./telemetry_decode /dev/ttyUSB0 1000 10 > run.csv    (1kHz for 10s)
+//   ./telemetry_decode --baud=921600 /dev/ttyUSB0 1000 > run.csv
+//   ./telemetry_decode --history=1 /dev/ttyUSB0 > s.csv   (per-second rollups)
+//   ./telemetry_decode - < capture.bin                    (decode raw frames)
+//
+// POSIX only. Works against the virtual device (--pty) as well.
+#include <stdlib.h>
+
+#include "HostLink.h"
+#include "TelemetryHistory.h"
+#include "TelemetryRecord.h"
+
+// Command opcodes from the firmware's command table
+const uint8_t OPCODE_TELEMETRY_STREAM = 0x36;
+const uint8_t OPCODE_HISTORY_DUMP = 0x38;
+
+struct DecodeStats
+{
+    uint64_t records;
+    uint64_t lost;
+    uint64_t frames;
+    uint64_t skippedFrames; // unknown layout
+    bool started;
+    uint16_t nextSequence;
+    bool done; // history dump ended
+};
+
+static void decodeTelemetry(const BinaryFrame &frame, DecodeStats &stats)
+{
+    stats.frames++;
+    if (frame.length < TELEMETRY_FRAME_HEADER_SIZE)
+    {
+        stats.skippedFrames++;
+        return;
+    }
+    uint8_t recordSize = frame.payload[1];
+    uint8_t count = frame.payload[2];
+    // Later layouts only append fields, so any record this large decodes
+    if (recordSize < TELEMETRY_RECORD_SIZE ||
+        frame.length < TELEMETRY_FRAME_HEADER_SIZE + (size_t)recordSize * count)
+    {
+        stats.skippedFrames++;
+        return;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        TelemetryRecord record;
+        unpackTelemetryRecord(frame.payload + TELEMETRY_FRAME_HEADER_SIZE + i * recordSize, record);
+        if (stats.started)
+        {
+            stats.lost += (uint16_t)(record.sequence - stats.nextSequence);
+        }
+        stats.started = true;
+        stats.nextSequence = record.sequence + 1;
+        stats.records++;
+        printf("%u,%lu,%u,%u,%u,%u\n", record.sequence, (unsigned long)record.timeUs, record.duty,
+               record.a0, record.flags, record.outputMode);
+    }
+}
+
+// Rows skipped by the device (overwritten before their turn) count as lost
+static void decodeHistory(const BinaryFrame &frame, DecodeStats &stats)
+{
+    stats.frames++;
+    if (frame.length < HISTORY_FRAME_HEADER_SIZE)
+    {
+        stats.skippedFrames++;
+        return;
+    }
+    uint8_t tier = frame.payload[0];
+    uint8_t rowSize = frame.payload[2];
+    uint8_t count = frame.payload[3];
+    uint32_t index = (uint32_t)readInt32LE(frame.payload + 4);
+    if (frame.payload[1] != HISTORY_ROW_VERSION || tier >= HISTORY_TIERS || rowSize != TelemetryHistory::rowSize(tier) ||
+        frame.length < HISTORY_FRAME_HEADER_SIZE + (size_t)rowSize * count)
+    {
+        stats.skippedFrames++;
+        return;
+    }
+    if (count == 0)
+    {
+        stats.done = true;
+        return;
+    }
+    if (stats.started)
+    {
+        stats.lost += index - stats.nextSequence;
+    }
+    stats.started = true;
+    stats.nextSequence = index + count;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t *row = frame.payload + HISTORY_FRAME_HEADER_SIZE + i * rowSize;
+        size_t fields = (rowSize - 4) / 4;
+        printf("%lu,%lu", (unsigned long)(index + i), (unsigned long)(uint32_t)readInt32LE(row));
+        for (size_t f = 0; f < fields; f++)
+        {
+            int32_t value = readInt32LE(row + 4 + f * 4);
+            // the rollups' sample count is the only unsigned field
+            if (tier != HISTORY_RAW && f == 0)
+            {
+                printf(",%lu", (unsigned long)(uint32_t)value);
+            }
+            else
+            {
+                printf(",%ld", (long)value);
+            }
+        }
+        printf("\n");
+        stats.records++;
+    }
+}
+
+static void printHistoryHeader(uint8_t tier)
+{
+    static const char *const CHANNELS[HISTORY_CHANNELS] = {"brightness", "on_permille", "a0", "free_heap", "loop_us"};
+    printf("index,time_ms");
+    if (tier != HISTORY_RAW)
+    {
+        printf(",samples");
+    }
+    for (size_t c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        if (tier == HISTORY_RAW)
+        {
+            printf(",%s", CHANNELS[c]);
+        }
+        else
+        {
+            printf(",%s_min,%s_max,%s_mean", CHANNELS[c], CHANNELS[c], CHANNELS[c]);
+        }
+    }
+    printf("\n");
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s PORT [RATE_HZ [SECONDS]]   stream from the device (default 1000 Hz, until Ctrl-C)\n"
+            "       %s --history=TIER PORT        dump a history tier (0 raw, 1 seconds, 2 minutes)\n"
+            "       %s -                          decode raw frames from stdin\n"
+            "  --baud=RATE before PORT runs the link at RATE (up to 2000000)\n"
+            "CSV columns: sequence,time_us,duty,a0,flags,output_mode\n",
+            program, program, program);
+}
+
+int main(int argc, char **argv)
+{
+    int32_t historyTier = -1;
+    uint32_t baud = 115200;
+    for (; argc > 1 && strncmp(argv[1], "--", 2) == 0; argv++, argc--)
+    {
+        if (strncmp(argv[1], "--history=", 10) == 0)
+        {
+            historyTier = atoi(argv[1] + 10);
+        }
+        else if (strncmp(argv[1], "--baud=", 7) == 0)
+        {
+            baud = (uint32_t)strtoul(argv[1] + 7, nullptr, 10);
+        }
+        else
+        {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc < 2 || argc > 4 || historyTier >= (int32_t)HISTORY_TIERS || (historyTier >= 0 && argc > 2))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    bool live = strcmp(argv[1], "-") != 0;
+    int32_t rate = argc > 2 ? atoi(argv[2]) : 1000;
+    uint64_t seconds = argc > 3 ? strtoull(argv[3], nullptr, 10) : 0;
+    bool history = historyTier >= 0;
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    int fd = live ? openPort(argv[1]) : STDIN_FILENO;
+    FrameDecoder decoder;
+    uint8_t startOpcode = history ? OPCODE_HISTORY_DUMP : OPCODE_TELEMETRY_STREAM;
+    if (fd < 0 || (live && !enterBinaryMode(fd)))
+    {
+        return 1;
+    }
+    if (live && baud != 115200 && !switchBaud(fd, decoder, baud))
+    {
+        fprintf(stderr, "could not switch to %lu baud\n", (unsigned long)baud);
+        return 1;
+    }
+    if (live && !sendCommand(fd, startOpcode, history ? &historyTier : &rate))
+    {
+        return 1;
+    }
+
+    if (history)
+    {
+        printHistoryHeader((uint8_t)historyTier);
+    }
+    else
+    {
+        printf("sequence,time_us,duty,a0,flags,output_mode\n");
+    }
+    DecodeStats stats = {};
+    uint64_t start = nowMs();
+    uint64_t lastKeepalive = start;
+    while (!stopRequested && !stats.done && (seconds == 0 || nowMs() - start < seconds * 1000))
+    {
+        pollfd input = {fd, POLLIN, 0};
+        if (poll(&input, 1, 100) < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (live && nowMs() - lastKeepalive >= KEEPALIVE_MS)
+        {
+            sendCommand(fd, OPCODE_PING, nullptr);
+            lastKeepalive = nowMs();
+        }
+        if ((input.revents & (POLLIN | POLLHUP)) == 0)
+        {
+            continue;
+        }
+
+        uint8_t chunk[512];
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0)
+        {
+            break;
+        }
+        for (ssize_t i = 0; i < count; i++)
+        {
+            BinaryFrame frame;
+            if (!decoder.feed(chunk[i], frame))
+            {
+                continue;
+            }
+            if (frame.opcode == FRAME_TELEMETRY && !history)
+            {
+                decodeTelemetry(frame, stats);
+            }
+            else if (frame.opcode == FRAME_HISTORY && history)
+            {
+                decodeHistory(frame, stats);
+            }
+        }
+    }
+
+    if (live)
+    {
+        int32_t off = 0;
+        if (!history)
+        {
+            sendCommand(fd, OPCODE_TELEMETRY_STREAM, &off);
+        }
+        if (baud != 115200)
+        {
+            switchBaud(fd, decoder, 115200);
+        }
+        sendCommand(fd, OPCODE_TEXT_MODE, nullptr);
+        close(fd);
+    }
+    fflush(stdout);
+
+    double elapsed = (nowMs() - start) / 1000.0;
+    fprintf(stderr, "%llu records in %llu frames over %.1fs (%.0f/s), %llu lost (%.2f%%), %llu bad frames, %llu unknown layout\n",
+            (unsigned long long)stats.records, (unsigned long long)stats.frames, elapsed,
+            elapsed > 0 ? stats.records / elapsed : 0.0, (unsigned long long)stats.lost,
+            stats.records + stats.lost > 0 ? 100.0 * stats.lost / (stats.records + stats.lost) : 0.0,
+            (unsigned long long)decoder.badFrameCount(), (unsigned long long)stats.skippedFrames);
+    return 0;
+}
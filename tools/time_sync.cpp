@@ -0,0 +1,157 @@
+// ==================== TIME SYNC ====================
+// Host tool for TIME_SYNC and scheduled commands. Runs a series of
+// NTP-style exchanges with the controller, estimates the offset between
+// the host's monotonic clock and the device's 64-bit esp_timer clock and
+// how fast it drifts, and can then fire LASER_TOGGLE at a host time
+// through a SCHEDULE frame and print how close the device got.
+//
+//   g++ -O2 -Iinclude tools/time_sync.cpp src/BinaryProtocol.cpp -o time_sync
+//   ./time_sync /dev/ttyUSB0 64 100          (64 exchanges, 100ms apart)
+//   ./time_sync /dev/ttyUSB0 32 50 500       (then toggle the laser 500ms later)
+//
+// Exchanges go out one at a time. Those with the shortest round trip are
+// least affected by queueing on either side, so only the fastest half is
+// used: the offset is a least-squares line through them against host
+// time, and its slope is the drift. Several controllers synced this way
+// can be given the same host instant, each converted to its own clock.
+//
+// POSIX only. Works against the virtual device (--pty) as well.
+#include <stdlib.h>
+#include <vector>
+
+#include "ClockSync.h"
+#include "HostLink.h"
+
+// Command opcodes from the firmware's command table
+const uint8_t OPCODE_LASER_TOGGLE = 0x03;
+const uint8_t OPCODE_TIME_SYNC = 0x75;
+
+const uint64_t REPLY_TIMEOUT_US = 500000;
+
+static bool exchange(int fd, FrameDecoder &decoder, SyncSample &sample)
+{
+    uint64_t sent = nowUs();
+    if (sendPayload(fd, OPCODE_TIME_SYNC, nullptr, 0) < 0)
+    {
+        return false;
+    }
+    uint8_t payload[TIME_FRAME_SIZE];
+    size_t length;
+    uint64_t received;
+    if (!awaitFrame(fd, decoder, FRAME_TIME, REPLY_TIMEOUT_US, payload, sizeof(payload), length, received) ||
+        length < TIME_FRAME_SIZE)
+    {
+        return false;
+    }
+
+    sample = syncSample(sent, readUint64LE(payload), readUint64LE(payload + 8), received);
+    return true;
+}
+
+// Schedules LASER_TOGGLE at a host time and prints the device's report
+static void fire(int fd, FrameDecoder &decoder, const ClockEstimate &clock, uint64_t delayMs)
+{
+    uint64_t hostAt = nowUs() + delayMs * 1000;
+    uint64_t deviceAt = clock.toDevice(hostAt);
+    uint8_t payload[SCHEDULE_HEADER_SIZE];
+    writeUint64LE(payload, deviceAt);
+    payload[8] = OPCODE_LASER_TOGGLE;
+    if (sendPayload(fd, OPCODE_SCHEDULE, payload, sizeof(payload)) < 0)
+    {
+        fprintf(stderr, "could not send SCHEDULE\n");
+        return;
+    }
+    printf("scheduled LASER_TOGGLE at device %llu (host +%llums)\n", (unsigned long long)deviceAt,
+           (unsigned long long)delayMs);
+
+    char message[FRAME_MAX_PAYLOAD + 1];
+    size_t length;
+    uint64_t received;
+    uint64_t deadline = nowUs() + delayMs * 1000 + 2 * REPLY_TIMEOUT_US;
+    while (nowUs() < deadline &&
+           awaitFrame(fd, decoder, FRAME_JSON, deadline - nowUs(), reinterpret_cast<uint8_t *>(message),
+                      sizeof(message) - 1, length, received))
+    {
+        message[length] = '\0';
+        if (strstr(message, "\"type\":\"scheduled\"") != nullptr)
+        {
+            printf("%s", message);
+            return;
+        }
+    }
+    fprintf(stderr, "no scheduled report from the device\n");
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s PORT [EXCHANGES [INTERVAL_MS [FIRE_MS]]]\n"
+            "  EXCHANGES    TIME_SYNC round trips (default 32)\n"
+            "  INTERVAL_MS  spacing between them (default 50); longer runs measure drift better\n"
+            "  FIRE_MS      then schedule LASER_TOGGLE this far ahead and report the error\n"
+            "CSV on stdout: host_us,offset_us,round_trip_us\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 5)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    int exchanges = argc > 2 ? atoi(argv[2]) : 32;
+    int intervalMs = argc > 3 ? atoi(argv[3]) : 50;
+    long fireMs = argc > 4 ? atol(argv[4]) : -1;
+    if (exchanges < 1 || intervalMs < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    int fd = openPort(argv[1]);
+    if (fd < 0 || !enterBinaryMode(fd))
+    {
+        return 1;
+    }
+
+    FrameDecoder decoder;
+    std::vector<SyncSample> samples;
+    printf("host_us,offset_us,round_trip_us\n");
+    for (int i = 0; i < exchanges && !stopRequested; i++)
+    {
+        SyncSample sample;
+        if (exchange(fd, decoder, sample))
+        {
+            samples.push_back(sample);
+            printf("%llu,%lld,%llu\n", (unsigned long long)sample.hostSent, (long long)sample.offset,
+                   (unsigned long long)sample.roundTrip);
+        }
+        usleep(intervalMs * 1000);
+    }
+
+    int result = 0;
+    if (samples.empty())
+    {
+        fprintf(stderr, "no TIME_SYNC replies\n");
+        result = 1;
+    }
+    else
+    {
+        ClockEstimate clock = estimateClock(samples);
+        fprintf(stderr, "%zu/%d replies, best %zu used: offset %.0fus, drift %+.1fppm, best round trip %lluus\n",
+                samples.size(), exchanges, clock.used, clock.offset, clock.drift * 1e6,
+                (unsigned long long)clock.bestRoundTrip);
+        if (fireMs >= 0)
+        {
+            fire(fd, decoder, clock, (uint64_t)fireMs);
+        }
+    }
+
+    sendCommand(fd, OPCODE_TEXT_MODE, nullptr);
+    close(fd);
+    return result;
+}